@@ -0,0 +1,174 @@
+# distutils: language = c++
+"""The Ising engine of qft/ising, without a process per data point.
+
+The sweeps and measurements run with the GIL released, so Python threads can drive several
+lattices at once. The spins are exposed through the buffer protocol, numpy.asarray(lattice)
+is a read-only view of them with the shape of the lattice, t, z, y, x:
+
+    from mypackage import ising
+    lattice = ising.Lattice([32, 32], 227)
+    lattice.sweep(1000)
+    energy, magnet = lattice.measure(10000, gap=5)
+"""
+from cpython.buffer cimport PyBUF_WRITABLE
+from libc.stdint cimport int8_t, uint64_t
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+from cython.view cimport array as cvarray
+
+
+cdef extern from "gsl/gsl_rng.h":
+    ctypedef struct gsl_rng:
+        pass
+    void gsl_rng_set(const gsl_rng* r, unsigned long seed) nogil
+    double gsl_rng_uniform(const gsl_rng* r) nogil
+
+cdef extern from "SiteStorage.h":
+    ctypedef uint64_t siteIndex
+    cdef cppclass MappedArray[T]:
+        T* begin() nogil
+
+cdef extern from "Resampling.h":
+    unsigned long streamSeed(unsigned long seed, unsigned long stream) nogil
+
+cdef extern from "Lattice.h":
+    cdef cppclass CLattice "Lattice":
+        CLattice(const vector[unsigned int]& dims, unsigned int RNSeed) except +
+        MappedArray[int8_t] lattice
+        siteIndex latticeSize
+        vector[siteIndex] strides
+        float temp
+        float beta
+        gsl_rng* generator
+        double calcTotalEnergy() nogil
+        double calcMagnetization() nogil
+
+cdef extern from "UpdateScheduler.h":
+    cdef enum class UpdateAlgorithm:
+        pass
+    UpdateAlgorithm parseAlgorithm(const string& name) except +
+    cdef cppclass UpdateScheduler:
+        UpdateScheduler(CLattice* lattice) except +
+        unsigned long long step(UpdateAlgorithm algorithm) except + nogil
+
+
+cdef class Lattice:
+    """An Ising lattice at temperature temp, 100x kT as for ./Metropolis.
+
+    dims holds the size of every dimension, x first, 2 to 4 of them. Like ./Metropolis the
+    lattice seeds its random numbers with temp. Given a seed, it starts from the random spins
+    of stream seed of temp instead, as the jobs of ./Campaign do.
+    """
+    cdef CLattice* lattice
+    cdef UpdateScheduler* scheduler
+    cdef readonly tuple shape
+    cdef Py_ssize_t bufferShape[4]
+    cdef Py_ssize_t bufferStrides[4]
+    cdef bint busy
+
+    def __cinit__(self, dims, unsigned int temp, seed=None):
+        cdef vector[unsigned int] sizes = dims
+        self.lattice = new CLattice(sizes, temp)
+        self.scheduler = new UpdateScheduler(self.lattice)
+        cdef int d, n = sizes.size()
+        shape = []
+        for d in range(n):
+            self.bufferShape[d] = sizes[n - 1 - d]
+            self.bufferStrides[d] = self.lattice.strides[n - 1 - d] * sizeof(int8_t)
+            shape.append(sizes[n - 1 - d])
+        self.shape = tuple(shape)
+
+        cdef siteIndex i
+        if seed is not None:
+            gsl_rng_set(self.lattice.generator, streamSeed(temp, seed))
+            for i in range(self.lattice.latticeSize):
+                self.lattice.lattice.begin()[i] = -1 if gsl_rng_uniform(self.lattice.generator) < 0.5 else 1
+            self.lattice.calcTotalEnergy()
+
+    def __dealloc__(self):
+        del self.scheduler
+        del self.lattice
+
+    @property
+    def temp(self):
+        return self.lattice.temp
+
+    @property
+    def beta(self):
+        return self.lattice.beta
+
+    def __len__(self):
+        return self.lattice.latticeSize
+
+    cdef void acquire(self) except *:
+        # The lattice isn't thread safe, a second thread gets an error rather than a race.
+        if self.busy:
+            raise RuntimeError("The lattice is already running in another thread")
+        self.busy = True
+
+    def sweep(self, unsigned int steps=1, algorithm="metropolis"):
+        """Runs steps of the update of ./Metropolis --algorithm and returns the site updates.
+
+        A step is a sweep of metropolis updates, a wolff cluster, a swendsen-wang sweep, or
+        (mixed) a metropolis sweep followed by a wolff cluster.
+        """
+        cdef UpdateAlgorithm update = parseAlgorithm(algorithm.encode())
+        cdef unsigned long long updates = 0
+        cdef unsigned int s
+        self.acquire()
+        try:
+            with nogil:
+                for s in range(steps):
+                    updates += self.scheduler.step(update)
+        finally:
+            self.busy = False
+        return updates
+
+    def energy(self):
+        """The energy per spin."""
+        return self.lattice.calcTotalEnergy()
+
+    def magnetization(self):
+        """The magnetization per spin."""
+        return self.lattice.calcMagnetization()
+
+    def measure(self, unsigned int samples, unsigned int gap=5, algorithm="metropolis"):
+        """Measures the energy and magnetization per spin every gap steps of algorithm.
+
+        It returns them as two arrays of doubles, which numpy.asarray wraps without a copy.
+        """
+        cdef UpdateAlgorithm update = parseAlgorithm(algorithm.encode())
+        energy = cvarray(shape=(max(samples, 1),), itemsize=sizeof(double), format="d")
+        magnet = cvarray(shape=(max(samples, 1),), itemsize=sizeof(double), format="d")
+        cdef double[:] energyView = energy
+        cdef double[:] magnetView = magnet
+        cdef unsigned int i, s
+        self.acquire()
+        try:
+            with nogil:
+                for i in range(samples):
+                    for s in range(gap):
+                        self.scheduler.step(update)
+                    energyView[i] = self.lattice.calcTotalEnergy()
+                    magnetView[i] = self.lattice.calcMagnetization()
+        finally:
+            self.busy = False
+        return energy[:samples], magnet[:samples]
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("The spins are read-only")
+        buffer.buf = self.lattice.lattice.begin()
+        buffer.obj = self
+        buffer.len = self.lattice.latticeSize * sizeof(int8_t)
+        buffer.readonly = 1
+        buffer.itemsize = sizeof(int8_t)
+        buffer.format = "b"
+        buffer.ndim = len(self.shape)
+        buffer.shape = self.bufferShape
+        buffer.strides = self.bufferStrides
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
@@ -0,0 +1,143 @@
+# distutils: language = c++
+"""The phi^4 engine of qft/phi-theory, without a process per data point.
+
+The sweeps and measurements run with the GIL released, so Python threads can drive several
+lattices at once. The field is exposed through the buffer protocol, numpy.asarray(lattice)
+is a read-only view of it with the shape of the lattice, t, z, y, x:
+
+    from mypackage import phi4
+    lattice = phi4.Lattice(-0.9, 1.0, [32, 32], seed=1)
+    lattice.sweep(1000)
+    energy, phi, cluster = lattice.measure(10000)
+"""
+from cpython.buffer cimport PyBUF_WRITABLE
+from libc.stdint cimport uint64_t
+from libcpp.vector cimport vector
+from cython.view cimport array as cvarray
+
+
+cdef extern from "SiteStorage.h":
+    ctypedef uint64_t siteIndex
+
+cdef extern from "Lattice.h":
+    cdef cppclass CLattice "Lattice":
+        CLattice(double muSqrd, double coupling, const vector[unsigned int]& dims) except +
+        double calcTotalEnergy() nogil
+        double calcAvgPhi() nogil
+        const double* getField() nogil
+        void metropolis(siteIndex site) nogil
+        siteIndex wolff(siteIndex site) nogil
+        siteIndex getRandomSite() nogil
+        void reseed(unsigned long seed) nogil
+
+
+cdef class Lattice:
+    """A phi^4 lattice with the mass squared and the coupling in their own units, not the
+    10000x and 100x that ./Simulation takes.
+
+    dims holds the size of every dimension, x first, 2 to 4 of them. Like ./Simulation the
+    lattice seeds its random numbers with the mass and the coupling. Given a seed, it starts
+    from the random field of that seed instead.
+    """
+    cdef CLattice* lattice
+    cdef siteIndex latticeSize
+    cdef readonly tuple shape
+    cdef Py_ssize_t bufferShape[4]
+    cdef Py_ssize_t bufferStrides[4]
+    cdef bint busy
+
+    def __cinit__(self, double muSqrd, double coupling, dims, seed=None):
+        cdef vector[unsigned int] sizes = dims
+        self.lattice = new CLattice(muSqrd, coupling, sizes)
+        cdef int d, n = sizes.size()
+        cdef Py_ssize_t stride = sizeof(double)
+        for d in range(n):
+            self.bufferStrides[n - 1 - d] = stride
+            self.bufferShape[n - 1 - d] = sizes[d]
+            stride *= sizes[d]
+        self.latticeSize = stride // sizeof(double)
+        shape = []
+        for d in range(n):
+            shape.append(self.bufferShape[d])
+        self.shape = tuple(shape)
+        if seed is not None:
+            self.lattice.reseed(seed)
+
+    def __dealloc__(self):
+        del self.lattice
+
+    def __len__(self):
+        return self.latticeSize
+
+    cdef void acquire(self) except *:
+        # The lattice isn't thread safe, a second thread gets an error rather than a race.
+        if self.busy:
+            raise RuntimeError("The lattice is already running in another thread")
+        self.busy = True
+
+    cdef siteIndex step(self, unsigned int gap) noexcept nogil:
+        # gap sweeps of metropolis updates then a wolff cluster, as a step of ./Simulation.
+        cdef siteIndex j
+        for j in range(self.latticeSize * gap):
+            self.lattice.metropolis(self.lattice.getRandomSite())
+        return self.lattice.wolff(self.lattice.getRandomSite())
+
+    def sweep(self, unsigned int steps=1, unsigned int gap=5):
+        """Runs steps of gap metropolis sweeps followed by a wolff cluster."""
+        cdef unsigned int s
+        self.acquire()
+        try:
+            with nogil:
+                for s in range(steps):
+                    self.step(gap)
+        finally:
+            self.busy = False
+
+    def energy(self):
+        """The total energy."""
+        return self.lattice.calcTotalEnergy()
+
+    def phi(self):
+        """The average field."""
+        return self.lattice.calcAvgPhi()
+
+    def measure(self, unsigned int samples, unsigned int gap=5):
+        """Measures the energy, the average field and the wolff cluster size after every step.
+
+        It returns them as three arrays of doubles, which numpy.asarray wraps without a copy.
+        """
+        energy = cvarray(shape=(max(samples, 1),), itemsize=sizeof(double), format="d")
+        phi = cvarray(shape=(max(samples, 1),), itemsize=sizeof(double), format="d")
+        cluster = cvarray(shape=(max(samples, 1),), itemsize=sizeof(double), format="d")
+        cdef double[:] energyView = energy
+        cdef double[:] phiView = phi
+        cdef double[:] clusterView = cluster
+        cdef unsigned int i
+        self.acquire()
+        try:
+            with nogil:
+                for i in range(samples):
+                    clusterView[i] = self.step(gap)
+                    energyView[i] = self.lattice.calcTotalEnergy()
+                    phiView[i] = self.lattice.calcAvgPhi()
+        finally:
+            self.busy = False
+        return energy[:samples], phi[:samples], cluster[:samples]
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("The field is read-only")
+        buffer.buf = <void*>self.lattice.getField()
+        buffer.obj = self
+        buffer.len = self.latticeSize * sizeof(double)
+        buffer.readonly = 1
+        buffer.itemsize = sizeof(double)
+        buffer.format = "d"
+        buffer.ndim = len(self.shape)
+        buffer.shape = self.bufferShape
+        buffer.strides = self.bufferStrides
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
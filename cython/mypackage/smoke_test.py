@@ -0,0 +1,42 @@
+"""Smoke test of the qft extensions, run by the Dockerfile once they are compiled.
+
+Every engine is constructed, swept and measured, and its lattice is read through
+numpy.asarray. It only checks that the bindings work, not the physics.
+"""
+import numpy as np
+
+from mypackage import ising, phi4
+
+
+def check_ising():
+    lattice = ising.Lattice([8, 6], 227, seed=1)
+    assert lattice.shape == (6, 8) and len(lattice) == 48
+    assert lattice.sweep(10) == 10 * 48
+    lattice.sweep(2, algorithm='wolff')
+    energy, magnet = lattice.measure(20, gap=1)
+    energy, magnet = np.asarray(energy), np.asarray(magnet)
+    assert energy.shape == (20,) and magnet.shape == (20,)
+    assert np.all(energy >= -2) and np.all(energy <= 2) and np.all(np.abs(magnet) <= 1)
+
+    spins = np.asarray(lattice)
+    assert spins.shape == (6, 8) and spins.dtype == np.int8 and not spins.flags.writeable
+    assert set(np.unique(spins)) <= {-1, 1}
+    assert np.isclose(spins.mean(), lattice.magnetization())
+
+
+def check_phi4():
+    lattice = phi4.Lattice(-0.9, 1.0, [8, 6], seed=1)
+    assert lattice.shape == (6, 8) and len(lattice) == 48
+    lattice.sweep(10, gap=1)
+    energy, phi, cluster = (np.asarray(a) for a in lattice.measure(20, gap=1))
+    assert energy.shape == (20,) and phi.shape == (20,) and np.all(cluster >= 1)
+
+    field = np.asarray(lattice)
+    assert field.shape == (6, 8) and field.dtype == np.float64 and not field.flags.writeable
+    assert np.isclose(field.mean(), lattice.phi())
+
+
+if __name__ == '__main__':
+    check_ising()
+    check_phi4()
+    print('mypackage: ising and phi4 extensions OK')
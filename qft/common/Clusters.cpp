@@ -0,0 +1,251 @@
+/* Clusters.cpp
+Implements the Hoshen-Kopelman labelling and the statistics of the clusters.
+*/
+#include "Clusters.h"
+#include <algorithm>  // max, min.
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include "Resampling.h"  // streamSeed.
+
+
+ClusterLabeller::ClusterLabeller(const std::vector<unsigned int>& sizes, unsigned int threads, unsigned long randomSeed)
+    : dims(sizes), sites(1), seed(randomSeed), labellings(0) {
+    if (dims.size() > maxDimensions)
+        throw std::runtime_error("Clusters are labelled on lattices of up to 4 dimensions");
+    for (unsigned int size : dims) {
+        strides.push_back(sites);
+        sites *= size;
+    }
+    if (sites > (siteIndex)std::numeric_limits<std::int32_t>::max())
+        throw std::runtime_error("Clusters are labelled on lattices of fewer than 2^31 sites");
+
+    // Whole slices of the last dimension per strip, so the strips only meet along it.
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int slices = dims.back();
+    unsigned int count = std::min(threads, slices);
+    siteIndex slice = strides.back();
+    for (unsigned int t = 0; t <= count; t++)
+        strips.push_back((siteIndex)slices * t / count * slice);
+
+    field.resize(sites);
+    parent.resize(sites);
+    offsets.resize(sites * dims.size());
+    wraps.resize(sites);
+    labels.resize(sites);
+}
+
+
+// The position of the neighbour is that of site plus one step along d, also across the
+// boundaries. The bond is decided by the hash of the seed, the labelling and the bond.
+bool ClusterLabeller::bonded(siteIndex site, unsigned int d, siteIndex neighbour, double coupling,
+                             unsigned long bondSeed) const {
+    double product = field[site] * field[neighbour];
+    if (!(product > 0))
+        return false;
+    if (std::isinf(coupling))
+        return true;
+    double u = (streamSeed(bondSeed, site * dims.size() + d) >> 11) * 0x1.0p-53;
+    return u < 1 - std::exp(-2 * coupling * product);
+}
+
+
+// findRoot returns the root of site and sets toRoot to the position of the root minus that of
+// site. Every site on the way is then pointed at the root directly.
+siteIndex ClusterLabeller::findRoot(siteIndex site, std::int32_t* toRoot) {
+    unsigned int n = dims.size();
+    for (unsigned int d = 0; d < n; d++)
+        toRoot[d] = 0;
+    siteIndex root = site;
+    while (parent[root] != root) {
+        for (unsigned int d = 0; d < n; d++)
+            toRoot[d] += offsets[root * n + d];
+        root = parent[root];
+    }
+
+    std::int32_t remaining[maxDimensions];
+    for (unsigned int d = 0; d < n; d++)
+        remaining[d] = toRoot[d];
+    while (parent[site] != root && site != root) {
+        siteIndex next = parent[site];
+        for (unsigned int d = 0; d < n; d++) {
+            std::int32_t step = offsets[site * n + d];
+            offsets[site * n + d] = remaining[d];
+            remaining[d] -= step;
+        }
+        parent[site] = root;
+        site = next;
+    }
+    return root;
+}
+
+
+// join bonds site to neighbour, one step along d from it. The root with the larger index is
+// attached to the other one, so every root stays the first site of its cluster.
+void ClusterLabeller::join(siteIndex site, unsigned int d, siteIndex neighbour) {
+    unsigned int n = dims.size();
+    std::int32_t toRootA[maxDimensions], toRootB[maxDimensions];
+    siteIndex a = findRoot(site, toRootA);
+    siteIndex b = findRoot(neighbour, toRootB);
+
+    // Position of root a minus that of root b.
+    std::int32_t between[maxDimensions];
+    bool loop = false;
+    for (unsigned int e = 0; e < n; e++) {
+        between[e] = toRootA[e] - toRootB[e] - (e == d ? 1 : 0);
+        loop = loop || between[e] != 0;
+    }
+
+    if (a == b) {
+        if (loop)
+            wraps[a] = 1;
+        return;
+    }
+    if (a > b) {
+        std::swap(a, b);
+        for (unsigned int e = 0; e < n; e++)
+            between[e] = -between[e];
+    }
+    parent[b] = a;
+    for (unsigned int e = 0; e < n; e++)
+        offsets[b * n + e] = between[e];
+    wraps[a] = wraps[a] || wraps[b];
+}
+
+
+// joinBonds joins the bonds of the sites from from to end of the strip [begin, end), either
+// those to neighbours inside the strip or those to neighbours outside of it.
+void ClusterLabeller::joinBonds(siteIndex begin, siteIndex end, siteIndex from, bool inside,
+                                double coupling, unsigned long bondSeed) {
+    for (siteIndex i = from; i < end; i++) {
+        for (unsigned int d = 0; d < dims.size(); d++) {
+            siteIndex neighbour = i + strides[d];
+            if (neighbour >= sites)
+                neighbour -= sites;
+            if ((neighbour >= begin && neighbour < end) == inside && bonded(i, d, neighbour, coupling, bondSeed))
+                join(i, d, neighbour);
+        }
+    }
+}
+
+
+void ClusterLabeller::labelField(double coupling) {
+    unsigned long bondSeed = streamSeed(seed, labellings++);
+    unsigned int count = strips.size() - 1;
+
+    auto inside = [&](unsigned int t) {
+        for (siteIndex i = strips[t]; i < strips[t + 1]; i++) {
+            parent[i] = i;
+            wraps[i] = 0;
+        }
+        joinBonds(strips[t], strips[t + 1], strips[t], true, coupling, bondSeed);
+    };
+    if (count == 1) {
+        inside(0);
+    } else {
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < count; t++)
+            workers.emplace_back(inside, t);
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    // Only the last slice of a strip has neighbours in the next strips.
+    for (unsigned int t = 0; t < count; t++) {
+        siteIndex from = std::max(strips[t], strips[t + 1] - strides.back());
+        joinBonds(strips[t], strips[t + 1], from, false, coupling, bondSeed);
+    }
+
+    // Roots come before the rest of their cluster, so one pass labels every site.
+    clusterSizes.clear();
+    weights.clear();
+    wrapping.clear();
+    std::int32_t toRoot[maxDimensions];
+    for (siteIndex i = 0; i < sites; i++) {
+        siteIndex root = findRoot(i, toRoot);
+        if (root == i) {
+            labels[i] = clusterSizes.size();
+            clusterSizes.push_back(0);
+            weights.push_back(0.0);
+            wrapping.push_back(wraps[i]);
+        } else {
+            labels[i] = labels[root];
+        }
+        clusterSizes[labels[i]]++;
+        weights[labels[i]] += std::fabs(field[i]);
+    }
+}
+
+
+void ClusterStatistics::addGeometric(const ClusterLabeller& labeller) {
+    sites = labeller.getSites();
+    siteIndex biggest = 0;
+    for (siteIndex size : labeller.getSizes()) {
+        distribution[size]++;
+        biggest = std::max(biggest, size);
+    }
+    unsigned int wrappers = 0;
+    for (char wraps : labeller.getWrapping())
+        wrappers += wraps ? 1 : 0;
+
+    measurements++;
+    clusters += labeller.getClusters();
+    largest += (double)biggest / sites;
+    wrapped += (wrappers > 0) ? 1 : 0;
+    wrappingClusters += wrappers;
+}
+
+
+void ClusterStatistics::addImproved(const ClusterLabeller& labeller) {
+    sites = labeller.getSites();
+    double sum = 0.0;
+    for (double weight : labeller.getWeights())
+        sum += weight * weight;
+    secondMoment += sum / ((double)sites * sites);
+    improvedMeasurements++;
+}
+
+
+double ClusterStatistics::meanClusters() const {
+    return measurements > 0 ? clusters / measurements : 0.0;
+}
+
+
+double ClusterStatistics::meanLargest() const {
+    return measurements > 0 ? largest / measurements : 0.0;
+}
+
+
+double ClusterStatistics::wrappingProbability() const {
+    return measurements > 0 ? wrapped / measurements : 0.0;
+}
+
+
+double ClusterStatistics::improvedSecondMoment() const {
+    return improvedMeasurements > 0 ? secondMoment / improvedMeasurements : 0.0;
+}
+
+
+void ClusterStatistics::write(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file for writing: " + path);
+    file << "# sites=" << sites << " measurements=" << measurements << "\n";
+    file << "# size, clusters of that size per measurement\n";
+    for (const auto& [size, count] : distribution)
+        file << size << "\t" << (double)count / measurements << "\n";
+    if (!file)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+
+void ClusterStatistics::report(FILE* out, double beta) const {
+    fprintf(out, "clusters: %.2f geometric clusters, largest %.4f of the sites, wrapping in %.3f of %zu measurements (%.3f clusters)\n",
+            meanClusters(), meanLargest(), wrappingProbability(), measurements,
+            measurements > 0 ? wrappingClusters / measurements : 0.0);
+    if (improvedMeasurements > 0)
+        fprintf(out, "clusters: improved <m^2> %f, chi' = beta N <m^2> %f\n",
+                improvedSecondMoment(), beta * sites * improvedSecondMoment());
+}
@@ -0,0 +1,117 @@
+/* Clusters.h
+Hoshen-Kopelman labelling of every cluster of a lattice, and statistics of the clusters.
+
+A labelling scans the sites in order and joins each one to its next neighbour along every
+dimension when the two are bonded, with union-find on the site indices. Neighbours of the same
+sign are bonded with probability 1 - exp(-2 coupling x_i x_j). An infinite coupling gives the
+geometric clusters. The coupling of the action gives the Fortuin-Kasteleyn clusters of the
+Ising spins, or of the signs of phi (the embedding of the wolff update), whose sizes are
+improved estimators of the susceptibility: <M^2> = <sum over clusters of (sum of |x|)^2>.
+The random number of a bond is a hash of the seed, the labelling and the bond, so it doesn't
+depend on the number of threads and the generator of the lattice is left alone.
+
+The scan is split into strips of slices of the last dimension. Every thread joins the bonds
+inside its strip, then one thread joins the bonds between the strips. Every site keeps its
+displacement from its parent in steps along every dimension. A bond inside a cluster whose
+two ends disagree on their displacement from the root closes a loop around the lattice, and
+that cluster wraps around it (percolates). With the helical boundary conditions such a loop
+around x is L_x steps along x and one step back along y, and so on.
+*/
+#ifndef _CLUSTERS_H
+#define _CLUSTERS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+#include "SiteStorage.h"
+
+
+class ClusterLabeller {
+    public:
+    static const unsigned int maxDimensions = 4;
+    static constexpr double geometric = std::numeric_limits<double>::infinity();
+
+    // sizes holds the size of every dimension of the lattice, x first. The strips are shared by
+    // threads threads, 0 uses every core. It throws std::runtime_error for lattices with more
+    // than 2^31 sites, whose displacements wouldn't fit.
+    ClusterLabeller(const std::vector<unsigned int>& sizes, unsigned int threads, unsigned long randomSeed);
+
+    // label finds the clusters of one configuration, values holds one value per site.
+    template <typename T>
+    void label(const T* values, double coupling) {
+        for (siteIndex i = 0; i < sites; i++)
+            field[i] = values[i];
+        labelField(coupling);
+    }
+
+    // The clusters of the last labelling, numbered in the order of their first site.
+    siteIndex getClusters() const { return clusterSizes.size(); }
+    siteIndex labelOf(siteIndex site) const { return labels[site]; }
+    const std::vector<siteIndex>& getSizes() const { return clusterSizes; }
+    const std::vector<double>& getWeights() const { return weights; }  // Sum of |x| over every cluster.
+    const std::vector<char>& getWrapping() const { return wrapping; }   // Whether every cluster wraps.
+    siteIndex getSites() const { return sites; }
+    unsigned int getThreads() const { return strips.size(); }
+
+    private:
+    void labelField(double coupling);
+    void joinBonds(siteIndex begin, siteIndex end, siteIndex from, bool inside, double coupling, unsigned long bondSeed);
+    bool bonded(siteIndex site, unsigned int d, siteIndex neighbour, double coupling, unsigned long bondSeed) const;
+    siteIndex findRoot(siteIndex site, std::int32_t* toRoot);
+    void join(siteIndex site, unsigned int d, siteIndex neighbour);
+
+    std::vector<unsigned int> dims;
+    std::vector<siteIndex> strides;
+    siteIndex sites;
+    unsigned long seed;
+    unsigned long labellings;
+    std::vector<siteIndex> strips;  // First site of every strip, and the end of the last one.
+
+    std::vector<double> field;
+    std::vector<siteIndex> parent;       // Union-find forest, every root is the first site of its cluster.
+    std::vector<std::int32_t> offsets;   // Position of the parent minus that of the site, per dimension.
+    std::vector<char> wraps;             // Set on the roots of the clusters that wrap around.
+
+    std::vector<siteIndex> labels;
+    std::vector<siteIndex> clusterSizes;
+    std::vector<double> weights;
+    std::vector<char> wrapping;
+};
+
+
+// ClusterStatistics accumulates the clusters of the measurements.
+class ClusterStatistics {
+    public:
+    // addGeometric adds the size distribution, the largest cluster and the wrapping clusters.
+    void addGeometric(const ClusterLabeller& labeller);
+    // addImproved adds the improved estimator of <m^2>, from Fortuin-Kasteleyn clusters.
+    void addImproved(const ClusterLabeller& labeller);
+
+    std::size_t size() const { return measurements; }
+    double meanClusters() const;
+    double meanLargest() const;          // Fraction of the sites in the largest cluster.
+    double wrappingProbability() const;  // Fraction of the measurements with a wrapping cluster.
+    double improvedSecondMoment() const;  // <sum over clusters of (sum of |x|)^2> / N^2.
+
+    // write saves the cluster size distribution, the number of clusters of every size per measurement.
+    // It throws std::runtime_error if the file can't be written.
+    void write(const std::string& path) const;
+    // report prints the averages, chi' = beta N <m^2> from the improved estimator among them.
+    void report(FILE* out, double beta) const;
+
+    private:
+    std::map<siteIndex, unsigned long long> distribution;
+    std::size_t measurements = 0;
+    std::size_t improvedMeasurements = 0;
+    siteIndex sites = 0;
+    double clusters = 0.0;
+    double largest = 0.0;
+    double wrapped = 0.0;
+    double wrappingClusters = 0.0;
+    double secondMoment = 0.0;
+};
+
+#endif // _CLUSTERS_H
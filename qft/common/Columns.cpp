@@ -0,0 +1,280 @@
+/* Columns.cpp
+Implements the columnar files of the time series.
+*/
+#include "Columns.h"
+#include <cctype>     // isalpha.
+#include <cstdio>     // snprintf.
+#include <cstdlib>    // strtod.
+#include <cstring>    // memcmp.
+#include <stdexcept>  // runtime_error.
+
+
+static const char magic[8] = {'Q', 'F', 'T', 'C', 'O', 'L', 'S', '1'};
+static const std::uint64_t prefixBytes = 24;
+static const std::uint64_t alignment = 64;
+static const std::size_t bufferRows = 8192;  // 64 KiB per column and write.
+
+static std::uint64_t align(std::uint64_t bytes) {
+    return (bytes + alignment - 1) / alignment * alignment;
+}
+
+static std::string quote(const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+template <typename T>
+static void put(std::ostream& file, T value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+
+ColumnWriter::ColumnWriter(const std::filesystem::path& path, const std::vector<std::string>& names,
+                           std::uint64_t rowCapacity, const ColumnAttributes& attributes)
+        : buffers(names.size()), capacity(rowCapacity), rows(0), written(0) {
+    // The offsets depend on the length of the header, which holds them. Reserving 64 bytes for
+    // the fields of every column gives a length that doesn't depend on them.
+    std::string text = "{\"format\": \"qft-columns\", \"version\": 1, \"capacity\": " + std::to_string(capacity)
+                     + ",\n \"attributes\": {";
+    char number[64];
+    for (std::size_t i = 0; i < attributes.size(); i++) {
+        snprintf(number, sizeof(number), "%.17g", attributes[i].second);
+        text += (i > 0 ? ", " : "") + quote(attributes[i].first) + ": " + number;
+    }
+    text += "},\n \"columns\": [";
+    std::uint64_t headerBytes = text.size() + 4;
+    for (const std::string& name : names)
+        headerBytes += quote(name).size() + 64;
+    std::uint64_t offset = align(prefixBytes + headerBytes);
+    for (std::size_t c = 0; c < names.size(); c++) {
+        offsets.push_back(offset);
+        text += std::string(c > 0 ? ",\n  " : "\n  ") + "{\"name\": " + quote(names[c]) + ", \"dtype\": \"<f8\", \"offset\": "
+              + std::to_string(offset) + "}";
+        offset += align(capacity * sizeof(double));
+    }
+    text += "]}";
+    text.resize(headerBytes - 1, ' ');
+    text += '\n';
+
+    file.open(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file for writing: " + path.string());
+    file.write(magic, sizeof(magic));
+    put<std::uint64_t>(file, 0);
+    put<std::uint64_t>(file, text.size());
+    file << text;
+    file.flush();
+    // The blocks of the columns are left as holes until they are written.
+    std::filesystem::resize_file(path, offset);
+    for (std::vector<double>& buffer : buffers)
+        buffer.reserve(bufferRows);
+}
+
+
+ColumnWriter::~ColumnWriter() {
+    flush();
+}
+
+
+void ColumnWriter::append(const std::vector<double>& row) {
+    if (row.size() != buffers.size())
+        throw std::runtime_error("A row of a columnar file has a value per column");
+    if (rows == capacity)
+        throw std::runtime_error("Too many rows for the columnar file, its capacity is " + std::to_string(capacity));
+    for (std::size_t c = 0; c < row.size(); c++)
+        buffers[c].push_back(row[c]);
+    rows++;
+    if (rows - written == bufferRows)
+        flush();
+}
+
+
+void ColumnWriter::flush() {
+    if (rows == written)
+        return;
+    for (std::size_t c = 0; c < buffers.size(); c++) {
+        file.seekp(offsets[c] + written * sizeof(double));
+        file.write(reinterpret_cast<const char*>(buffers[c].data()), buffers[c].size() * sizeof(double));
+        buffers[c].clear();
+    }
+    written = rows;
+    file.seekp(sizeof(magic));
+    put(file, rows);
+    file.flush();
+}
+
+
+// The header is scanned for the keys ColumnWriter writes, other values are skipped.
+namespace {
+
+class HeaderScanner {
+    public:
+    explicit HeaderScanner(const std::string& header) : text(header), at(0) {}
+
+    char peek() {
+        while (at < text.size() && (text[at] == ' ' || text[at] == '\n' || text[at] == '\t' || text[at] == '\r'))
+            at++;
+        return at < text.size() ? text[at] : '\0';
+    }
+
+    void expect(char c) {
+        if (peek() != c)
+            throw std::runtime_error(std::string("Malformed columnar header, expected ") + c);
+        at++;
+    }
+
+    // next consumes c if it comes next.
+    bool next(char c) {
+        if (peek() != c)
+            return false;
+        at++;
+        return true;
+    }
+
+    std::string string() {
+        expect('"');
+        std::string out;
+        while (at < text.size() && text[at] != '"') {
+            if (text[at] == '\\')
+                at++;
+            if (at < text.size())
+                out += text[at++];
+        }
+        expect('"');
+        return out;
+    }
+
+    double number() {
+        peek();
+        const char* start = text.c_str() + at;
+        char* end;
+        double value = strtod(start, &end);
+        if (end == start)
+            throw std::runtime_error("Malformed columnar header, expected a number");
+        at += end - start;
+        return value;
+    }
+
+    void skip() {
+        char c = peek();
+        if (c == '"') {
+            string();
+        } else if (c == '{' || c == '[') {
+            char close = (c == '{') ? '}' : ']';
+            at++;
+            if (next(close))
+                return;
+            do {
+                if (c == '{') {
+                    string();
+                    expect(':');
+                }
+                skip();
+            } while (next(','));
+            expect(close);
+        } else if (c == 't' || c == 'f' || c == 'n') {
+            while (at < text.size() && isalpha((unsigned char)text[at]))
+                at++;
+        } else {
+            number();
+        }
+    }
+
+    private:
+    const std::string& text;
+    std::size_t at;
+};
+
+}  // namespace
+
+
+bool ColumnReader::isColumnar(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    char start[sizeof(magic)];
+    return file.read(start, sizeof(start)) && memcmp(start, magic, sizeof(magic)) == 0;
+}
+
+
+ColumnReader::ColumnReader(const std::filesystem::path& filePath) : path(filePath) {
+    std::ifstream file(path, std::ios::binary);
+    char start[sizeof(magic)];
+    std::uint64_t headerBytes = 0;
+    if (!file.read(start, sizeof(start)) || memcmp(start, magic, sizeof(magic)) != 0
+        || !file.read(reinterpret_cast<char*>(&rows), sizeof(rows))
+        || !file.read(reinterpret_cast<char*>(&headerBytes), sizeof(headerBytes)))
+        throw std::runtime_error("Not a columnar file: " + path.string());
+    std::string header(headerBytes, '\0');
+    if (!file.read(header.data(), headerBytes))
+        throw std::runtime_error("Truncated columnar file: " + path.string());
+
+    HeaderScanner scanner(header);
+    scanner.expect('{');
+    do {
+        std::string key = scanner.string();
+        scanner.expect(':');
+        if (key == "attributes") {
+            scanner.expect('{');
+            if (!scanner.next('}')) {
+                do {
+                    std::string name = scanner.string();
+                    scanner.expect(':');
+                    attributes[name] = scanner.number();
+                } while (scanner.next(','));
+                scanner.expect('}');
+            }
+        } else if (key == "columns") {
+            scanner.expect('[');
+            do {
+                std::string name, dtype;
+                std::uint64_t offset = 0;
+                scanner.expect('{');
+                do {
+                    std::string field = scanner.string();
+                    scanner.expect(':');
+                    if (field == "name")
+                        name = scanner.string();
+                    else if (field == "dtype")
+                        dtype = scanner.string();
+                    else if (field == "offset")
+                        offset = scanner.number();
+                    else
+                        scanner.skip();
+                } while (scanner.next(','));
+                scanner.expect('}');
+                if (dtype != "<f8")
+                    throw std::runtime_error("Unsupported column type " + dtype + " in " + path.string());
+                offsets[name] = offset;
+            } while (scanner.next(','));
+            scanner.expect(']');
+        } else {
+            scanner.skip();
+        }
+    } while (scanner.next(','));
+    scanner.expect('}');
+}
+
+
+std::vector<double> ColumnReader::column(const std::string& name) const {
+    auto found = offsets.find(name);
+    if (found == offsets.end())
+        throw std::runtime_error("No column " + name + " in " + path.string());
+    std::vector<double> values(rows);
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(found->second);
+    if (!file.read(reinterpret_cast<char*>(values.data()), rows * sizeof(double)))
+        throw std::runtime_error("Truncated column " + name + " in " + path.string());
+    return values;
+}
+
+
+double ColumnReader::attribute(const std::string& name) const {
+    auto found = attributes.find(name);
+    if (found == attributes.end())
+        throw std::runtime_error("No attribute " + name + " in " + path.string());
+    return found->second;
+}
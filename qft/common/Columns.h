@@ -0,0 +1,80 @@
+/* Columns.h
+A self-describing columnar file of time series, which numpy can map without copying them
+(see columnar.py).
+
+    0   "QFTCOLS1"
+    8   rows written so far, u64
+    16  length of the header, u64
+    24  the header: JSON, padded with spaces
+        {"format": "qft-columns", "version": 1, "capacity": N,
+         "attributes": {"temp": 2.27, ...},
+         "columns": [{"name": "energy", "dtype": "<f8", "offset": 4096}, ...]}
+
+Every column is a block of capacity little-endian doubles at its offset, aligned to 64 bytes.
+The rows are buffered and written a few thousand at a time, the count at offset 8 is updated
+after every write, so a file is readable while it is written and after a crash.
+*/
+#ifndef _COLUMNS_H
+#define _COLUMNS_H
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "The columnar files are written in the byte order of the host, which must be little-endian."
+#endif
+
+
+typedef std::vector<std::pair<std::string, double>> ColumnAttributes;
+
+class ColumnWriter {
+    public:
+    // The file holds at most capacity rows of the named columns. It throws std::runtime_error
+    // if the file can't be written.
+    ColumnWriter(const std::filesystem::path& path, const std::vector<std::string>& names,
+                 std::uint64_t capacity, const ColumnAttributes& attributes = {});
+    ~ColumnWriter();
+
+    // append adds a row, one value per column. It throws std::runtime_error past the capacity.
+    void append(const std::vector<double>& row);
+    void flush();
+
+    std::uint64_t getRows() const { return rows; }
+
+    private:
+    std::ofstream file;
+    std::vector<std::uint64_t> offsets;
+    std::vector<std::vector<double>> buffers;  // The rows not written yet, column by column.
+    std::uint64_t capacity;
+    std::uint64_t rows;
+    std::uint64_t written;
+};
+
+class ColumnReader {
+    public:
+    // It throws std::runtime_error if path isn't a columnar file.
+    explicit ColumnReader(const std::filesystem::path& path);
+
+    // isColumnar checks the magic of the file at path.
+    static bool isColumnar(const std::filesystem::path& path);
+
+    std::uint64_t getRows() const { return rows; }
+    bool has(const std::string& name) const { return offsets.count(name) > 0; }
+    // column reads every row of a column, attribute the value of an attribute, they throw
+    // std::runtime_error if it is missing.
+    std::vector<double> column(const std::string& name) const;
+    double attribute(const std::string& name) const;
+
+    private:
+    std::filesystem::path path;
+    std::uint64_t rows;
+    std::map<std::string, std::uint64_t> offsets;
+    std::map<std::string, double> attributes;
+};
+
+#endif // _COLUMNS_H
@@ -0,0 +1,172 @@
+/* Correlations.cpp
+Implements the FFT measurements of the two-point correlation function.
+*/
+#include "Correlations.h"
+#include <algorithm>  // min.
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <gsl/gsl_errno.h>
+
+
+Correlations::Correlations(const std::vector<unsigned int>& sizes)
+    : dims(sizes), sites(1), measurements(0), series(sizes.size() + 1) {
+    for (unsigned int size : sizes) {
+        strides.push_back(sites);
+        sites *= size;
+    }
+    buffer.resize(sites);
+    spectrum.assign(sites / 2 + 1, 0.0);
+    wavetable = gsl_fft_real_wavetable_alloc(sites);
+    inverseWavetable = gsl_fft_halfcomplex_wavetable_alloc(sites);
+    workspace = gsl_fft_real_workspace_alloc(sites);
+    if (!wavetable || !inverseWavetable || !workspace)
+        throw std::runtime_error("Failed to allocate the FFT of " + std::to_string(sites) + " sites");
+}
+
+
+Correlations::~Correlations() {
+    gsl_fft_real_wavetable_free(wavetable);
+    gsl_fft_halfcomplex_wavetable_free(inverseWavetable);
+    gsl_fft_real_workspace_free(workspace);
+}
+
+
+// The transform is left in halfcomplex order: F(0), then the real and imaginary parts
+// of F(k) for 0 < k < N / 2, then F(N / 2) if N is even.
+void Correlations::transform() {
+    if (gsl_fft_real_transform(buffer.data(), 1, sites, wavetable, workspace) != GSL_SUCCESS)
+        throw std::runtime_error("FFT of the lattice failed");
+
+    auto powerOf = [this](siteIndex k) {
+        if (k == 0)
+            return buffer[0] * buffer[0];
+        if (2 * k == sites)
+            return buffer[sites - 1] * buffer[sites - 1];
+        return buffer[2*k - 1] * buffer[2*k - 1] + buffer[2*k] * buffer[2*k];
+    };
+    for (siteIndex k = 0; k < spectrum.size(); k++)
+        spectrum[k] += powerOf(k);
+    measurements++;
+
+    // The structure factors of this configuration, the lowest modes are at most N / 2.
+    series[0].push_back(powerOf(0) / sites);
+    for (unsigned int d = 0; d < dims.size(); d++)
+        series[d + 1].push_back(powerOf(lowestMode(dims, d)) / sites);
+}
+
+
+double Correlations::power(siteIndex mode) const {
+    mode %= sites;
+    return spectrum[std::min(mode, sites - mode)];
+}
+
+
+double Correlations::structureFactor(unsigned int d, unsigned int n) const {
+    if (measurements == 0)
+        return 0.0;
+    return power(n * lowestMode(dims, d)) / ((double)sites * measurements);
+}
+
+
+siteIndex lowestMode(const std::vector<unsigned int>& dims, unsigned int d) {
+    siteIndex mode = 1;
+    for (unsigned int e = d + 1; e < dims.size(); e++)
+        mode *= dims[e];
+    return mode;
+}
+
+
+double modeMomentum(const std::vector<unsigned int>& dims, siteIndex mode) {
+    siteIndex sites = 1;
+    for (unsigned int size : dims)
+        sites *= size;
+    mode %= sites;
+
+    double squared = 0.0;
+    siteIndex stride = 1;
+    for (unsigned int size : dims) {
+        // The phase per step is taken modulo 2 pi before it is turned into a double.
+        siteIndex turns = (siteIndex)(((unsigned __int128)mode * stride) % sites);
+        double s = std::sin(M_PI * turns / sites);
+        squared += 4 * s * s;
+        stride *= size;
+    }
+    return std::sqrt(squared);
+}
+
+
+double Correlations::momentum(unsigned int d, unsigned int n) const {
+    return modeMomentum(dims, n * lowestMode(dims, d));
+}
+
+
+std::vector<double> Correlations::correlation(unsigned int d) const {
+    std::vector<double> g(dims[d] / 2 + 1, 0.0);
+    if (measurements == 0)
+        return g;
+
+    // |F(k)|^2 is real and even, its halfcomplex form has no imaginary parts. The inverse
+    // divides by N and gives sum_i x_i x_(i+j), another N makes it an average over the sites.
+    std::vector<double> sums(sites, 0.0);
+    sums[0] = spectrum[0];
+    for (siteIndex k = 1; 2 * k < sites; k++)
+        sums[2*k - 1] = spectrum[k];
+    if (sites % 2 == 0 && sites > 1)
+        sums[sites - 1] = spectrum[sites / 2];
+    if (gsl_fft_halfcomplex_inverse(sums.data(), 1, sites, inverseWavetable, workspace) != GSL_SUCCESS)
+        throw std::runtime_error("Inverse FFT of the power spectrum failed");
+
+    for (unsigned int r = 0; r < g.size(); r++)
+        g[r] = sums[(r * strides[d]) % sites] / ((double)sites * measurements);
+    return g;
+}
+
+
+double Correlations::correlationLength(unsigned int d) const {
+    double ratio = structureFactor(d, 0) / structureFactor(d, 1) - 1;
+    return (ratio > 0) ? std::sqrt(ratio) / momentum(d, 1) : 0.0;
+}
+
+
+ResamplingResult Correlations::meanCorrelationLength(unsigned int bins) const {
+    std::vector<double> khat;
+    for (unsigned int d = 0; d < dims.size(); d++)
+        khat.push_back(momentum(d, 1));
+    DerivedQuantity xi = [khat](const std::vector<double>& a) {
+        double sum = 0.0;
+        for (unsigned int d = 0; d < khat.size(); d++) {
+            double ratio = a[0] / a[d + 1] - 1;
+            sum += (ratio > 0) ? std::sqrt(ratio) / khat[d] : 0.0;
+        }
+        return sum / khat.size();
+    };
+    Resampler resampler(series, bins);
+    return resampler.jackknife(xi);
+}
+
+
+void Correlations::write(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file for writing: " + path);
+    file.precision(std::numeric_limits<double>::max_digits10);
+
+    file << "# dims=";
+    for (unsigned int d = 0; d < dims.size(); d++)
+        file << (d > 0 ? "x" : "") << dims[d];
+    file << " measurements=" << measurements << "\n";
+    file << "# xi_2nd";
+    for (unsigned int d = 0; d < dims.size(); d++)
+        file << " " << correlationLength(d);
+    file << "\n";
+    file << "# dimension, r, G(r), khat, S(k) with k = r times the lowest mode\n";
+    for (unsigned int d = 0; d < dims.size(); d++) {
+        std::vector<double> g = correlation(d);
+        for (unsigned int r = 0; r < g.size(); r++)
+            file << d << "\t" << r << "\t" << g[r] << "\t" << momentum(d, r) << "\t" << structureFactor(d, r) << "\n";
+    }
+    if (!file)
+        throw std::runtime_error("Failed to write " + path);
+}
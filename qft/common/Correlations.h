@@ -0,0 +1,90 @@
+/* Correlations.h
+Two-point correlation function, structure factor and second-moment correlation length.
+
+The lattices have helical boundary conditions, the neighbours of site i along dimension d
+are i +- stride[d] modulo the number of sites N. Their translations are the cyclic shifts
+of the site index, so one real-to-complex FFT of length N over the sites diagonalizes them
+in any number of dimensions. Mode m of the transform has the phase 2 pi m stride[d] / N
+per step along dimension d, and the lowest mode along d is the product of the sizes of the
+dimensions after d. Its momentum is 2 pi / L_d along d and nearly zero along the others,
+the exact lattice momentum khat^2 = sum_d 4 sin^2(phase_d / 2) is used for it.
+
+Every measurement costs one forward transform. The power spectrum |F(k)|^2 is summed over
+the measurements, so S(k) is available at any time and G(r) only needs one inverse
+transform of the average at the end. The second-moment estimator along dimension d is
+
+    xi_d = sqrt(<S(0)> / <S(k_d)> - 1) / khat_d
+
+with k_d the lowest mode along d. S(0) and S(k_d) of every measurement are kept as well,
+their series give the jackknife error of xi.
+*/
+#ifndef _CORRELATIONS_H
+#define _CORRELATIONS_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <gsl/gsl_fft_real.h>         // Real to halfcomplex transforms.
+#include <gsl/gsl_fft_halfcomplex.h>  // Their inverse.
+#include "Resampling.h"
+#include "SiteStorage.h"
+
+
+// lowestMode is the mode of the transform with the lowest momentum along dimension d, and
+// modeMomentum the exact lattice momentum khat of a mode.
+siteIndex lowestMode(const std::vector<unsigned int>& dims, unsigned int d);
+double modeMomentum(const std::vector<unsigned int>& dims, siteIndex mode);
+
+class Correlations {
+    public:
+    // sizes holds the size of every dimension of the lattice, x first.
+    explicit Correlations(const std::vector<unsigned int>& sizes);
+    ~Correlations();
+
+    Correlations(const Correlations&) = delete;
+    Correlations& operator=(const Correlations&) = delete;
+
+    // add transforms one configuration of the lattice, values holds one value per site.
+    template <typename T>
+    void add(const T* values) {
+        for (siteIndex i = 0; i < sites; i++)
+            buffer[i] = values[i];
+        transform();
+    }
+
+    std::size_t size() const { return measurements; }
+    unsigned int getDimensions() const { return dims.size(); }
+
+    // Averages over the measurements so far, r and n count steps along dimension d.
+    double structureFactor(unsigned int d, unsigned int n) const;  // S(k) at n times the lowest mode.
+    double momentum(unsigned int d, unsigned int n) const;         // khat of that mode.
+    std::vector<double> correlation(unsigned int d) const;         // G(r) for r = 0, ..., L_d / 2.
+
+    // Second-moment correlation length along dimension d, and averaged over the dimensions
+    // with its jackknife error over bins blocks of measurements.
+    double correlationLength(unsigned int d) const;
+    ResamplingResult meanCorrelationLength(unsigned int bins) const;
+
+    // write saves G(r) and S(k) along every dimension as text, one line per distance.
+    // It throws std::runtime_error if the file can't be written.
+    void write(const std::string& path) const;
+
+    private:
+    void transform();
+    double power(siteIndex mode) const;  // Summed |F(k)|^2 of mode, or of N - mode.
+
+    std::vector<unsigned int> dims;
+    std::vector<siteIndex> strides;
+    siteIndex sites;
+    std::size_t measurements;
+
+    std::vector<double> buffer;    // One configuration, transformed in place.
+    std::vector<double> spectrum;  // Summed |F(k)|^2 for k = 0, ..., N / 2.
+    std::vector<std::vector<double>> series;  // S(0), then S(k_d) of every measurement.
+
+    gsl_fft_real_wavetable* wavetable;
+    gsl_fft_halfcomplex_wavetable* inverseWavetable;
+    gsl_fft_real_workspace* workspace;
+};
+
+#endif // _CORRELATIONS_H
@@ -0,0 +1,127 @@
+/* Equilibration.cpp
+Run time detection of equilibration and of the measurement spacing.
+*/
+#include "Equilibration.h"
+#include <algorithm>  // max, min.
+#include <cmath>      // ceil, fabs, sqrt.
+
+
+double integratedAutocorrelationTime(const std::vector<double>& series, double c) {
+    size_t n = series.size();
+    if (n < 2)
+        return 0.5;
+
+    double mean = 0.0;
+    for (double x : series)
+        mean += x;
+    mean /= n;
+
+    double variance = 0.0;
+    for (double x : series)
+        variance += (x - mean) * (x - mean);
+    variance /= n;
+    if (variance <= 0)
+        return 0.5;
+
+    double tau = 0.5;
+    for (size_t t = 1; t < n / 2; t++) {
+        double rho = 0.0;
+        for (size_t i = 0; i + t < n; i++)
+            rho += (series[i] - mean) * (series[i + t] - mean);
+        rho /= (n - t) * variance;
+        tau += rho;
+        if (t >= c * tau)
+            break;
+    }
+    return std::max(tau, 0.5);
+}
+
+
+EquilibrationDetector::EquilibrationDetector(unsigned int batch, unsigned int minimum)
+    : batchSize(std::max(1u, batch)), minBatches(minimum), partial(0.0), count(0) {}
+
+void EquilibrationDetector::add(double value) {
+    partial += value;
+    count++;
+    if (count % batchSize == 0) {
+        batches.push_back(partial / batchSize);
+        partial = 0.0;
+    }
+}
+
+// bestBatch returns the MSER truncation point in batches, using suffix sums. Only the first
+// half is searched, the statistic is meaningless with just a few batches left; a minimum at
+// the end of the first half means the series is still drifting.
+size_t EquilibrationDetector::bestBatch() const {
+    size_t n = batches.size();
+    double sum = 0.0, squares = 0.0;
+    double best = -1.0;
+    size_t bestD = 0;
+    for (size_t d = n; d-- > 0;) {
+        sum += batches[d];
+        squares += batches[d] * batches[d];
+        if (d > n / 2)
+            continue;
+        double remaining = n - d;
+        double mser = (squares - sum * sum / remaining) / (remaining * remaining);
+        // Ties go to the earliest truncation point.
+        if (best < 0 || mser <= best) {
+            best = mser;
+            bestD = d;
+        }
+    }
+    return bestD;
+}
+
+size_t EquilibrationDetector::truncation() const {
+    return bestBatch() * batchSize;
+}
+
+// equilibrated also compares the means of the two halves of what MSER keeps, since a slow
+// drift (e.g. coarsening domains) can hide in the noise of the MSER statistic.
+bool EquilibrationDetector::equilibrated() const {
+    if (batches.size() < minBatches)
+        return false;
+    // The truncation point of a drifting series moves along with its end, usually somewhere
+    // between a third and a half of it, so we ask for it in the first quarter.
+    size_t d = bestBatch();
+    if (d > batches.size() / 4)
+        return false;
+
+    std::vector<double> kept(batches.begin() + d, batches.end());
+    size_t half = kept.size() / 2;
+    double first = 0.0, second = 0.0, mean = 0.0, variance = 0.0;
+    for (size_t i = 0; i < half; i++)
+        first += kept[i];
+    for (size_t i = half; i < 2 * half; i++)
+        second += kept[i];
+    first /= half;
+    second /= half;
+    for (double b : kept)
+        mean += b;
+    mean /= kept.size();
+    for (double b : kept)
+        variance += (b - mean) * (b - mean);
+    variance /= kept.size();
+
+    // Standard error of the difference of two means of correlated batches.
+    double error = sqrt(2 * integratedAutocorrelationTime(kept) * variance * 2 / half);
+    return fabs(first - second) <= 2 * error;
+}
+
+
+MeasurementSpacing::MeasurementSpacing(unsigned int gap, unsigned int maximum, unsigned int size)
+    : current(std::max(1u, gap)), maxGap(std::max(1u, maximum)), window(std::max(8u, size)), lastTau(0.0) {}
+
+void MeasurementSpacing::add(double value) {
+    values.push_back(value);
+    if (values.size() < window)
+        return;
+
+    lastTau = integratedAutocorrelationTime(values) * current;
+    unsigned int target = (unsigned int)ceil(lastTau);
+    target = std::min(target, 2 * current);
+    target = std::max(target, current / 2);
+    current = std::min(std::max(target, 1u), maxGap);
+    values.clear();
+}
@@ -0,0 +1,66 @@
+/* Equilibration.h
+Run time detection of equilibration and of the measurement spacing.
+
+EquilibrationDetector applies the MSER-m rule (White, 1997) to a series, e.g.
+the energy after every sweep: the series is averaged in batches of m and the
+truncation point d minimizes the squared standard error of the remaining
+batches, sum_{i>=d} (b_i - mean_d)^2 / (n - d)^2. Once d lies in the first
+quarter of the series, and the means of the two halves of the rest agree within
+two standard errors, everything after it is taken to be in equilibrium. This
+is a heuristic; slow drifts like coarsening domains can still fool it, so the
+drivers keep their equilibration budget as an upper bound.
+
+MeasurementSpacing adapts the number of sweeps between measurements to the
+integrated autocorrelation time of the measured series. It collects a window
+of measurements at the current spacing, estimates tau_int from them, and moves
+the spacing towards tau_int in sweeps, at most by a factor of 2 at a time.
+*/
+#ifndef _EQUILIBRATION_H
+#define _EQUILIBRATION_H
+
+#include <cstddef>
+#include <vector>
+
+
+// Sokal's automatic windowing estimate, tau = 1/2 + sum_{t=1}^{W} rho(t) with the smallest
+// window W >= c tau(W). Returns 0.5 for uncorrelated or constant series.
+double integratedAutocorrelationTime(const std::vector<double>& series, double c = 6.0);
+
+class EquilibrationDetector {
+    public:
+    explicit EquilibrationDetector(unsigned int batchSize = 5, unsigned int minBatches = 20);
+
+    void add(double value);
+
+    // Number of values to discard.
+    size_t truncation() const;
+    bool equilibrated() const;
+    size_t size() const { return count; }
+
+    private:
+    unsigned int batchSize;
+    unsigned int minBatches;
+    std::vector<double> batches;
+    double partial;
+    size_t count;
+
+    size_t bestBatch() const;
+};
+
+class MeasurementSpacing {
+    public:
+    MeasurementSpacing(unsigned int gap, unsigned int maxGap, unsigned int window = 128);
+
+    void add(double value);
+    unsigned int gap() const { return current; }
+    double tau() const { return lastTau; }  // In sweeps, 0 until the first window is full.
+
+    private:
+    unsigned int current;
+    unsigned int maxGap;
+    unsigned int window;
+    double lastTau;
+    std::vector<double> values;
+};
+
+#endif // _EQUILIBRATION_H
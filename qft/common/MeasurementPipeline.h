@@ -0,0 +1,167 @@
+/* MeasurementPipeline.h
+Takes the measurements off the thread that runs the Markov chain.
+
+The sweep thread copies the configuration into a snapshot, hands it over and goes back to
+sweeping, while worker threads measure the snapshots. The snapshots live in a ring of slots
+that are allocated once and reused. Every slot carries a sequence number, as in Vyukov's
+bounded queue: the producer fills slot k once its sequence is k, the workers claim a full
+slot by advancing a shared tail with a compare and swap, and give it back by moving its
+sequence on by the size of the ring. Nothing is locked on the way. When the workers fall
+behind, the ring is full and the producer waits for a slot, so the chain never gets more
+than a ring ahead of the measurements.
+
+The workers measure the snapshots in any order, each one gets the index of its measurement.
+*/
+#ifndef _MEASUREMENT_PIPELINE_H
+#define _MEASUREMENT_PIPELINE_H
+
+#include "Trace.h"
+#include <algorithm>  // max, min.
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>     // unique_ptr.
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+template <typename Snapshot>
+class MeasurementPipeline {
+    public:
+    // measure is called by the workers with the worker number, the index of the measurement and
+    // the snapshot, which is only valid during the call.
+    typedef std::function<void(unsigned int worker, std::uint64_t index, const Snapshot& snapshot)> Measure;
+
+    // The ring has at least slotCount slots, rounded up to a power of two.
+    MeasurementPipeline(unsigned int workerCount, unsigned int slotCount, Measure measureFunction)
+            : measure(measureFunction), head(0), published(0), tail(0), stopping(false), stalls(0) {
+        std::size_t size = 1;
+        while (size < std::max(2u, slotCount))
+            size *= 2;
+        mask = size - 1;
+        slots = std::unique_ptr<Slot[]>(new Slot[size]);
+        for (std::size_t i = 0; i < size; i++)
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        for (unsigned int w = 0; w < std::max(1u, workerCount); w++)
+            workers.emplace_back([this, w]() { work(w); });
+    }
+
+    ~MeasurementPipeline() {
+        try {
+            finish();
+        } catch (...) {
+        }
+    }
+
+    // acquire returns the snapshot of the next measurement to fill, waiting while the ring is
+    // full. Only the sweep thread calls it, followed by publish.
+    Snapshot& acquire() {
+        Slot& slot = slots[head & mask];
+        if (slot.sequence.load(std::memory_order_acquire) != head) {
+            stalls++;
+            Backoff backoff;
+            while (slot.sequence.load(std::memory_order_acquire) != head)
+                backoff.wait();
+        }
+        return slot.snapshot;
+    }
+
+    // publish hands the snapshot of the last acquire to the workers.
+    void publish() {
+        slots[head & mask].sequence.store(head + 1, std::memory_order_release);
+        head++;
+        published.store(head, std::memory_order_release);
+    }
+
+    // finish waits until every snapshot is measured and stops the workers. The first exception
+    // thrown by measure is rethrown here, the snapshots after it are dropped.
+    void finish() {
+        stopping.store(true, std::memory_order_release);
+        for (std::thread& worker : workers)
+            worker.join();
+        workers.clear();
+        if (error) {
+            std::exception_ptr thrown = error;
+            error = nullptr;
+            std::rethrow_exception(thrown);
+        }
+    }
+
+    // Times the sweep thread had to wait for the workers.
+    unsigned long long getStalls() const { return stalls; }
+
+    private:
+    struct Slot {
+        std::atomic<std::uint64_t> sequence;
+        Snapshot snapshot;
+    };
+
+    // Waiting threads spin briefly, then yield, then sleep, so idle workers don't take a core
+    // from the sweeps.
+    class Backoff {
+        public:
+        void wait() {
+            if (spins < 64) {
+                spins++;
+            } else if (spins < 128) {
+                spins++;
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(sleep));
+                sleep = std::min(sleep * 2, 200u);
+            }
+        }
+
+        private:
+        unsigned int spins = 0;
+        unsigned int sleep = 10;
+    };
+
+    void work(unsigned int worker) {
+        Trace::setThreadName("measure-" + std::to_string(worker));
+        Backoff backoff;
+        while (true) {
+            std::uint64_t position = tail.load(std::memory_order_relaxed);
+            Slot& slot = slots[position & mask];
+            if (slot.sequence.load(std::memory_order_acquire) == position + 1) {
+                if (!tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    continue;
+                if (!failed.load(std::memory_order_relaxed)) {
+                    try {
+                        measure(worker, position, slot.snapshot);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(errorMutex);
+                        if (!error)
+                            error = std::current_exception();
+                        failed.store(true, std::memory_order_relaxed);
+                    }
+                }
+                slot.sequence.store(position + mask + 1, std::memory_order_release);
+                backoff = Backoff();
+            } else if (stopping.load(std::memory_order_acquire) && position == published.load(std::memory_order_acquire)) {
+                return;
+            } else {
+                backoff.wait();
+            }
+        }
+    }
+
+    Measure measure;
+    std::unique_ptr<Slot[]> slots;
+    std::uint64_t mask;
+    std::uint64_t head;                     // Next slot of the producer, only it touches it.
+    std::atomic<std::uint64_t> published;   // Snapshots handed over.
+    std::atomic<std::uint64_t> tail;        // Next snapshot to measure.
+    std::atomic<bool> stopping;
+    std::atomic<bool> failed{false};
+    unsigned long long stalls;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+};
+
+#endif // _MEASUREMENT_PIPELINE_H
@@ -0,0 +1,58 @@
+/* Options.cpp
+Parses the optional "--name" and "--name=value" flags that may follow the
+positional arguments of a driver.
+*/
+#include "Options.h"
+#include <stdexcept> // For std::runtime_error
+#include <string>    // For std::stoul, std::stod
+
+
+Options::Options(int argc, char** const argv, int first) {
+    for (int i = first; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.size() < 3 || arg.compare(0, 2, "--") != 0) {
+            throw std::runtime_error("Unexpected argument (options look like --name or --name=value): " + arg);
+        }
+
+        // A flag without a value is stored with an empty one.
+        size_t equals = arg.find('=');
+        if (equals == std::string::npos) {
+            flags[arg.substr(2)] = "";
+        } else {
+            flags[arg.substr(2, equals - 2)] = arg.substr(equals + 1);
+        }
+    }
+}
+
+bool Options::has(const std::string& name) const {
+    return flags.find(name) != flags.end();
+}
+
+std::string Options::get(const std::string& name, const std::string& fallback) const {
+    auto it = flags.find(name);
+    if (it == flags.end() || it->second.empty())
+        return fallback;
+    return it->second;
+}
+
+unsigned int Options::getUInt(const std::string& name, unsigned int fallback) const {
+    std::string value = get(name, "");
+    if (value.empty())
+        return fallback;
+    try {
+        return (unsigned int)std::stoul(value);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Option --" + name + " expects an unsigned integer, got: " + value);
+    }
+}
+
+double Options::getDouble(const std::string& name, double fallback) const {
+    std::string value = get(name, "");
+    if (value.empty())
+        return fallback;
+    try {
+        return std::stod(value);
+    } catch (const std::exception&) {
+        throw std::runtime_error("Option --" + name + " expects a number, got: " + value);
+    }
+}
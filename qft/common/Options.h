@@ -0,0 +1,29 @@
+/* Options.h
+Parses the optional "--name" and "--name=value" flags that may follow the
+positional arguments of a driver.
+
+The positional arguments stay the way they have always been so that the
+notebooks and the CI invocations keep working unchanged.
+*/
+#ifndef _OPTIONS_H
+#define _OPTIONS_H
+
+#include <map>
+#include <string>
+
+
+class Options {
+    public:
+    // first is the index of the first optional argument in argv.
+    Options(int argc, char** const argv, int first);
+
+    bool has(const std::string& name) const;
+    std::string get(const std::string& name, const std::string& fallback) const;
+    unsigned int getUInt(const std::string& name, unsigned int fallback) const;
+    double getDouble(const std::string& name, double fallback) const;
+
+    private:
+    std::map<std::string, std::string> flags;
+};
+
+#endif // _OPTIONS_H
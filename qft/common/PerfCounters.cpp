@@ -0,0 +1,152 @@
+/* PerfCounters.cpp
+Optional hardware performance counters around the phases of a simulation.
+*/
+#include "PerfCounters.h"
+#include <cerrno>
+#include <cstring>               // strerror, memset.
+#include <stdexcept>             // For std::runtime_error
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+// glibc does not provide a wrapper for perf_event_open.
+int openEvent(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;         // Count threads spawned after the counters were opened.
+    attr.exclude_kernel = 1;  // Allowed with perf_event_paranoid <= 2.
+    attr.exclude_hv = 1;
+    // When there are more events than hardware counters the kernel multiplexes them,
+    // these two let us scale the raw counts back up.
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+const char* eventNames[] = {"cycles", "instructions", "L1D misses", "LLC misses", "branch misses"};
+
+}  // namespace
+
+
+PerfCounters::PerfCounters() {
+    const uint64_t l1dReadMiss = PERF_COUNT_HW_CACHE_L1D
+        | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+        | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+
+    fds[CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    int firstErrno = (fds[CYCLES] < 0) ? errno : 0;
+    fds[INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    fds[L1D_MISSES] = openEvent(PERF_TYPE_HW_CACHE, l1dReadMiss);
+    fds[LLC_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+
+    bool any = false;
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (fds[i] >= 0) {
+            ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+            any = true;
+        }
+    }
+
+    if (!any) {
+        unavailableReason = "perf_event_open failed: ";
+        unavailableReason += strerror(firstErrno);
+        if (firstErrno == EACCES || firstErrno == EPERM)
+            unavailableReason += " (check /proc/sys/kernel/perf_event_paranoid or the container's seccomp profile)";
+        else if (firstErrno == ENOENT || firstErrno == ENOSYS || firstErrno == EOPNOTSUPP)
+            unavailableReason += " (no hardware counters exposed, e.g. inside a virtual machine)";
+    }
+}
+
+PerfCounters::~PerfCounters() {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (fds[i] >= 0)
+            close(fds[i]);
+    }
+}
+
+bool PerfCounters::available() const {
+    return unavailableReason.empty();
+}
+
+// readCounters stores the scaled value of every event, or -1 for the missing ones.
+void PerfCounters::readCounters(double* values) const {
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        values[i] = -1;
+        if (fds[i] < 0)
+            continue;
+
+        uint64_t data[3];  // value, time enabled, time running.
+        if (read(fds[i], data, sizeof(data)) != (ssize_t)sizeof(data) || data[2] == 0)
+            continue;
+        values[i] = (double)data[0] * ((double)data[1] / (double)data[2]);
+    }
+}
+
+void PerfCounters::begin(const std::string& phase) {
+    auto it = phases.find(phase);
+    if (it == phases.end()) {
+        Phase fresh = {};
+        it = phases.emplace(phase, fresh).first;
+        order.push_back(phase);
+    }
+    if (it->second.running)
+        throw std::runtime_error("Performance counter phase began twice: " + phase);
+
+    it->second.running = true;
+    it->second.startTime = std::chrono::steady_clock::now();
+    readCounters(it->second.start);
+}
+
+void PerfCounters::end(const std::string& phase, unsigned long long siteUpdates) {
+    double now[NUM_EVENTS];
+    readCounters(now);
+    auto nowTime = std::chrono::steady_clock::now();
+
+    auto it = phases.find(phase);
+    if (it == phases.end() || !it->second.running)
+        throw std::runtime_error("Performance counter phase ended without beginning: " + phase);
+
+    Phase& p = it->second;
+    for (int i = 0; i < NUM_EVENTS; i++) {
+        if (now[i] < 0 || p.start[i] < 0)
+            p.total[i] = -1;  // Once an event could not be read the phase has no valid total.
+        else if (p.total[i] >= 0)
+            p.total[i] += now[i] - p.start[i];
+    }
+    p.seconds += std::chrono::duration<double>(nowTime - p.startTime).count();
+    p.siteUpdates += siteUpdates;
+    p.running = false;
+}
+
+void PerfCounters::report(FILE* out) const {
+    if (!available())
+        fprintf(out, "perf: hardware counters unavailable, %s\n", unavailableReason.c_str());
+
+    for (const std::string& name : order) {
+        const Phase& p = phases.at(name);
+        double updates = (p.siteUpdates > 0) ? (double)p.siteUpdates : 1.0;
+
+        fprintf(out, "perf: %s: %llu site updates in %.3f s (%.2f ns per update)\n",
+            name.c_str(), p.siteUpdates, p.seconds, 1e9 * p.seconds / updates);
+        if (!available())
+            continue;
+        for (int i = 0; i < NUM_EVENTS; i++) {
+            if (p.total[i] < 0)
+                fprintf(out, "perf:   %-14s n/a\n", eventNames[i]);
+            else
+                fprintf(out, "perf:   %-14s %.0f (%.4f per update)\n", eventNames[i], p.total[i], p.total[i] / updates);
+        }
+        if (p.total[CYCLES] > 0 && p.total[INSTRUCTIONS] >= 0)
+            fprintf(out, "perf:   %-14s %.3f\n", "IPC", p.total[INSTRUCTIONS] / p.total[CYCLES]);
+    }
+    fflush(out);
+}
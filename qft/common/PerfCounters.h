@@ -0,0 +1,62 @@
+/* PerfCounters.h
+Optional hardware performance counters around the phases of a simulation.
+
+The counters are opened with Linux perf_event_open(2) for the calling process:
+cycles, instructions, L1 data cache read misses, last level cache misses and
+branch misses. Each phase (equilibration, measurement, ...) accumulates the
+counter deltas between begin() and end() together with the number of site
+updates it performed, so that report() can print per-update figures.
+
+Containers usually forbid perf_event_open (seccomp, perf_event_paranoid) and
+virtual machines often lack some of the hardware events. Missing events are
+reported as n/a. If none can be opened, report() explains why and falls back to
+the wall-clock time per site update, which every phase records regardless.
+*/
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+
+class PerfCounters {
+    public:
+    PerfCounters();
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    bool available() const;
+
+    // Phases can be begun and ended repeatedly; their counts accumulate.
+    void begin(const std::string& phase);
+    void end(const std::string& phase, unsigned long long siteUpdates);
+
+    void report(FILE* out) const;
+
+    private:
+    enum Event { CYCLES, INSTRUCTIONS, L1D_MISSES, LLC_MISSES, BRANCH_MISSES, NUM_EVENTS };
+
+    struct Phase {
+        double start[NUM_EVENTS];
+        double total[NUM_EVENTS];
+        std::chrono::steady_clock::time_point startTime;
+        double seconds;
+        unsigned long long siteUpdates;
+        bool running;
+    };
+
+    int fds[NUM_EVENTS];
+    std::string unavailableReason;
+    std::map<std::string, Phase> phases;
+    std::vector<std::string> order;  // Phases in the order in which they were first seen.
+
+    void readCounters(double* values) const;
+};
+
+#endif // _PERFCOUNTERS_H
@@ -0,0 +1,161 @@
+/* Resampling.cpp
+Blocked jackknife and bootstrap error estimates for derived observables.
+*/
+#include "Resampling.h"
+#include <algorithm>    // fill, min, max.
+#include <atomic>
+#include <cmath>        // sqrt.
+#include <memory>
+#include <stdexcept>    // For std::runtime_error
+#include <string>       // For std::to_string()
+#include <thread>
+#include <gsl/gsl_rng.h>
+
+namespace {
+
+// Bootstrap resamples are generated in chunks of this many, one random stream per chunk.
+const unsigned int chunkSize = 64;
+
+}  // namespace
+
+// splitmix64 turns (seed, stream) into well separated Mersenne twister seeds.
+unsigned long streamSeed(unsigned long seed, unsigned long stream) {
+    unsigned long long z = (unsigned long long)seed + 0x9E3779B97F4A7C15ULL * (stream + 1);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (unsigned long)(z ^ (z >> 31));
+}
+
+
+Resampler::Resampler(const std::vector<std::vector<double>>& series, unsigned int nBins)
+    : observables(series.size()), bins(nBins) {
+    if (observables == 0) {
+        throw std::runtime_error("The resampler needs at least one series");
+    }
+    size_t length = series[0].size();
+    for (const auto& s : series) {
+        if (s.size() != length) {
+            throw std::runtime_error("All the resampled series must have the same length");
+        }
+    }
+    if (bins < 2 || length < bins) {
+        throw std::runtime_error("Cannot split " + std::to_string(length) + " measurements into "
+            + std::to_string(bins) + " bins (at least 2 are needed)");
+    }
+
+    binSize = length / bins;
+    binAverages.assign((size_t)bins * observables, 0.0);
+    totals.assign(observables, 0.0);
+    for (unsigned int k = 0; k < observables; k++) {
+        for (unsigned int b = 0; b < bins; b++) {
+            double sum = 0.0;
+            for (unsigned int i = b * binSize; i < (b + 1) * binSize; i++) {
+                sum += series[k][i];
+            }
+            binAverages[(size_t)b * observables + k] = sum / binSize;
+            totals[k] += sum / binSize;
+        }
+    }
+}
+
+double Resampler::estimate(const DerivedQuantity& f) const {
+    std::vector<double> averages(observables);
+    for (unsigned int k = 0; k < observables; k++) {
+        averages[k] = totals[k] / bins;
+    }
+    return f(averages);
+}
+
+// jackknife leaves one bin out at a time. The leave-one-out averages come from the totals,
+// so each of the bins estimates costs O(observables).
+ResamplingResult Resampler::jackknife(const DerivedQuantity& f) const {
+    ResamplingResult result;
+    result.value = estimate(f);
+
+    std::vector<double> averages(observables);
+    double mean = 0.0;
+    double sqrd = 0.0;
+    for (unsigned int b = 0; b < bins; b++) {
+        for (unsigned int k = 0; k < observables; k++) {
+            averages[k] = (totals[k] - binAverages[(size_t)b * observables + k]) / (bins - 1);
+        }
+        double leftOut = f(averages);
+        mean += leftOut;
+        sqrd += leftOut * leftOut;
+    }
+    mean /= bins;
+    sqrd /= bins;
+
+    double variance = sqrd - mean * mean;
+    result.error = sqrt((bins - 1) * (variance > 0 ? variance : 0));
+    result.bias = (bins - 1) * (mean - result.value);
+    result.biasCorrected = result.value - result.bias;
+    return result;
+}
+
+ResamplingResult Resampler::bootstrap(const DerivedQuantity& f, unsigned int resamples,
+                                      unsigned long seed, unsigned int threads) const {
+    if (resamples < 2) {
+        throw std::runtime_error("The bootstrap needs at least 2 resamples");
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<double> estimates(resamples);
+    unsigned int chunks = (resamples + chunkSize - 1) / chunkSize;
+    std::atomic<unsigned int> nextChunk{0};
+
+    auto worker = [&]() {
+        std::unique_ptr<gsl_rng, decltype(&gsl_rng_free)> generator(gsl_rng_alloc(gsl_rng_mt19937), gsl_rng_free);
+        std::vector<double> averages(observables);
+
+        for (unsigned int c = nextChunk++; c < chunks; c = nextChunk++) {
+            gsl_rng_set(generator.get(), streamSeed(seed, c));
+            unsigned int last = std::min(resamples, (c + 1) * chunkSize);
+            for (unsigned int r = c * chunkSize; r < last; r++) {
+                // Draw bins bins with replacement.
+                std::fill(averages.begin(), averages.end(), 0.0);
+                for (unsigned int b = 0; b < bins; b++) {
+                    unsigned int pick = (unsigned int)(bins * gsl_rng_uniform(generator.get()));
+                    const double* row = &binAverages[(size_t)pick * observables];
+                    for (unsigned int k = 0; k < observables; k++) {
+                        averages[k] += row[k];
+                    }
+                }
+                for (unsigned int k = 0; k < observables; k++) {
+                    averages[k] /= bins;
+                }
+                estimates[r] = f(averages);
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < std::min(threads, chunks); t++) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : pool) {
+        t.join();
+    }
+
+    ResamplingResult result;
+    result.value = estimate(f);
+
+    double mean = 0.0;
+    for (double e : estimates) {
+        mean += e;
+    }
+    mean /= resamples;
+    double variance = 0.0;
+    for (double e : estimates) {
+        variance += (e - mean) * (e - mean);
+    }
+    variance /= (resamples - 1);
+
+    result.error = sqrt(variance);
+    result.bias = mean - result.value;
+    result.biasCorrected = result.value - result.bias;
+    return result;
+}
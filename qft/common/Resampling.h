@@ -0,0 +1,61 @@
+/* Resampling.h
+Blocked jackknife and bootstrap error estimates for derived observables.
+
+A derived observable (specific heat, susceptibility, Binder cumulant, ...) is a
+function of the averages of a few primary time series, e.g. <e>, <e^2>, <|m|>.
+The series are binned once on construction: consecutive measurements are
+averaged into blocks long enough to be roughly independent, which is what makes
+the error estimates account for the autocorrelations. Every resample after that
+only touches the bin averages, so it costs O(bins) instead of O(sampleSize).
+
+Bootstrap resamples are split into fixed chunks, each one with its own random
+number stream derived from the seed and the chunk index, and the chunks are
+shared among the threads. The result therefore does not depend on how many
+threads were used.
+*/
+#ifndef _RESAMPLING_H
+#define _RESAMPLING_H
+
+#include <functional>
+#include <vector>
+
+
+// streamSeed derives the seed of random number stream number stream from seed, the streams
+// of a seed are independent of each other for all practical purposes.
+unsigned long streamSeed(unsigned long seed, unsigned long stream);
+
+// DerivedQuantity receives the averages of the primary series, in the order in which
+// they were given to the Resampler. It is called concurrently so it must not have
+// side effects.
+typedef std::function<double(const std::vector<double>& averages)> DerivedQuantity;
+
+struct ResamplingResult {
+    double value;  // The quantity evaluated on the full sample.
+    double error;
+    double bias;   // Estimated bias of value, already removed from biasCorrected.
+    double biasCorrected;
+};
+
+class Resampler {
+    public:
+    // series[k] is the k-th primary observable, all of them with the same length.
+    // Measurements that don't fill the last bin are dropped.
+    Resampler(const std::vector<std::vector<double>>& series, unsigned int bins);
+
+    double estimate(const DerivedQuantity& f) const;
+    ResamplingResult jackknife(const DerivedQuantity& f) const;
+    ResamplingResult bootstrap(const DerivedQuantity& f, unsigned int resamples,
+                               unsigned long seed, unsigned int threads) const;
+
+    unsigned int getBins() const { return bins; }
+    unsigned int getBinSize() const { return binSize; }
+
+    private:
+    unsigned int observables;
+    unsigned int bins;
+    unsigned int binSize;
+    std::vector<double> binAverages;  // bins x observables, one row per bin.
+    std::vector<double> totals;       // Sum over the bins of each observable.
+};
+
+#endif // _RESAMPLING_H
@@ -0,0 +1,229 @@
+/* ResultCache.cpp
+Implements the store of the results of the drivers.
+*/
+#include "ResultCache.h"
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>       // open.
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <sys/file.h>    // flock.
+#include <unistd.h>      // close, pread.
+
+
+namespace {
+
+const char entryMagic[4] = {'R', 'C', 'E', '1'};
+const std::size_t indexRecordBytes = 24;
+
+// DirectoryLock holds an flock of the cache for as long as it lives.
+class DirectoryLock {
+    public:
+    DirectoryLock(const std::filesystem::path& directory, int operation) {
+        fd = open((directory / "lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0 || flock(fd, operation) != 0)
+            throw std::runtime_error("Failed to lock the result cache " + directory.string());
+    }
+    ~DirectoryLock() { close(fd); }
+
+    private:
+    int fd;
+};
+
+std::string readFile(const std::filesystem::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to read " + path.string());
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+template <typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+bool get(const std::string& in, std::size_t& at, T& value) {
+    if (in.size() - at < sizeof(value))
+        return false;
+    std::memcpy(&value, in.data() + at, sizeof(value));
+    at += sizeof(value);
+    return true;
+}
+
+bool getString(const std::string& in, std::size_t& at, std::uint64_t length, std::string& value) {
+    if (in.size() - at < length)
+        return false;
+    value = in.substr(at, length);
+    at += length;
+    return true;
+}
+
+}  // namespace
+
+
+void CacheEntry::addFile(const std::string& path) {
+    blobs.emplace_back(path, readFile(path));
+}
+
+
+std::string CacheEntry::restoreFiles() const {
+    std::string out;
+    for (const auto& [name, contents] : blobs) {
+        if (name == "stdout") {
+            out = contents;
+            continue;
+        }
+        std::ofstream file(name, std::ios::binary);
+        if (!file.is_open() || !file.write(contents.data(), contents.size()))
+            throw std::runtime_error("Failed to restore " + name + " from the result cache");
+    }
+    return out;
+}
+
+
+ResultCache::ResultCache(const std::filesystem::path& path) : directory(path) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (!std::filesystem::is_directory(directory))
+        throw std::runtime_error("Failed to create the result cache " + directory.string());
+    readIndex();
+}
+
+
+// FNV-1a, the keys only need to spread well, collisions are caught by the descriptions.
+std::uint64_t ResultCache::hash(const std::string& text) {
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+
+std::string ResultCache::describe(int argc, char** const argv) {
+    std::vector<std::string> parameters;
+    for (int i = 1; i < argc; i++) {
+        if (std::strncmp(argv[i], "--cache", 7) != 0)
+            parameters.push_back(argv[i]);
+    }
+    return describe(parameters);
+}
+
+
+std::string ResultCache::describe(const std::vector<std::string>& parameters) {
+    // The executable is only hashed once, campaigns describe every one of their jobs.
+    static const std::string executable = [] {
+        char version[32];
+        snprintf(version, sizeof(version), "%016llx", (unsigned long long)hash(readFile("/proc/self/exe")));
+        return std::string("executable ") + version + "\n";
+    }();
+    std::string description = executable;
+    for (const std::string& parameter : parameters)
+        description += parameter + "\n";
+    return description;
+}
+
+
+// The records past the end of the entries are those of a writer that didn't finish.
+void ResultCache::readIndex() {
+    DirectoryLock lock(directory, LOCK_SH);
+    std::error_code error;
+    std::uint64_t dataBytes = std::filesystem::file_size(directory / "results.dat", error);
+    if (error)
+        return;
+    // Without its index the entries can't be found, the cache starts over with the next store.
+    if (!std::filesystem::exists(directory / "index.bin", error))
+        return;
+    std::string records = readFile(directory / "index.bin");
+    for (std::size_t at = 0; at + indexRecordBytes <= records.size(); ) {
+        std::uint64_t key = 0;
+        Location location{};
+        if (!get(records, at, key) || !get(records, at, location.offset) || !get(records, at, location.length))
+            break;
+        if (location.offset + location.length <= dataBytes)
+            index[key].push_back(location);
+    }
+}
+
+
+bool ResultCache::lookup(const std::string& description, CacheEntry& entry) const {
+    auto found = index.find(hash(description));
+    if (found == index.end())
+        return false;
+
+    DirectoryLock lock(directory, LOCK_SH);
+    int fd = open((directory / "results.dat").c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool hit = false;
+    for (auto location = found->second.rbegin(); location != found->second.rend() && !hit; ++location) {
+        std::string bytes(location->length, '\0');
+        if (pread(fd, bytes.data(), bytes.size(), location->offset) != (ssize_t)bytes.size())
+            continue;
+
+        std::size_t at = 0;
+        std::uint32_t length, count;
+        std::string text;
+        if (bytes.compare(0, 4, entryMagic, 4) != 0)
+            continue;
+        at = 4;
+        if (!get(bytes, at, length) || !getString(bytes, at, length, text) || text != description || !get(bytes, at, count))
+            continue;
+        CacheEntry candidate;
+        bool complete = true;
+        for (std::uint32_t b = 0; b < count && complete; b++) {
+            std::uint32_t nameLength;
+            std::uint64_t dataLength;
+            std::string name, data;
+            complete = get(bytes, at, nameLength) && getString(bytes, at, nameLength, name)
+                    && get(bytes, at, dataLength) && getString(bytes, at, dataLength, data);
+            candidate.blobs.emplace_back(std::move(name), std::move(data));
+        }
+        if (complete) {
+            entry = std::move(candidate);
+            hit = true;
+        }
+    }
+    close(fd);
+    return hit;
+}
+
+
+void ResultCache::store(const std::string& description, const CacheEntry& entry) {
+    std::string bytes(entryMagic, 4);
+    put<std::uint32_t>(bytes, description.size());
+    bytes += description;
+    put<std::uint32_t>(bytes, entry.blobs.size());
+    for (const auto& [name, contents] : entry.blobs) {
+        put<std::uint32_t>(bytes, name.size());
+        bytes += name;
+        put<std::uint64_t>(bytes, contents.size());
+        bytes += contents;
+    }
+
+    // The entry is written before its index record, a reader never sees a record without it.
+    DirectoryLock lock(directory, LOCK_EX);
+    std::ofstream data(directory / "results.dat", std::ios::binary | std::ios::app);
+    std::error_code error;
+    std::uint64_t offset = std::filesystem::file_size(directory / "results.dat", error);
+    if (!data.is_open() || error || !data.write(bytes.data(), bytes.size()) || !data.flush())
+        throw std::runtime_error("Failed to write the result cache " + directory.string());
+
+    // A record cut short by a crash would shift all the records after it.
+    std::uint64_t indexBytes = std::filesystem::file_size(directory / "index.bin", error);
+    if (!error && indexBytes % indexRecordBytes != 0)
+        std::filesystem::resize_file(directory / "index.bin", indexBytes - indexBytes % indexRecordBytes);
+
+    std::uint64_t key = hash(description);
+    std::string record;
+    put(record, key);
+    put<std::uint64_t>(record, offset);
+    put<std::uint64_t>(record, bytes.size());
+    std::ofstream indexFile(directory / "index.bin", std::ios::binary | std::ios::app);
+    if (!indexFile.is_open() || !indexFile.write(record.data(), record.size()) || !indexFile.flush())
+        throw std::runtime_error("Failed to write the index of the result cache " + directory.string());
+    index[key].push_back({offset, bytes.size()});
+}
@@ -0,0 +1,68 @@
+/* ResultCache.h
+A content-addressed store of the results of the drivers, so that a point that was already
+simulated is never run again.
+
+A run is identified by the executable it was run with and all of its arguments, the seed
+among them. Its description is that text, with a hash of the bytes of the executable in place
+of its name, so rebuilding a driver invalidates its results. The key of a run is a 64-bit
+hash of the description.
+
+A cache is a directory with two append-only files:
+    results.dat  the entries: the description and the named blobs of every run, its stdout
+                 and the files it wrote.
+    index.bin    one 24 byte record per entry: key, offset and length in results.dat.
+The index is read into a hash table when the cache is opened, a lookup then costs one read of
+the entry, whose description is compared to guard against hash collisions. Writers append
+under an flock of the directory, so notebooks and campaigns can share a cache. A record cut
+short by a crash is ignored.
+*/
+#ifndef _RESULT_CACHE_H
+#define _RESULT_CACHE_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+struct CacheEntry {
+    // Name and contents, "stdout" or the path of a file the run wrote.
+    std::vector<std::pair<std::string, std::string>> blobs;
+
+    // addFile adds the contents of the file at path, it throws std::runtime_error if it can't be read.
+    void addFile(const std::string& path);
+    // restoreFiles writes back every blob but stdout, and returns stdout.
+    std::string restoreFiles() const;
+};
+
+class ResultCache {
+    public:
+    // The directory is created if needed. It throws std::runtime_error if it can't be used.
+    explicit ResultCache(const std::filesystem::path& directory);
+
+    // describe identifies the run of argv, leaving out the --cache options.
+    static std::string describe(int argc, char** const argv);
+    // describe identifies a run of this executable with the given parameters.
+    static std::string describe(const std::vector<std::string>& parameters);
+    static std::uint64_t hash(const std::string& text);
+
+    bool lookup(const std::string& description, CacheEntry& entry) const;
+    void store(const std::string& description, const CacheEntry& entry);
+
+    std::size_t size() const { return index.size(); }
+
+    private:
+    struct Location {
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    void readIndex();
+
+    std::filesystem::path directory;
+    std::unordered_map<std::uint64_t, std::vector<Location>> index;  // Every entry of a key, oldest first.
+};
+
+#endif // _RESULT_CACHE_H
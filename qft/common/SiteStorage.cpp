@@ -0,0 +1,53 @@
+/* SiteStorage.cpp
+Memory-mapped storage of the per-site values of a lattice.
+*/
+#include "SiteStorage.h"
+#include <cerrno>
+#include <cstring>    // strerror.
+#include <stdexcept>  // runtime_error.
+#include <string>
+#include <fcntl.h>     // open.
+#include <sys/mman.h>  // mmap, madvise.
+#include <unistd.h>    // close, ftruncate.
+
+
+static std::runtime_error mappingError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+void* mapPages(std::size_t bytes, const std::filesystem::path& path) {
+    if (bytes == 0)
+        return nullptr;
+
+    void* pages;
+    if (path.empty()) {
+        // Anonymous pages are only backed by memory once they are touched.
+        pages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (pages == MAP_FAILED)
+            throw mappingError("Failed to map " + std::to_string(bytes) + " bytes");
+    } else {
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+            throw mappingError("Failed to open " + path.string());
+        if (ftruncate(fd, bytes) != 0) {
+            close(fd);
+            throw mappingError("Failed to resize " + path.string());
+        }
+        // The mapping keeps its own reference to the file.
+        pages = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (pages == MAP_FAILED)
+            throw mappingError("Failed to map " + path.string());
+    }
+
+#ifdef MADV_HUGEPAGE
+    // Only a hint, it fails on kernels without transparent huge pages and on most file systems.
+    madvise(pages, bytes, MADV_HUGEPAGE);
+#endif
+    return pages;
+}
+
+void unmapPages(void* pages, std::size_t bytes) {
+    if (pages != nullptr)
+        munmap(pages, bytes);
+}
@@ -0,0 +1,79 @@
+/* SiteStorage.h
+Storage of the per-site values of a lattice.
+
+Site indices are 64 bits wide so that lattices with more than 2^32 sites can be
+addressed. MappedArray keeps the values in pages mapped with mmap instead of on
+the heap: anonymous pages by default, or the pages of a file given by path. A
+file-backed array can be larger than the memory of the machine, the kernel then
+pages it in and out as it is swept, which works best when the sweeps visit the
+sites in order. Huge pages are requested with madvise where the kernel supports
+them, they cut down the TLB misses of sweeping a large lattice.
+*/
+#ifndef _SITE_STORAGE_H
+#define _SITE_STORAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <utility>  // swap.
+
+
+typedef std::uint64_t siteIndex;
+
+// mapPages maps bytes of zeroed anonymous memory, or of the file at path which is created
+// or resized to fit. It throws std::runtime_error if the mapping fails.
+void* mapPages(std::size_t bytes, const std::filesystem::path& path);
+void unmapPages(void* pages, std::size_t bytes);
+
+template <typename T>
+class MappedArray {
+    public:
+    MappedArray() : values(nullptr), count(0) {}
+
+    // The values are left zero, or as they are in an existing file, and the pages aren't touched
+    // until they are first written. Threads can then place them on their own NUMA node.
+    explicit MappedArray(siteIndex n, const std::filesystem::path& path = {})
+        : values(static_cast<T*>(mapPages(n * sizeof(T), path))), count(n) {}
+
+    // Every value is set to value, including those of an existing file.
+    MappedArray(siteIndex n, T value, const std::filesystem::path& path = {})
+        : values(static_cast<T*>(mapPages(n * sizeof(T), path))), count(n) {
+        for (siteIndex i = 0; i < count; i++)
+            values[i] = value;
+    }
+
+    MappedArray(const MappedArray&) = delete;
+    MappedArray& operator=(const MappedArray&) = delete;
+
+    MappedArray(MappedArray&& other) : MappedArray() {
+        swap(other);
+    }
+
+    MappedArray& operator=(MappedArray&& other) {
+        MappedArray(std::move(other)).swap(*this);
+        return *this;
+    }
+
+    ~MappedArray() {
+        unmapPages(values, count * sizeof(T));
+    }
+
+    void swap(MappedArray& other) {
+        std::swap(values, other.values);
+        std::swap(count, other.count);
+    }
+
+    T& operator[](siteIndex i) { return values[i]; }
+    const T& operator[](siteIndex i) const { return values[i]; }
+    siteIndex size() const { return count; }
+    T* begin() { return values; }
+    T* end() { return values + count; }
+    const T* begin() const { return values; }
+    const T* end() const { return values + count; }
+
+    private:
+    T* values;
+    siteIndex count;
+};
+
+#endif // _SITE_STORAGE_H
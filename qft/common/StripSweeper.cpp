@@ -0,0 +1,63 @@
+/* StripSweeper.cpp
+The pinned worker threads of StripSweeper.
+*/
+#include "StripSweeper.h"
+#include "Trace.h"
+#include <string>
+
+
+PinnedWorkers::PinnedWorkers(const std::vector<unsigned int>& cpus)
+    : pinned(cpus.size(), 0), current(nullptr), generation(0), running(0), stopping(false), arrived(0), phase(0) {
+    for (unsigned int w = 0; w < cpus.size(); w++)
+        threads.emplace_back([this, w, cpu = cpus[w]]() { work(w, cpu); });
+}
+
+PinnedWorkers::~PinnedWorkers() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread& t : threads)
+        t.join();
+}
+
+void PinnedWorkers::work(unsigned int w, unsigned int cpu) {
+    pinned[w] = Topology::pin(cpu);
+    Trace::setThreadName("sweep-" + std::to_string(w));
+    unsigned long long done = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        started.wait(lock, [&]() { return stopping || generation != done; });
+        if (stopping)
+            return;
+        done = generation;
+        lock.unlock();
+        (*current)(w);
+        lock.lock();
+        if (--running == 0)
+            finished.notify_one();
+    }
+}
+
+void PinnedWorkers::run(const std::function<void(unsigned int)>& task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    current = &task;
+    running = threads.size();
+    generation++;
+    started.notify_all();
+    finished.wait(lock, [&]() { return running == 0; });
+    current = nullptr;
+}
+
+void PinnedWorkers::arrive() {
+    std::unique_lock<std::mutex> lock(mutex);
+    unsigned long long at = phase;
+    if (++arrived == threads.size()) {
+        arrived = 0;
+        phase++;
+        released.notify_all();
+    } else {
+        released.wait(lock, [&]() { return phase != at; });
+    }
+}
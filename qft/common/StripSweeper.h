@@ -0,0 +1,170 @@
+/* StripSweeper.h
+Metropolis sweeps of the lattice shared by threads pinned to the cores, for the Ising spins
+and the phi^4 field alike.
+
+The lattice is cut along its last dimension (rows in 2D, planes in 3D) into two
+strips per worker, each at least one slice thick. A site then only has
+neighbours in its own strip and in the strips right before and after it, also
+across the helical boundary, so all even strips can be swept at the same time,
+and then all odd ones. Within a strip the sites are visited in order.
+
+Worker w is pinned to a cpu (see Topology.h), owns strips 2w and 2w + 1 and
+draws from its own random number stream. The worker threads are started once, by
+the constructor, and wait between calls to sweep, so a sweep costs two barriers
+rather than starting and pinning every thread again. With firstTouch the workers
+copy their strips of the lattice into freshly mapped pages on construction, so
+that every strip ends up on the NUMA node of the worker that sweeps it. Their
+random number generators are allocated on their own threads for the same reason.
+
+The Lattice needs latticeSize, strides, a MappedArray lattice and a thread safe
+metropolis(site, rng) that returns whether the site changed.
+*/
+#ifndef _STRIP_SWEEPER_H
+#define _STRIP_SWEEPER_H
+
+#include "Resampling.h"   // streamSeed.
+#include "SiteStorage.h"
+#include "Topology.h"
+#include <algorithm>      // copy, min.
+#include <condition_variable>
+#include <cstdio>
+#include <functional>
+#include <memory>         // unique_ptr.
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <gsl/gsl_rng.h>
+
+
+// PinnedWorkers keeps a thread pinned to each of the given cpus, waiting for tasks.
+class PinnedWorkers {
+    public:
+    explicit PinnedWorkers(const std::vector<unsigned int>& cpus);
+    ~PinnedWorkers();
+
+    PinnedWorkers(const PinnedWorkers&) = delete;
+    PinnedWorkers& operator=(const PinnedWorkers&) = delete;
+
+    // run calls task(w) on worker w of every worker and waits for all of them.
+    void run(const std::function<void(unsigned int)>& task);
+    // arrive is called by the tasks, it waits until every worker has arrived.
+    void arrive();
+
+    unsigned int size() const { return threads.size(); }
+    bool isPinned(unsigned int w) const { return pinned[w]; }
+
+    private:
+    std::vector<std::thread> threads;
+    std::vector<char> pinned;   // Written by the workers, one element each.
+
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    std::condition_variable released;
+    const std::function<void(unsigned int)>* current;
+    unsigned long long generation;  // Of the current task, the workers wait for it to change.
+    unsigned int running;
+    bool stopping;
+    unsigned int arrived;
+    unsigned long long phase;       // Of the barrier of arrive.
+
+    void work(unsigned int w, unsigned int cpu);
+};
+
+
+template <typename Lattice>
+class StripSweeper {
+    public:
+    // threads = 0 uses every cpu of the topology, at most half a worker per slice is used.
+    // firstTouch must be off for a lattice kept in a file, it would be copied to memory.
+    StripSweeper(Lattice* l, unsigned int threads, unsigned long seed, bool firstTouch) : lattice(l) {
+        // Every strip is a whole number of slices of the last dimension, at least one.
+        siteIndex sliceSize = lattice->strides.back();
+        siteIndex slices = lattice->latticeSize / sliceSize;
+        if (slices < 2)
+            throw std::runtime_error("Threaded sweeps need at least 2 slices along the last dimension");
+        if (threads == 0)
+            threads = topology.getCpus().size();
+        threads = std::min<siteIndex>(threads, slices / 2);
+
+        unsigned int strips = 2 * threads;
+        std::vector<unsigned int> cpus(threads);
+        strip.resize(threads);
+        for (unsigned int w = 0; w < threads; w++) {
+            cpus[w] = strip[w].cpu = topology.cpuFor(w, threads);
+            for (unsigned int k = 0; k < 2; k++) {
+                strip[w].begin[k] = (2 * w + k) * slices / strips * sliceSize;
+                strip[w].end[k] = (2 * w + k + 1) * slices / strips * sliceSize;
+            }
+        }
+        workers = std::make_unique<PinnedWorkers>(cpus);
+
+        // The lattice is written first by the worker that sweeps it, the old pages are given back.
+        decltype(Lattice::lattice) placed(firstTouch ? lattice->latticeSize : 0);
+        workers->run([&](unsigned int w) {
+            Strip& own = strip[w];
+            own.generator.reset(gsl_rng_alloc(gsl_rng_mt19937));
+            gsl_rng_set(own.generator.get(), streamSeed(seed, w));
+            if (firstTouch) {
+                for (unsigned int k = 0; k < 2; k++)
+                    std::copy(lattice->lattice.begin() + own.begin[k], lattice->lattice.begin() + own.end[k],
+                              placed.begin() + own.begin[k]);
+            }
+        });
+        if (firstTouch)
+            lattice->lattice = std::move(placed);
+    }
+
+    // sweep performs the given number of sweeps and returns the number of changed sites.
+    unsigned long long sweep(unsigned int sweeps) {
+        workers->run([&](unsigned int w) {
+            Strip& own = strip[w];
+            unsigned long long changed = 0;
+            for (unsigned int s = 0; s < sweeps; s++) {
+                for (unsigned int k = 0; k < 2; k++) {
+                    for (siteIndex site = own.begin[k]; site < own.end[k]; site++)
+                        changed += lattice->metropolis(site, own.generator.get());
+                    // Nobody starts on the next strips before the neighbours of all of them are done.
+                    workers->arrive();
+                }
+            }
+            own.changed = changed;
+        });
+
+        unsigned long long total = 0;
+        for (const Strip& own : strip)
+            total += own.changed;
+        return total;
+    }
+
+    unsigned int getThreads() const { return workers->size(); }
+
+    void report(FILE* out) const {
+        topology.report(out);
+        for (unsigned int w = 0; w < strip.size(); w++) {
+            fprintf(out, "threads: worker %u on cpu %u (node %u%s), sites %llu-%llu and %llu-%llu\n",
+                    w, strip[w].cpu, topology.nodeOf(strip[w].cpu), workers->isPinned(w) ? "" : ", not pinned",
+                    (unsigned long long)strip[w].begin[0], (unsigned long long)strip[w].end[0] - 1,
+                    (unsigned long long)strip[w].begin[1], (unsigned long long)strip[w].end[1] - 1);
+        }
+    }
+
+    private:
+    // The strips of a worker and what it sweeps them with.
+    struct Strip {
+        unsigned int cpu = 0;
+        siteIndex begin[2] = {0, 0};  // The even strip, then the odd one.
+        siteIndex end[2] = {0, 0};
+        std::unique_ptr<gsl_rng, decltype(&gsl_rng_free)> generator{nullptr, gsl_rng_free};
+        unsigned long long changed = 0;
+    };
+
+    Lattice* lattice;
+    Topology topology;
+    std::vector<Strip> strip;
+    // Last, so the threads are stopped before anything they use goes.
+    std::unique_ptr<PinnedWorkers> workers;
+};
+
+#endif // _STRIP_SWEEPER_H
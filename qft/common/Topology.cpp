@@ -0,0 +1,108 @@
+/* Topology.cpp
+The NUMA nodes and cores the process may run on, and pinning threads to them.
+*/
+#include "Topology.h"
+#include <algorithm>  // sort.
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <dirent.h>  // opendir, readdir.
+#include <sched.h>   // sched_getaffinity, sched_setaffinity.
+
+
+// parseCpuList reads the kernel's cpu list format, e.g. "0-3,8,10-11".
+static std::vector<unsigned int> parseCpuList(const std::string& list) {
+    std::vector<unsigned int> result;
+    std::stringstream ranges(list);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty() || range == "\n")
+            continue;
+        size_t dash = range.find('-');
+        unsigned int first = std::stoul(range.substr(0, dash));
+        unsigned int last = (dash == std::string::npos) ? first : std::stoul(range.substr(dash + 1));
+        for (unsigned int cpu = first; cpu <= last; cpu++)
+            result.push_back(cpu);
+    }
+    return result;
+}
+
+Topology::Topology() {
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        CPU_ZERO(&allowed);
+
+    std::vector<unsigned int> nodeIds;
+    if (DIR* dir = opendir("/sys/devices/system/node")) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 4 && name.compare(0, 4, "node") == 0 && name.find_first_not_of("0123456789", 4) == std::string::npos)
+                nodeIds.push_back(std::stoul(name.substr(4)));
+        }
+        closedir(dir);
+    }
+    std::sort(nodeIds.begin(), nodeIds.end());
+
+    for (unsigned int id : nodeIds) {
+        std::ifstream file("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+        std::string list;
+        std::getline(file, list);
+
+        NumaNode node = {id, {}};
+        for (unsigned int cpu : parseCpuList(list)) {
+            if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+                node.cpus.push_back(cpu);
+        }
+        // Nodes with memory but no usable cpus can't host workers.
+        if (!node.cpus.empty())
+            nodes.push_back(node);
+    }
+
+    if (nodes.empty()) {
+        NumaNode node = {0, {}};
+        for (unsigned int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &allowed))
+                node.cpus.push_back(cpu);
+        }
+        if (node.cpus.empty())
+            node.cpus.push_back(0);
+        nodes.push_back(node);
+    }
+
+    for (const NumaNode& node : nodes)
+        cpus.insert(cpus.end(), node.cpus.begin(), node.cpus.end());
+}
+
+unsigned int Topology::nodeOf(unsigned int cpu) const {
+    for (const NumaNode& node : nodes) {
+        for (unsigned int c : node.cpus) {
+            if (c == cpu)
+                return node.id;
+        }
+    }
+    return nodes.front().id;
+}
+
+unsigned int Topology::cpuFor(unsigned int worker, unsigned int workers) const {
+    if (workers <= cpus.size())
+        return cpus[(size_t)worker * cpus.size() / workers];
+    return cpus[worker % cpus.size()];
+}
+
+bool Topology::pin(unsigned int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+}
+
+void Topology::report(FILE* out) const {
+    fprintf(out, "topology: %zu cpus on %zu nodes\n", cpus.size(), nodes.size());
+    for (const NumaNode& node : nodes) {
+        fprintf(out, "topology: node %u cpus", node.id);
+        for (unsigned int cpu : node.cpus)
+            fprintf(out, " %u", cpu);
+        fprintf(out, "\n");
+    }
+}
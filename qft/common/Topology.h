@@ -0,0 +1,48 @@
+/* Topology.h
+The NUMA nodes and cores the process may run on, and pinning threads to them.
+
+The nodes and their cpus are read from /sys/devices/system/node, restricted to
+the cpus in the affinity mask of the process (taskset, cgroups, batch systems).
+Machines without the node directory are a single node. The cpus are listed node
+by node, so handing consecutive workers consecutive cpus keeps the workers of
+neighbouring strips of a lattice on the same node.
+
+Memory lands on the node of the thread that first touches it, so data shared
+by pinned workers should be written first by the worker that will use it.
+*/
+#ifndef _TOPOLOGY_H
+#define _TOPOLOGY_H
+
+#include <cstdio>
+#include <vector>
+
+
+struct NumaNode {
+    unsigned int id;
+    std::vector<unsigned int> cpus;
+};
+
+class Topology {
+    public:
+    Topology();
+
+    const std::vector<NumaNode>& getNodes() const { return nodes; }
+    // Every usable cpu, node by node.
+    const std::vector<unsigned int>& getCpus() const { return cpus; }
+    unsigned int nodeOf(unsigned int cpu) const;
+
+    // cpuFor spreads workers evenly over the cpus, worker w of n gets a cpu on the
+    // same node as workers w - 1 and w + 1 whenever possible.
+    unsigned int cpuFor(unsigned int worker, unsigned int workers) const;
+
+    // pin binds the calling thread to cpu, it returns false if the kernel refused.
+    static bool pin(unsigned int cpu);
+
+    void report(FILE* out) const;
+
+    private:
+    std::vector<NumaNode> nodes;
+    std::vector<unsigned int> cpus;
+};
+
+#endif // _TOPOLOGY_H
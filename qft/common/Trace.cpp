@@ -0,0 +1,124 @@
+/* Trace.cpp
+Timeline tracing of the simulation phases, exported as Chrome trace_event JSON.
+*/
+#include "Trace.h"
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept> // For std::runtime_error
+#include <vector>
+#include <unistd.h>  // getpid.
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+// TraceBuffer is written by its owning thread only.
+struct TraceBuffer {
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> head{0};  // Number of events ever recorded.
+    unsigned int tid;
+    std::string threadName;
+};
+
+std::chrono::steady_clock::time_point origin;
+std::size_t bufferCapacity = 0;
+
+// The registry lock is only taken the first time a thread records an event.
+std::mutex registryMutex;
+std::vector<std::unique_ptr<TraceBuffer>> registry;
+thread_local TraceBuffer* localBuffer = nullptr;
+
+TraceBuffer* threadBuffer() {
+    if (localBuffer == nullptr) {
+        auto buffer = std::make_unique<TraceBuffer>();
+        buffer->events.resize(bufferCapacity);
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer->tid = registry.size() + 1;
+        buffer->threadName = (buffer->tid == 1) ? "main" : "worker-" + std::to_string(buffer->tid - 1);
+        localBuffer = buffer.get();
+        registry.push_back(std::move(buffer));
+    }
+    return localBuffer;
+}
+
+// Chrome wants microseconds; we keep the nanoseconds as decimals.
+void writeMicroseconds(std::ofstream& file, uint64_t nanoseconds) {
+    file << nanoseconds / 1000 << "." << (nanoseconds % 1000) / 100 << (nanoseconds % 100) / 10 << nanoseconds % 10;
+}
+
+}  // namespace
+
+
+std::atomic<bool> Trace::active{false};
+
+void Trace::enable(std::size_t capacity) {
+    if (capacity == 0)
+        throw std::runtime_error("The trace buffer needs room for at least one event");
+    origin = std::chrono::steady_clock::now();
+    bufferCapacity = capacity;
+    active.store(true, std::memory_order_release);
+}
+
+uint64_t Trace::now() {
+    auto elapsed = std::chrono::steady_clock::now() - origin;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void Trace::complete(const char* name, uint64_t start) {
+    if (!enabled())
+        return;
+    uint64_t end = now();
+
+    TraceBuffer* buffer = threadBuffer();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    buffer->events[head % bufferCapacity] = {name, start, end - start};
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const std::string& name) {
+    if (!enabled())
+        return;
+    threadBuffer()->threadName = name;
+}
+
+void Trace::write(const std::string& path) {
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + path);
+    }
+
+    int pid = (int)getpid();
+    bool first = true;
+    uint64_t dropped = 0;
+
+    file << "{\"traceEvents\":[\n";
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (const auto& buffer : registry) {
+        if (!first)
+            file << ",\n";
+        first = false;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+             << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t oldest = (head > bufferCapacity) ? head - bufferCapacity : 0;
+        dropped += oldest;
+        for (uint64_t i = oldest; i < head; i++) {
+            const TraceEvent& event = buffer->events[i % bufferCapacity];
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"ts\":";
+            writeMicroseconds(file, event.start);
+            file << ",\"dur\":";
+            writeMicroseconds(file, event.duration);
+            file << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid << "}";
+        }
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":" << dropped << "}}\n";
+    file.close();
+}
@@ -0,0 +1,64 @@
+/* Trace.h
+Timeline tracing of the simulation phases, exported as Chrome trace_event JSON
+(open it with https://ui.perfetto.dev or chrome://tracing).
+
+Every thread that records an event gets its own fixed-size ring buffer, so
+recording never takes a lock: the owning thread is the only writer and it
+publishes each event by bumping an atomic head. When a buffer is full the
+oldest events are overwritten. Events are stored as complete ("X") events,
+a name plus a start time and a duration, which keeps the JSON well formed
+even when the ring has wrapped around.
+
+Tracing is off unless Trace::enable() is called. The disabled path is a single
+relaxed atomic load, so the instrumentation can stay in the hot loops as long
+as it is kept at the granularity of sweeps rather than site updates.
+*/
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+
+class Trace {
+    public:
+    // capacity is the number of events each thread keeps.
+    static void enable(std::size_t capacity);
+    static bool enabled() { return active.load(std::memory_order_relaxed); }
+
+    // now returns nanoseconds since tracing was enabled.
+    static uint64_t now();
+    // complete records an event that started at start and ends now.
+    // name must outlive the trace (in practice, a string literal).
+    static void complete(const char* name, uint64_t start);
+    // setThreadName labels the calling thread in the timeline, instead of worker-N.
+    static void setThreadName(const std::string& name);
+
+    // write dumps every buffer. Call it once the traced threads are done.
+    static void write(const std::string& path);
+
+    private:
+    static std::atomic<bool> active;
+};
+
+
+// TraceScope records an event covering its own lifetime.
+class TraceScope {
+    public:
+    explicit TraceScope(const char* eventName)
+        : name(Trace::enabled() ? eventName : nullptr), start(name ? Trace::now() : 0) {}
+    ~TraceScope() {
+        if (name)
+            Trace::complete(name, start);
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    private:
+    const char* name;
+    uint64_t start;
+};
+
+#endif // _TRACE_H
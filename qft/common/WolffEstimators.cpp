@@ -0,0 +1,126 @@
+/* WolffEstimators.cpp
+Implements the improved estimators of the wolff clusters.
+*/
+#include "WolffEstimators.h"
+#include <algorithm>  // min.
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include "Correlations.h"  // lowestMode, modeMomentum.
+
+
+WolffEstimators::WolffEstimators(const std::vector<unsigned int>& sizes, bool measurePairs)
+    : dims(sizes), sites(1), pairs(measurePairs), clusterSizes(0.0), series(sizes.size() + 1) {
+    for (unsigned int size : dims) {
+        strides.push_back(sites);
+        sites *= size;
+        correlations.emplace_back(size / 2 + 1, 0.0);
+    }
+}
+
+
+void WolffEstimators::add(const std::vector<siteIndex>& members, const std::function<bool(siteIndex)>& contains,
+                          const std::function<double(siteIndex)>& weight) {
+    double size = members.size();
+    clusterSizes += size;
+
+    // The phases are taken modulo 2 pi in integers, before they are turned into doubles.
+    std::vector<double> re(dims.size(), 0.0), im(dims.size(), 0.0);
+    std::vector<siteIndex> modes;
+    for (unsigned int d = 0; d < dims.size(); d++)
+        modes.push_back(lowestMode(dims, d));
+    double total = 0.0;
+    for (siteIndex x : members) {
+        double w = weight(x);
+        total += w;
+        for (unsigned int d = 0; d < dims.size(); d++) {
+            siteIndex turns = (siteIndex)(((unsigned __int128)modes[d] * x) % sites);
+            double phase = 2 * M_PI * turns / sites;
+            re[d] += w * std::cos(phase);
+            im[d] += w * std::sin(phase);
+        }
+    }
+    series[0].push_back(total * total / size);
+    for (unsigned int d = 0; d < dims.size(); d++)
+        series[d + 1].push_back((re[d] * re[d] + im[d] * im[d]) / size);
+
+    if (!pairs)
+        return;
+    for (siteIndex x : members) {
+        double w = weight(x);
+        for (unsigned int d = 0; d < dims.size(); d++) {
+            correlations[d][0] += w * w / size;
+            for (unsigned int r = 1; r < correlations[d].size(); r++) {
+                siteIndex y = (x + r * strides[d]) % sites;
+                if (contains(y))
+                    correlations[d][r] += w * weight(y) / size;
+            }
+        }
+    }
+}
+
+
+double WolffEstimators::meanClusterSize() const {
+    return size() > 0 ? clusterSizes / size() : 0.0;
+}
+
+
+ResamplingResult WolffEstimators::secondMoment(unsigned int bins) const {
+    Resampler resampler(series, bins);
+    return resampler.jackknife([](const std::vector<double>& a) { return a[0]; });
+}
+
+
+ResamplingResult WolffEstimators::correlationLength(unsigned int bins) const {
+    std::vector<double> khat;
+    for (unsigned int d = 0; d < dims.size(); d++)
+        khat.push_back(modeMomentum(dims, lowestMode(dims, d)));
+    Resampler resampler(series, bins);
+    return resampler.jackknife([khat](const std::vector<double>& a) {
+        double sum = 0.0;
+        for (unsigned int d = 0; d < khat.size(); d++) {
+            double ratio = a[0] / a[d + 1] - 1;
+            sum += (ratio > 0) ? std::sqrt(ratio) / khat[d] : 0.0;
+        }
+        return sum / khat.size();
+    });
+}
+
+
+std::vector<double> WolffEstimators::correlation(unsigned int d) const {
+    std::vector<double> g = correlations[d];
+    for (double& value : g)
+        value = size() > 0 ? value / size() : 0.0;
+    return g;
+}
+
+
+void WolffEstimators::write(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file for writing: " + path);
+    file.precision(std::numeric_limits<double>::max_digits10);
+    file << "# clusters=" << size() << " mean size=" << meanClusterSize() << "\n";
+    file << "# dimension, r, G(r) from the wolff clusters\n";
+    for (unsigned int d = 0; d < dims.size(); d++) {
+        std::vector<double> g = correlation(d);
+        for (unsigned int r = 0; r < g.size(); r++)
+            file << d << "\t" << r << "\t" << g[r] << "\n";
+    }
+    if (!file)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+
+void WolffEstimators::report(FILE* out, double beta) const {
+    fprintf(out, "wolff: %zu clusters, <|C|> %f", size(), meanClusterSize());
+    if (size() >= 2) {
+        unsigned int bins = std::min<std::size_t>(32, size());
+        ResamplingResult moment = secondMoment(bins);
+        ResamplingResult xi = correlationLength(bins);
+        fprintf(out, ", chi' = beta <W^2/|C|> %f +- %f, xi_2nd %f +- %f",
+                beta * moment.value, beta * moment.error, xi.value, xi.error);
+    }
+    fprintf(out, "\n");
+}
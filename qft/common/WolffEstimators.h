@@ -0,0 +1,67 @@
+/* WolffEstimators.h
+Improved estimators measured on the clusters of the wolff update.
+
+The wolff update picks a cluster with probability |C| / N, so an average over the
+Swendsen-Wang clusters of a configuration becomes an average over the wolff clusters
+weighted by N / |C|. With W = sum over the cluster of the weights |x| (1 for spins):
+
+    <M^2> / N = <W^2 / |C|>                      chi' = beta N <m^2> = beta <W^2 / |C|>
+    S(k)      = <|sum_C |x| e^(i k x)|^2 / |C|>  S(0) is the same as <M^2> / N
+    G(r)      = <sum_(x, x + r in C) |x| |x + r| / |C|>
+
+Only pairs of sites in the same cluster contribute, so these estimators don't carry the
+noise of the cancelling contributions of different clusters. Near T_c they need far fewer
+samples than the variance of the magnetization. The momenta are the modes of the helical
+lattice, as in Correlations.h.
+
+S(0) and S(k) of the lowest mode along every dimension are kept for every cluster, so that
+chi' and the second-moment correlation length get jackknife errors. G(r) along every axis
+costs |C| L lookups per cluster and is only measured on request.
+*/
+#ifndef _WOLFF_ESTIMATORS_H
+#define _WOLFF_ESTIMATORS_H
+
+#include <cstddef>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Resampling.h"
+#include "SiteStorage.h"
+
+
+class WolffEstimators {
+    public:
+    // sizes holds the size of every dimension of the lattice, x first.
+    // G(r) is only measured with measurePairs.
+    WolffEstimators(const std::vector<unsigned int>& sizes, bool measurePairs);
+
+    // add measures one cluster: its sites, whether a site belongs to it, and the weight |x| of a site.
+    void add(const std::vector<siteIndex>& members, const std::function<bool(siteIndex)>& contains,
+             const std::function<double(siteIndex)>& weight);
+
+    std::size_t size() const { return series[0].size(); }
+    double meanClusterSize() const;
+    // jackknife errors over bins blocks of clusters, size() must be at least 2.
+    ResamplingResult secondMoment(unsigned int bins) const;       // <M^2> / N = S(0).
+    ResamplingResult correlationLength(unsigned int bins) const;  // Second moment, averaged over the dimensions.
+    std::vector<double> correlation(unsigned int d) const;         // G(r) for r = 0, ..., L_d / 2.
+
+    // write saves G(r) along every dimension as text, one line per distance.
+    // It throws std::runtime_error if the file can't be written.
+    void write(const std::string& path) const;
+    // report prints <|C|>, chi' = beta <W^2 / |C|> and the correlation length with their errors.
+    void report(FILE* out, double beta) const;
+
+    private:
+    std::vector<unsigned int> dims;
+    std::vector<siteIndex> strides;
+    siteIndex sites;
+    bool pairs;
+
+    double clusterSizes;
+    std::vector<std::vector<double>> series;       // S(0), then S(k_d) of every cluster.
+    std::vector<std::vector<double>> correlations;  // Summed G(r) along every dimension.
+};
+
+#endif // _WOLFF_ESTIMATORS_H
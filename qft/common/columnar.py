@@ -0,0 +1,57 @@
+"""Reader of the columnar time series files (see Columns.h).
+
+The columns are numpy.memmap views of the file, nothing is copied until it is used:
+
+    import columnar
+    series = columnar.load('series.col')
+    series.attributes['temp'], len(series)
+    energy = series['energy']
+"""
+import json
+import struct
+from dataclasses import dataclass, field
+from typing import Dict
+
+import numpy as np
+
+MAGIC = b'QFTCOLS1'
+
+
+@dataclass
+class Columns:
+    """The columns of a file, by name, and the attributes of its header."""
+    path: str
+    rows: int
+    attributes: Dict[str, float]
+    columns: Dict[str, np.ndarray] = field(repr=False)
+
+    def __getitem__(self, name: str) -> np.ndarray:
+        return self.columns[name]
+
+    def __len__(self) -> int:
+        return self.rows
+
+    def keys(self):
+        return self.columns.keys()
+
+
+def load(path: str) -> Columns:
+    """Maps the columns of a file, read-only.
+
+    The rows are those written when it is called, a file still being written can be loaded
+    again later to see more of them.
+    """
+    with open(path, 'rb') as f:
+        prefix = f.read(24)
+        if len(prefix) < 24 or prefix[:8] != MAGIC:
+            raise ValueError(f'{path} is not a columnar file')
+        rows, header_bytes = struct.unpack('<QQ', prefix[8:])
+        header = json.loads(f.read(header_bytes))
+
+    columns = {}
+    for column in header['columns']:
+        dtype = np.dtype(column['dtype'])
+        # A memory map can't be empty.
+        columns[column['name']] = np.memmap(
+            path, dtype=dtype, mode='r', offset=column['offset'], shape=(rows,)) if rows > 0 else np.empty(0, dtype)
+    return Columns(path=path, rows=rows, attributes=header['attributes'], columns=columns)
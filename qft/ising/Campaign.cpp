@@ -0,0 +1,273 @@
+/* Campaign.cpp
+Runs a finite-size-scaling campaign: the same Ising simulation for every (L, T, seed) of a job
+file, on a work stealing pool of threads, with the results of every job appended to a single
+CSV file as soon as it is done.
+
+The job file has one job per line, "L temp seed", with the temperature as 100x kT as in
+Metropolis and the seed 1 if left out. Blank lines and lines starting with # are skipped.
+Every job simulates an L^dimensions lattice: init equilibration steps, then a measurement every
+gap steps of the update chosen with --algorithm. The columns of the results are
+
+    L,dimensions,temp,seed,init,sampleSize,algorithm,gap,bins,avgE,errE,avgMAbs,errMAbs,c,errC,chi,errChi,binder,errBinder,seconds
+
+with blocked jackknife errors. Jobs already in the results file with the same settings are
+skipped, so an interrupted campaign is resumed by running it again. A results file with other
+columns is refused rather than appended to. With --cache the row of every finished job is also
+stored in a result cache (see ResultCache.h), shared by the campaigns: a job another campaign
+already ran is copied from it instead of being run again.
+
+Usage: ./Campaign jobs.txt results.csv [--threads=0] [--init=1000] [--samples=1000] ...
+*/
+#include <algorithm>         // min.
+#include <chrono>
+#include <cmath>             // fabs.
+#include <cstdio>            // printf.
+#include <cstdlib>           // exit.
+#include <filesystem>
+#include <fstream>
+#include <memory>            // unique_ptr.
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "Lattice.h"
+#include "Options.h"
+#include "Resampling.h"
+#include "ResultCache.h"
+#include "UpdateScheduler.h"
+#include "WorkStealingPool.h"
+
+
+struct CampaignJob {
+    unsigned int L;
+    unsigned int temp;  // 100x kT.
+    unsigned int seed;
+};
+
+struct CampaignSettings {
+    unsigned int dimensions;
+    unsigned int init;
+    unsigned int sampleSize;
+    unsigned int gap;
+    UpdateAlgorithm algorithm;
+    unsigned int bins;
+};
+
+
+std::vector<CampaignJob> readJobs(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open the job file: " + filename);
+
+    std::vector<CampaignJob> jobs;
+    std::string line;
+    unsigned int number = 0;
+    while (std::getline(file, line)) {
+        number++;
+        std::istringstream fields(line);
+        std::string first;
+        if (!(fields >> first) || first[0] == '#')
+            continue;
+        CampaignJob job{0, 0, 1};
+        fields.str(line);
+        fields.clear();
+        if (!(fields >> job.L >> job.temp) || job.L < 2 || job.temp == 0)
+            throw std::runtime_error(filename + ":" + std::to_string(number) + ": expected \"L temp [seed]\"");
+        unsigned int seed;
+        if (fields >> seed)
+            job.seed = seed;
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+
+const std::string resultsHeader = "L,dimensions,temp,seed,init,sampleSize,algorithm,gap,bins,avgE,errE,avgMAbs,errMAbs,"
+                                  "c,errC,chi,errChi,binder,errBinder,seconds";
+
+// A job and the settings its row depends on, the first columns of the row.
+typedef std::tuple<unsigned int, unsigned int, unsigned int, unsigned int, unsigned int, unsigned int,
+                   std::string, unsigned int, unsigned int> JobKey;
+
+JobKey jobKey(const CampaignJob& job, const CampaignSettings& settings) {
+    return {job.L, settings.dimensions, job.temp, job.seed, settings.init, settings.sampleSize,
+            algorithmName(settings.algorithm), settings.gap, settings.bins};
+}
+
+// The jobs of an existing results file.
+std::set<JobKey> readDone(const std::string& filename) {
+    std::set<JobKey> done;
+    std::ifstream file(filename);
+    std::string line;
+    if (std::getline(file, line) && line != resultsHeader)
+        throw std::runtime_error(filename + " has other columns than the results of this Campaign, refusing to append to it");
+    while (std::getline(file, line)) {
+        unsigned int L, dimensions, temp, seed, init, sampleSize, gap, bins;
+        char algorithm[32];
+        if (sscanf(line.c_str(), "%u,%u,%u,%u,%u,%u,%31[^,],%u,%u", &L, &dimensions, &temp, &seed, &init,
+                   &sampleSize, algorithm, &gap, &bins) == 9)
+            done.insert({L, dimensions, temp, seed, init, sampleSize, algorithm, gap, bins});
+    }
+    return done;
+}
+
+
+// runJob simulates one job and returns its line of the results.
+std::string runJob(const CampaignJob& job, const CampaignSettings& settings) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<unsigned int> dims(settings.dimensions, job.L);
+    Lattice lattice(dims, job.temp);
+
+    // The lattice seeds its generator with the temperature, every seed gets its own stream
+    // and its own random initial state.
+    gsl_rng_set(lattice.generator, streamSeed(job.temp, job.seed));
+    for (siteIndex i = 0; i < lattice.latticeSize; i++)
+        lattice.lattice[i] = (gsl_rng_uniform(lattice.generator) < 0.5) ? -1 : 1;
+    lattice.calcTotalEnergy();
+
+    UpdateScheduler scheduler(&lattice);
+    for (unsigned int s = 0; s < settings.init; s++)
+        scheduler.step(settings.algorithm);
+
+    std::vector<std::vector<double>> primary(5, std::vector<double>(settings.sampleSize));
+    for (unsigned int i = 0; i < settings.sampleSize; i++) {
+        for (unsigned int s = 0; s < settings.gap; s++)
+            scheduler.step(settings.algorithm);
+        double e = lattice.calcTotalEnergy();
+        double m = fabs(lattice.calcMagnetization());
+        primary[0][i] = e;
+        primary[1][i] = e * e;
+        primary[2][i] = m;
+        primary[3][i] = m * m;
+        primary[4][i] = m * m * m * m;
+    }
+
+    // The same quantities and errors as Metropolis --resample.
+    Resampler resampler(primary, std::min(settings.bins, settings.sampleSize));
+    double beta = lattice.beta;
+    double size = lattice.latticeSize;
+    std::vector<DerivedQuantity> quantities = {
+        [](const std::vector<double>& a) { return a[0]; },
+        [](const std::vector<double>& a) { return a[2]; },
+        [=](const std::vector<double>& a) { return beta * beta * size * (a[1] - a[0] * a[0]); },
+        [=](const std::vector<double>& a) { return beta * size * (a[3] - a[2] * a[2]); },
+        [](const std::vector<double>& a) { return 1 - a[4] / (3 * a[3] * a[3]); },
+    };
+
+    char prefix[256];
+    snprintf(prefix, sizeof(prefix), "%u,%u,%u,%u,%u,%u,%s,%u,%u", job.L, settings.dimensions, job.temp, job.seed,
+             settings.init, settings.sampleSize, algorithmName(settings.algorithm).c_str(), settings.gap, settings.bins);
+    std::string row = prefix;
+    for (const DerivedQuantity& f : quantities) {
+        ResamplingResult result = resampler.jackknife(f);
+        char values[64];
+        snprintf(values, sizeof(values), ",%lf,%lf", result.value, result.error);
+        row += values;
+    }
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), ",%.3f", std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return row + seconds;
+}
+
+
+int main(int argc, char** const argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s jobs.txt results.csv [options]\n", argv[0]);
+        fprintf(stderr, "The job file has a line \"L temp [seed]\" per job, temp is 100x kT.\n");
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --threads=0           threads running the jobs, pinned to the cores (0 uses every core)\n");
+        fprintf(stderr, "  --dimensions=2        dimensions of the L^dimensions lattices\n");
+        fprintf(stderr, "  --init=1000           equilibration steps of every job\n");
+        fprintf(stderr, "  --samples=1000        measurements of every job\n");
+        fprintf(stderr, "  --gap=5               steps between measurements\n");
+        fprintf(stderr, "  --algorithm=NAME      update of a step: metropolis (default), wolff, swendsen-wang or mixed\n");
+        fprintf(stderr, "  --bins=32             bins of the jackknife errors\n");
+        fprintf(stderr, "  --cache=results-cache copy the jobs already in this cache, and store the new ones there\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    std::string jobFile = argv[1];
+    std::string resultFile = argv[2];
+    Options options(argc, argv, 3);
+
+    CampaignSettings settings;
+    settings.dimensions = options.getUInt("dimensions", 2);
+    settings.init = options.getUInt("init", 1000);
+    settings.sampleSize = options.getUInt("samples", 1000);
+    settings.gap = options.getUInt("gap", 5);
+    settings.algorithm = parseAlgorithm(options.get("algorithm", "metropolis"));
+    settings.bins = options.getUInt("bins", 32);
+
+    std::vector<CampaignJob> jobs = readJobs(jobFile);
+    std::set<JobKey> done = readDone(resultFile);
+    bool fresh = !std::filesystem::exists(resultFile) || std::filesystem::file_size(resultFile) == 0;
+
+    std::ofstream results(resultFile, std::ios::app);
+    if (!results.is_open())
+        throw std::runtime_error("Failed to open file for writing: " + resultFile);
+    if (fresh)
+        results << resultsHeader << std::endl;
+
+    std::unique_ptr<ResultCache> cache;
+    if (options.has("cache"))
+        cache = std::make_unique<ResultCache>(options.get("cache", "results-cache"));
+    // A job is described by all that its row depends on.
+    auto describe = [&](const CampaignJob& job) {
+        return ResultCache::describe({"Campaign", std::to_string(job.L), std::to_string(settings.dimensions),
+                                      std::to_string(job.temp), std::to_string(job.seed), std::to_string(settings.init),
+                                      std::to_string(settings.sampleSize), std::to_string(settings.gap),
+                                      algorithmName(settings.algorithm), std::to_string(settings.bins)});
+    };
+
+    // The cost of a job is estimated as its site updates, the largest ones are started first.
+    std::vector<PoolTask> tasks;
+    std::mutex resultsMutex;
+    unsigned int finished = 0, skipped = 0, cached = 0;
+    std::size_t count = 0;
+    for (const CampaignJob& job : jobs) {
+        if (done.count(jobKey(job, settings))) {
+            skipped++;
+            continue;
+        }
+        CacheEntry entry;
+        if (cache && cache->lookup(describe(job), entry)) {
+            results << entry.restoreFiles() << std::flush;
+            cached++;
+            continue;
+        }
+        double sites = 1;
+        for (unsigned int d = 0; d < settings.dimensions; d++)
+            sites *= job.L;
+        double cost = sites * (settings.init + (double)settings.gap * settings.sampleSize);
+        tasks.push_back({cost, [&, job](unsigned int worker) {
+            std::string row = runJob(job, settings);
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            results << row << std::endl;  // Flushed, a partial campaign is usable.
+            if (cache) {
+                CacheEntry stored;
+                stored.blobs.emplace_back("stdout", row + "\n");
+                cache->store(describe(job), stored);
+            }
+            finished++;
+            fprintf(stderr, "campaign: L=%u temp=%u seed=%u done on worker %u (%u of %zu)\n",
+                    job.L, job.temp, job.seed, worker, finished, count);
+        }});
+    }
+    count = tasks.size();
+    if (skipped > 0)
+        fprintf(stderr, "campaign: %u jobs already in %s\n", skipped, resultFile.c_str());
+    if (cached > 0)
+        fprintf(stderr, "campaign: %u jobs copied from the cache\n", cached);
+
+    auto start = std::chrono::steady_clock::now();
+    WorkStealingPool pool(options.getUInt("threads", 0));
+    pool.run(std::move(tasks));
+    fprintf(stderr, "campaign: %zu jobs on %u threads in %.1f s, %llu steals\n", count, pool.getThreads(),
+            std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), pool.getSteals());
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/* CreutzDemon.cpp
+Microcanonical (Creutz demon) dynamics of the Ising lattice.
+*/
+#include "CreutzDemon.h"
+#include <algorithm>  // max.
+#include <cmath>      // cosh, sinh, tanh, sqrt, log.
+#include <numeric>    // accumulate.
+#include <stdexcept>  // For std::runtime_error
+
+
+CreutzDemon::CreutzDemon(Lattice* l, unsigned int s)
+    : lattice(l), stripes(s), bank(0), rows(l->latticeSize / l->xDim), demonSum(0.0), demonSamples(0) {
+    if (stripes == 0 || stripes > rows)
+        throw std::runtime_error("The number of demons must be between 1 and the number of rows");
+
+    demons.assign(stripes, 0);
+    stripeOf.resize(rows);
+    for (siteIndex row = 0; row < rows; row++)
+        stripeOf[row] = (unsigned long long)row * stripes / rows;
+
+    lattice->calcTotalEnergy();
+    energy = (int)lattice->totalEnergy;
+}
+
+int CreutzDemon::setEnergy(int target) {
+    // Remove energy with zero temperature sweeps, they stop once the lattice is
+    // stuck in a local minimum (e.g. stripes) and can't go any lower.
+    bool progress = true;
+    while (energy > target && progress) {
+        progress = false;
+        for (siteIndex site = 0; site < lattice->latticeSize && energy > target; site++) {
+            int deltaE = -2 * lattice->calcEnergy(site);
+            if (deltaE < 0) {
+                lattice->lattice[site] *= -1;
+                energy += deltaE;
+                progress = true;
+            }
+        }
+    }
+
+    // Below Tc the quench usually freezes into domains above the target, start over from
+    // the ordered state then, keeping the sign of the majority.
+    if (energy > target) {
+        int spin = (lattice->calcMagnetization() < 0) ? -1 : 1;
+        std::fill(lattice->lattice.begin(), lattice->lattice.end(), spin);
+        energy = -(int)(lattice->dimensions * lattice->latticeSize);
+    }
+
+    // Whatever is left goes to the bank, from which the demons are refilled a little at a
+    // time. A demon that could pay for everything would flip its whole stripe every sweep
+    // without changing the energy.
+    bank = std::max(0, target - energy);
+    for (int& demon : demons)
+        demon = 0;
+    refill();
+    return energy;
+}
+
+void CreutzDemon::refill() {
+    for (int& demon : demons) {
+        int amount = std::min(bank, std::max(0, maxRefill - demon)) / 4 * 4;
+        demon += amount;
+        bank -= amount;
+    }
+}
+
+unsigned long long CreutzDemon::sweep() {
+    if (bank > 0)
+        refill();
+
+    unsigned long long flips = 0;
+    siteIndex site = 0;
+    for (siteIndex row = 0; row < rows; row++) {
+        int& demon = demons[stripeOf[row]];
+        for (unsigned int x = 0; x < lattice->xDim; x++, site++) {
+            int deltaE = -2 * lattice->calcEnergy(site);
+            if (deltaE <= demon) {
+                lattice->lattice[site] *= -1;
+                demon -= deltaE;
+                energy += deltaE;
+                flips++;
+            }
+        }
+    }
+
+    for (int demon : demons)
+        demonSum += demon;
+    demonSamples += stripes;
+    return flips;
+}
+
+double CreutzDemon::temperature() const {
+    if (demonSamples == 0 || demonSum <= 0)
+        return 0.0;
+    return 4.0 / log(1.0 + 4.0 * demonSamples / demonSum);
+}
+
+void CreutzDemon::resetStatistics() {
+    demonSum = 0.0;
+    demonSamples = 0;
+}
+
+int CreutzDemon::getDemonEnergy() const {
+    return std::accumulate(demons.begin(), demons.end(), bank);
+}
+
+double CreutzDemon::onsagerEnergy(double temp) {
+    double beta = 1.0 / temp;
+    double k = 2 * sinh(2 * beta) / (cosh(2 * beta) * cosh(2 * beta));
+    double t = tanh(2 * beta);
+
+    // The complete elliptic integral of the first kind, K(k) = pi / (2 AGM(1, sqrt(1 - k^2))).
+    // It diverges at Tc, where its prefactor vanishes.
+    double ellipticTerm = 0.0;
+    if (k < 1.0) {
+        double a = 1.0, b = sqrt(1.0 - k * k);
+        while (fabs(a - b) > 1e-15 * a) {
+            double mean = (a + b) / 2;
+            b = sqrt(a * b);
+            a = mean;
+        }
+        ellipticTerm = (2 * t * t - 1) / a;  // (2/pi) K(k) (2 tanh^2 - 1).
+    }
+    return -(1.0 / t) * (1.0 + ellipticTerm);
+}
@@ -0,0 +1,68 @@
+/* CreutzDemon.h
+Microcanonical (Creutz demon) dynamics of the Ising lattice.
+
+A demon carries a non-negative energy. Sites are visited in a fixed order and
+a spin flips whenever the demon can pay for the energy change; energy released
+by a flip goes to the demon. The total energy of the lattice and its demons is
+conserved, and no random numbers are needed at all.
+
+The lattice is split into stripes of whole rows (runs of xDim sites, which in
+3D and 4D are rows of the x-y planes one after the other), each with its own
+demon, so
+that energy moves slowly between distant parts of the lattice only through the
+spins, as with one demon per site block.
+
+The demons are in equilibrium with the lattice, and their energies, which are
+multiples of 4, follow a Boltzmann distribution. The temperature is read from
+their average, <Ed> = 4 / (exp(4/T) - 1).
+
+To equilibrate at a given temperature the lattice is first brought to the
+energy per spin of the infinite lattice at that temperature (Onsager) and then
+left to thermalize microcanonically.
+*/
+#ifndef _CREUTZDEMON_H
+#define _CREUTZDEMON_H
+
+#include "Lattice.h"
+#include <vector>
+
+
+class CreutzDemon {
+    public:
+    CreutzDemon(Lattice* lattice, unsigned int stripes);
+
+    // Quenches the lattice down to the given total energy if it is above it (falling back
+    // to the ordered state if the quench gets stuck). The missing energy is handed to the
+    // demons over the following sweeps. Returns the lattice energy.
+    int setEnergy(int target);
+
+    // One pass over all sites. Returns the number of flips.
+    unsigned long long sweep();
+
+    // Temperature from the demon energies averaged over all sweeps since the last reset.
+    double temperature() const;
+    void resetStatistics();
+
+    int getEnergy() const { return energy; }
+    int getDemonEnergy() const;
+
+    // Energy per spin of the infinite 2D Ising lattice at temperature T (Onsager).
+    // There is no exact result in 3D and 4D.
+    static double onsagerEnergy(double temp);
+
+    private:
+    void refill();
+
+    Lattice* lattice;
+    unsigned int stripes;
+    int energy;                       // Of the lattice.
+    int bank;                         // Energy still to be handed to the demons.
+    static const int maxRefill = 16;
+    std::vector<int> demons;
+    siteIndex rows;
+    std::vector<unsigned int> stripeOf;  // Demon of every row.
+    double demonSum;
+    unsigned long long demonSamples;
+};
+
+#endif // _CREUTZDEMON_H
@@ -0,0 +1,140 @@
+/* Decomposed.cpp
+Runs one Ising lattice split over several processes on the same host. Every
+process owns a Subdomain and the processes exchange the boundary slices of
+their subdomains through shared memory after every half sweep (see
+HaloExchange.h). The observables are summed over all processes and printed
+once, in the columns of Replicas with the number of processes in place of the
+replica:
+xDim,yDim,init,sampleSize,RNSeed,T,processes,avgE,avgMAbs,c,chi,binder
+
+The throughput is reported on stderr.
+
+Usage: ./Decomposed xDim yDim init sampleSize temp processes [--zDim=1 --tDim=1 --seed=temp]
+The temperature is given as 100x kT, as in Metropolis.
+*/
+#include <chrono>
+#include <cmath>             // fabs.
+#include <cstdio>            // printf.
+#include <cstdlib>           // atoi, exit.
+#include <exception>
+#include <vector>
+#include <sys/wait.h>        // waitpid.
+#include <unistd.h>          // fork, _exit.
+#include "HaloExchange.h"
+#include "Options.h"
+#include "Subdomain.h"
+
+
+// run does the work of one process, only rank 0 prints.
+static void run(const std::vector<unsigned int>& dims, unsigned int rank, HaloExchange* exchange,
+                unsigned int init, unsigned int sampleSize, unsigned int RNSeed, unsigned long seed) {
+    double temp = (double)RNSeed / 100;
+    Subdomain subdomain(dims, rank, exchange, temp, seed);
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < init; i++)
+        subdomain.sweep();
+
+    // Measure every 5 sweeps, as Metropolis does.
+    double sumE = 0.0, sumE2 = 0.0, sumM = 0.0, sumM2 = 0.0, sumM4 = 0.0;
+    for (unsigned int i = 0; i < sampleSize; i++) {
+        for (unsigned int j = 0; j < 5; j++)
+            subdomain.sweep();
+        double energy, magnet;
+        subdomain.measure(energy, magnet);
+        double m = fabs(magnet);
+        sumE += energy;
+        sumE2 += energy * energy;
+        sumM += m;
+        sumM2 += m * m;
+        sumM4 += m * m * m * m;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (rank != 0)
+        return;
+
+    double beta = 1.0 / temp;
+    double size = subdomain.getLatticeSize();
+    double e = sumE / sampleSize, e2 = sumE2 / sampleSize;
+    double m = sumM / sampleSize, m2 = sumM2 / sampleSize, m4 = sumM4 / sampleSize;
+    printf("%d,%d,%d,%d,%d,%f,%u,%lf,%lf,%lf,%lf,%lf\n", dims[0], dims[1], init, sampleSize, RNSeed, temp,
+           exchange->getProcesses(), e, m, beta * beta * size * (e2 - e * e), beta * size * (m2 - m * m),
+           1 - m4 / (3 * m2 * m2));
+    fflush(stdout);
+
+    double updates = (double)(init + 5.0 * sampleSize) * size;
+    fprintf(stderr, "decomposed: %u processes, %.3g site updates per second, %.3g ns per site update\n",
+            exchange->getProcesses(), updates / seconds, seconds * 1e9 / updates);
+}
+
+int main(int argc, char** const argv) {
+    if (argc < 7) {
+        fprintf(stderr, "Usage: %s xDim yDim init sampleSize temp processes [options]\n", argv[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --zDim=1              z dimension, for a 3D lattice\n");
+        fprintf(stderr, "  --tDim=1              t dimension, for a 4D lattice\n");
+        fprintf(stderr, "  --seed=temp           seed of the random number streams of the processes\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    unsigned int xDim = atoi(argv[1]);
+    unsigned int yDim = atoi(argv[2]);
+    unsigned int init = atoi(argv[3]);
+    unsigned int sampleSize = atoi(argv[4]);
+    unsigned int RNSeed = atoi(argv[5]);  // 100x temperature.
+    unsigned int processes = atoi(argv[6]);
+    Options options(argc, argv, 7);
+
+    // Dimensions of size 1 are left out, --tDim without --zDim gives a 3D lattice.
+    std::vector<unsigned int> dims = {xDim, yDim};
+    for (const char* name : {"zDim", "tDim"}) {
+        if (options.getUInt(name, 1) > 1)
+            dims.push_back(options.getUInt(name, 1));
+    }
+    if (processes < 1 || processes > dims.back() / 2) {
+        fprintf(stderr, "Between 1 and %u processes, two strips of the last dimension each\n", dims.back() / 2);
+        exit(1);
+    }
+    unsigned long seed = options.getUInt("seed", RNSeed);
+    siteIndex sliceSize = 1;
+    for (unsigned int d = 0; d + 1 < dims.size(); d++)
+        sliceSize *= dims[d];
+
+    // The exchange is mapped before forking, so that every process shares it.
+    HaloExchange exchange(processes, sliceSize);
+    fflush(stdout);
+    fflush(stderr);
+    std::vector<pid_t> children;
+    for (unsigned int rank = 1; rank < processes; rank++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            int status = 0;
+            try {
+                run(dims, rank, &exchange, init, sampleSize, RNSeed, seed);
+            } catch (const std::exception& error) {
+                fprintf(stderr, "decomposed: process %u: %s\n", rank, error.what());
+                status = 1;
+            }
+            // The parent owns everything else, children leave without running any destructors.
+            fflush(stderr);
+            _exit(status);
+        }
+        children.push_back(pid);
+    }
+
+    run(dims, 0, &exchange, init, sampleSize, RNSeed, seed);
+
+    int failed = 0;
+    for (pid_t pid : children) {
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,65 @@
+/* DensityOfStates.cpp
+Estimates ln g(E) of a 2D, 3D or 4D Ising lattice with Wang-Landau sampling and derives
+the thermodynamics at every temperature of a grid from it, instead of running
+one Metropolis simulation per temperature.
+
+Usage: ./DensityOfStates xDim yDim seed dos.txt Tmin Tmax points [options]
+Temperatures are in kT units.
+*/
+#include <cstdio>            // printf.
+#include <cstdlib>           // atoi, atof.
+#include "Options.h"
+#include "WangLandau.h"
+
+
+int main(int argc, char** const argv) {
+    if (argc < 8) {
+        fprintf(stderr, "Usage: %s xDim yDim seed dos.txt Tmin Tmax points [options]\n", argv[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --zDim=1              z dimension, for a 3D lattice\n");
+        fprintf(stderr, "  --tDim=1              t dimension, for a 4D lattice\n");
+        fprintf(stderr, "  --windows=1           energy windows sampled in parallel, one thread each\n");
+        fprintf(stderr, "  --overlap=0.5         overlap between neighbouring windows\n");
+        fprintf(stderr, "  --flatness=0.8        minimum histogram entry relative to the mean\n");
+        fprintf(stderr, "  --final-logf=1e-8     stop once ln f is below this\n");
+        fprintf(stderr, "  --check-sweeps=100    sweeps between flatness checks\n");
+        fprintf(stderr, "  --accumulate-logf=1e-4  collect <|M|>(E) once ln f is below this\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    unsigned int xDim = atoi(argv[1]);
+    unsigned int yDim = atoi(argv[2]);
+    unsigned int seed = atoi(argv[3]);
+    std::string dosFile = argv[4];
+    double tempMin = atof(argv[5]);
+    double tempMax = atof(argv[6]);
+    unsigned int points = atoi(argv[7]);
+    Options options(argc, argv, 8);
+
+    WangLandauParams params;
+    params.flatness = options.getDouble("flatness", 0.8);
+    params.finalLogF = options.getDouble("final-logf", 1e-8);
+    params.checkSweeps = options.getUInt("check-sweeps", 100);
+    params.accumulateLogF = options.getDouble("accumulate-logf", 1e-4);
+
+    // Dimensions of size 1 are left out, --tDim without --zDim gives a 3D lattice.
+    std::vector<unsigned int> dims = {xDim, yDim};
+    for (const char* name : {"zDim", "tDim"}) {
+        if (options.getUInt(name, 1) > 1)
+            dims.push_back(options.getUInt(name, 1));
+    }
+
+    DensityOfStates dos = sampleDensityOfStates(dims, seed,
+        options.getUInt("windows", 1), options.getDouble("overlap", 0.5), params);
+    saveDensityOfStates(dos, dosFile);
+
+    printf("T,avgE,c,avgMAbs,f,s\n");
+    for (unsigned int i = 0; i < points; i++) {
+        double temp = (points > 1) ? tempMin + (tempMax - tempMin) * i / (points - 1) : tempMin;
+        Thermodynamics t = thermodynamics(dos, temp);
+        printf("%f,%lf,%lf,%lf,%lf,%lf\n", t.temp, t.energy, t.specificHeat, t.magnetAbs, t.freeEnergy, t.entropy);
+    }
+
+    return 0;
+}
@@ -0,0 +1,189 @@
+/* Equivalence.cpp
+Checks that a candidate update kernel samples the same distribution as a reference kernel.
+
+A faster kernel draws its random numbers differently, so its chain can't be compared with the
+reference bit by bit. Instead both kernels run many independent chains of the same lattice at
+the same temperature, every chain from its own random stream and random initial spins, and
+measure E, m and |m| once the chain has run init steps. Over the chains these are independent
+draws from the equilibrium distribution, whichever the kernel. Averages over a chain are not
+compared: their spread grows with the autocorrelation time, which differs between kernels
+that are both right. The two sets of chains are compared observable by observable with the
+Kolmogorov-Smirnov and chi-square tests of HypothesisTests.h. The candidate passes if no
+p-value is below alpha divided by the number of tests (Bonferroni), and the program then
+exits with 0, else with 1.
+
+The kernels are
+    metropolis      a sweep of random site Metropolis updates, the reference,
+    sequential      a sweep of Metropolis updates in site order,
+    wolff, swendsen-wang, mixed
+                    a step of the update, as for Metropolis --algorithm,
+    nfold           a sweep of n-fold way time,
+    strips          a sweep of the threaded strips of Metropolis --sweep-threads.
+
+Usage: ./Equivalence reference candidate L temp [--seeds=1000] [--init=1000] ...
+*/
+#include <algorithm>         // min.
+#include <chrono>
+#include <cmath>             // fabs.
+#include <cstdio>            // printf.
+#include <cstdlib>           // atoi, exit.
+#include <functional>
+#include <memory>            // unique_ptr.
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "HypothesisTests.h"
+#include "Lattice.h"
+#include "NFoldWay.h"
+#include "Options.h"
+#include "Resampling.h"      // streamSeed.
+#include "StripSweeper.h"
+#include "UpdateScheduler.h"
+#include "WorkStealingPool.h"
+
+
+struct EquivalenceSettings {
+    unsigned int L;
+    unsigned int dimensions;
+    unsigned int temp;          // 100x kT.
+    unsigned int init;
+    unsigned int stripThreads;
+};
+
+// What a chain contributes to the tests, per spin.
+struct ChainResult {
+    double energy;
+    double magnet;
+};
+
+const std::vector<std::string> kernelNames = {"metropolis", "sequential", "wolff", "swendsen-wang", "mixed", "nfold", "strips"};
+
+
+// runChain runs a chain of the kernel from its own stream of the seed.
+ChainResult runChain(const std::string& kernel, const EquivalenceSettings& settings, unsigned int seed) {
+    std::vector<unsigned int> dims(settings.dimensions, settings.L);
+    Lattice lattice(dims, settings.temp);
+    gsl_rng_set(lattice.generator, streamSeed(settings.temp, seed));
+    for (siteIndex i = 0; i < lattice.latticeSize; i++)
+        lattice.lattice[i] = (gsl_rng_uniform(lattice.generator) < 0.5) ? -1 : 1;
+    lattice.calcTotalEnergy();
+
+    std::function<void()> step;
+    std::unique_ptr<UpdateScheduler> scheduler;
+    std::unique_ptr<NFoldWay> nfold;
+    std::unique_ptr<StripSweeper<Lattice>> strips;
+    if (kernel == "sequential") {
+        step = [&]() {
+            for (siteIndex i = 0; i < lattice.latticeSize; i++)
+                lattice.metropolis(i);
+        };
+    } else if (kernel == "nfold") {
+        nfold = std::make_unique<NFoldWay>(&lattice);
+        step = [&]() { nfold->advance(1.0); };
+    } else if (kernel == "strips") {
+        strips = std::make_unique<StripSweeper<Lattice>>(&lattice, settings.stripThreads, streamSeed(settings.temp, seed), false);
+        step = [&]() { strips->sweep(1); };
+    } else {
+        UpdateAlgorithm algorithm = parseAlgorithm(kernel);
+        scheduler = std::make_unique<UpdateScheduler>(&lattice);
+        step = [&, algorithm]() { scheduler->step(algorithm); };
+    }
+
+    for (unsigned int s = 0; s < settings.init; s++)
+        step();
+    return {lattice.calcTotalEnergy(), lattice.calcMagnetization()};
+}
+
+void checkKernel(const std::string& kernel) {
+    for (const std::string& name : kernelNames)
+        if (name == kernel)
+            return;
+    throw std::runtime_error("Unknown kernel " + kernel + ", expected metropolis, sequential, wolff, swendsen-wang, mixed, nfold or strips");
+}
+
+
+int main(int argc, char** const argv) {
+    if (argc < 5) {
+        fprintf(stderr, "Usage: %s reference candidate L temp [options]\n", argv[0]);
+        fprintf(stderr, "The kernels are metropolis, sequential, wolff, swendsen-wang, mixed, nfold and strips, temp is 100x kT.\n");
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --dimensions=2        dimensions of the L^dimensions lattice\n");
+        fprintf(stderr, "  --seeds=1000          chains of every kernel\n");
+        fprintf(stderr, "  --seed=1              seed of the first chain, the chains use the streams that follow it\n");
+        fprintf(stderr, "  --init=1000           equilibration steps of every chain\n");
+        fprintf(stderr, "  --bins=10             bins of the chi-square tests\n");
+        fprintf(stderr, "  --alpha=0.01          probability of failing an equivalent kernel, over all the tests\n");
+        fprintf(stderr, "  --threads=0           threads running the chains, pinned to the cores (0 uses every core)\n");
+        fprintf(stderr, "  --strip-threads=2     threads of every chain of the strips kernel\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    std::string reference = argv[1];
+    std::string candidate = argv[2];
+    checkKernel(reference);
+    checkKernel(candidate);
+    Options options(argc, argv, 5);
+
+    EquivalenceSettings settings;
+    settings.L = atoi(argv[3]);
+    settings.temp = atoi(argv[4]);
+    settings.dimensions = options.getUInt("dimensions", 2);
+    settings.init = options.getUInt("init", 1000);
+    settings.stripThreads = options.getUInt("strip-threads", 2);
+    unsigned int seeds = options.getUInt("seeds", 1000);
+    unsigned int firstSeed = options.getUInt("seed", 1);
+    unsigned int bins = options.getUInt("bins", 10);
+    double alpha = options.getDouble("alpha", 0.01);
+    if (settings.L < 2 || settings.temp == 0 || seeds < 2)
+        throw std::runtime_error("Equivalence needs L >= 2, temp > 0 and seeds > 1");
+
+    // The reference and the candidate take alternate streams, so no two chains share their
+    // random numbers.
+    std::vector<ChainResult> referenceChains(seeds), candidateChains(seeds);
+    std::vector<PoolTask> tasks;
+    double cost = settings.init;
+    for (unsigned int k = 0; k < seeds; k++) {
+        tasks.push_back({cost, [&, k](unsigned int) {
+            referenceChains[k] = runChain(reference, settings, firstSeed + 2 * k);
+        }});
+        tasks.push_back({cost, [&, k](unsigned int) {
+            candidateChains[k] = runChain(candidate, settings, firstSeed + 2 * k + 1);
+        }});
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    WorkStealingPool pool(options.getUInt("threads", 0));
+    pool.run(std::move(tasks));
+    fprintf(stderr, "equivalence: %u chains of %s and of %s on %u threads in %.1f s\n", seeds, reference.c_str(),
+            candidate.c_str(), pool.getThreads(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    std::vector<std::pair<std::string, std::function<double(const ChainResult&)>>> observables = {
+        {"E", [](const ChainResult& c) { return c.energy; }},
+        {"m", [](const ChainResult& c) { return c.magnet; }},
+        {"|m|", [](const ChainResult& c) { return fabs(c.magnet); }},
+    };
+    std::vector<std::pair<std::string, TestResult>> results;
+    for (const auto& observable : observables) {
+        std::vector<double> a, b;
+        for (unsigned int k = 0; k < seeds; k++) {
+            a.push_back(observable.second(referenceChains[k]));
+            b.push_back(observable.second(candidateChains[k]));
+        }
+        results.push_back({observable.first, ksTest(a, b)});
+        results.push_back({observable.first, chiSquareTest(a, b, bins)});
+    }
+
+    double threshold = alpha / results.size();
+    double smallest = 1;
+    printf("observable,test,statistic,df,p,pass\n");
+    for (const auto& result : results) {
+        const TestResult& test = result.second;
+        printf("%s,%s,%f,%u,%g,%d\n", result.first.c_str(), test.test.c_str(), test.statistic, test.df, test.p, test.p >= threshold);
+        smallest = std::min(smallest, test.p);
+    }
+    bool passed = smallest >= threshold;
+    fprintf(stderr, "equivalence: %s %s %s, smallest p %g of %zu tests, alpha %g (%g per test)\n", candidate.c_str(),
+            passed ? "matches" : "does NOT match", reference.c_str(), smallest, results.size(), alpha, threshold);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+/* Exact.cpp
+Exact free energy, energy, specific heat and magnetization moments of Ising strips from
+their transfer matrix (see TransferMatrix.h), to check new engines against without waiting
+for long Metropolis runs.
+
+Usage: ./Exact width length Tmin Tmax points [options]
+length = 0 is the infinite strip. Temperatures are in kT units, 2.2 rather than the 220
+given to Metropolis. The default helical boundary is the lattice of Metropolis with
+xDim = width and yDim = length.
+*/
+#include <chrono>
+#include <cstdio>            // printf.
+#include <cstdlib>           // atoi, atof.
+#include "Options.h"
+#include "TransferMatrix.h"
+
+
+int main(int argc, char** const argv) {
+    if (argc < 6) {
+        fprintf(stderr, "Usage: %s width length Tmin Tmax points [options]\n", argv[0]);
+        fprintf(stderr, "  length = 0 solves the infinite strip\n");
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --boundary=helical    helical as in Metropolis, or torus\n");
+        fprintf(stderr, "  --threads=0           worker threads (0 uses every core)\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    unsigned int width = atoi(argv[1]);
+    unsigned int length = atoi(argv[2]);
+    double tempMin = atof(argv[3]);
+    double tempMax = atof(argv[4]);
+    unsigned int points = atoi(argv[5]);
+    Options options(argc, argv, 6);
+
+    StripBoundary boundary = parseBoundary(options.get("boundary", "helical"));
+    TransferMatrix matrix(width, boundary, options.getUInt("threads", 0));
+
+    // Same column names as Reweight where the observables are the same. chi is beta N <m^2>,
+    // Metropolis subtracts <|m|>^2 instead of <m>^2.
+    printf("T,f,avgE,c,m2,m4,chi,binder\n");
+    for (unsigned int i = 0; i < points; i++) {
+        double temp = (points > 1) ? tempMin + (tempMax - tempMin) * i / (points - 1) : tempMin;
+        auto begin = std::chrono::steady_clock::now();
+        ExactResult r = matrix.solve(temp, length);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+        printf("%f,%.12f,%.12f,%.12f,%.12g,%.12g,%.12g,%.12f\n", r.temp, r.freeEnergy, r.energy,
+            r.specificHeat, r.magnetSqrd, r.magnetQuart, r.susceptibility, r.binder);
+        if (length == 0)
+            fprintf(stderr, "exact: T=%f converged after %u rows in %.3f s\n", temp, matrix.getIterations(), seconds);
+        else
+            fprintf(stderr, "exact: T=%f in %.3f s\n", temp, seconds);
+    }
+    return 0;
+}
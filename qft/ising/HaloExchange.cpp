@@ -0,0 +1,79 @@
+/* HaloExchange.cpp
+Boundary slices and global sums shared by the processes of a decomposed lattice.
+*/
+#include "HaloExchange.h"
+#include <cerrno>
+#include <cstring>    // strerror.
+#include <stdexcept>  // runtime_error.
+#include <string>
+#include <fcntl.h>     // O_* constants.
+#include <sys/mman.h>  // shm_open, mmap.
+#include <unistd.h>    // ftruncate, getpid.
+
+
+HaloExchange::HaloExchange(unsigned int n, siteIndex slice)
+    : processes(n), sliceSize(slice), creator(getpid()) {
+    // The barrier first, then the doubles, then the slices, each one suitably aligned.
+    std::size_t valuesOffset = (sizeof(pthread_barrier_t) + 63) / 64 * 64;
+    std::size_t slicesOffset = valuesOffset + processes * maxValues * sizeof(double);
+    bytes = slicesOffset + 2 * processes * sliceSize;
+
+    std::string name = "/qft-ising-halo-" + std::to_string(creator);
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0)
+        throw std::runtime_error("Failed to create shared memory " + name + ": " + std::strerror(errno));
+    shm_unlink(name.c_str());
+    if (ftruncate(fd, bytes) != 0) {
+        close(fd);
+        throw std::runtime_error("Failed to resize shared memory " + name + ": " + std::strerror(errno));
+    }
+    segment = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (segment == MAP_FAILED)
+        throw std::runtime_error("Failed to map shared memory " + name + ": " + std::strerror(errno));
+
+    char* base = static_cast<char*>(segment);
+    barrier = reinterpret_cast<pthread_barrier_t*>(base);
+    values = reinterpret_cast<double*>(base + valuesOffset);
+    slices = reinterpret_cast<std::int8_t*>(base + slicesOffset);
+
+    pthread_barrierattr_t attributes;
+    pthread_barrierattr_init(&attributes);
+    pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_barrier_init(barrier, &attributes, processes);
+    pthread_barrierattr_destroy(&attributes);
+}
+
+HaloExchange::~HaloExchange() {
+    if (getpid() == creator)
+        pthread_barrier_destroy(barrier);
+    munmap(segment, bytes);
+}
+
+std::int8_t* HaloExchange::first(unsigned int rank) {
+    return slices + (2 * rank) * sliceSize;
+}
+
+std::int8_t* HaloExchange::last(unsigned int rank) {
+    return slices + (2 * rank + 1) * sliceSize;
+}
+
+void HaloExchange::wait() {
+    pthread_barrier_wait(barrier);
+}
+
+void HaloExchange::sum(unsigned int rank, double* v, unsigned int count) {
+    if (count > maxValues)
+        throw std::runtime_error("HaloExchange can only sum " + std::to_string(maxValues) + " values at a time");
+
+    for (unsigned int k = 0; k < count; k++)
+        values[rank * maxValues + k] = v[k];
+    wait();
+    for (unsigned int k = 0; k < count; k++) {
+        v[k] = 0.0;
+        for (unsigned int p = 0; p < processes; p++)
+            v[k] += values[p * maxValues + k];
+    }
+    // Nobody overwrites their values before everyone has read them.
+    wait();
+}
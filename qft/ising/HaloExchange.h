@@ -0,0 +1,54 @@
+/* HaloExchange.h
+Boundary slices and global sums shared by the processes of a decomposed lattice.
+
+The exchange lives in a POSIX shared memory segment which is created and mapped
+before the processes are forked, so that all of them inherit the mapping. Its
+name is unlinked right away, nothing is left behind if a process dies. The
+segment holds a process-shared barrier, the first and the last slice of every
+subdomain, and a few doubles per process for the sums of the observables.
+*/
+#ifndef _HALO_EXCHANGE_H
+#define _HALO_EXCHANGE_H
+
+#include "SiteStorage.h"  // siteIndex.
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <sys/types.h>    // pid_t.
+
+
+class HaloExchange {
+    public:
+    static const unsigned int maxValues = 4;  // Doubles per process in a sum.
+
+    HaloExchange(unsigned int processes, siteIndex sliceSize);
+    ~HaloExchange();
+
+    HaloExchange(const HaloExchange&) = delete;
+    HaloExchange& operator=(const HaloExchange&) = delete;
+
+    // The published first and last slice of subdomain rank.
+    std::int8_t* first(unsigned int rank);
+    std::int8_t* last(unsigned int rank);
+
+    // wait returns once every process has called it.
+    void wait();
+
+    // sum replaces values by their sums over all processes, every process gets the totals.
+    void sum(unsigned int rank, double* values, unsigned int count);
+
+    unsigned int getProcesses() const { return processes; }
+
+    private:
+    unsigned int processes;
+    siteIndex sliceSize;
+    std::size_t bytes;
+    void* segment;
+    pid_t creator;  // Only the process that created the barrier destroys it.
+
+    pthread_barrier_t* barrier;
+    double* values;
+    std::int8_t* slices;
+};
+
+#endif // _HALO_EXCHANGE_H
@@ -22,37 +22,34 @@ running time decreased by around 20%.
 */
 #include "HashTable.h"
 #include <vector>
-#include <cstddef>  // NULL.
 
-HashTable::HashTable(unsigned int tableNumber) {
-    size = 0;
-    std::vector<node*>* temp = new std::vector<node*>(tableNumber, NULL);
-    table = *temp;
-    mod = tableNumber - 1;
-}
+// The number of lists must be a power of two since the hash is masked with mod.
+HashTable::HashTable(unsigned int tableNum)
+    : size(0), tableNumber(tableNum), mod(tableNum - 1), table(tableNum, nullptr) {}
 
-HashTable::HashTable() {
-    HashTable(4093);
-}
+// Note: this used to call the other constructor on a temporary, leaving the table empty.
+HashTable::HashTable() : HashTable(4096) {}
 
-HashTable::~HashTable() {}
+HashTable::~HashTable() {
+    clear();
+}
 
-void HashTable::insert(unsigned int site) {
+void HashTable::insert(siteIndex site) {
     size++;
 
     node* toAdd = new node;
     toAdd->value = site;
 
-    unsigned int index = (17 * site - 97) & mod;
+    siteIndex index = (17 * site - 97) & mod;
     toAdd->next = table[index];
     table[index] = toAdd;
 }
 
-bool HashTable::find(unsigned int site) {
-    unsigned int index = (17 * site - 97) & mod;
+bool HashTable::find(siteIndex site) {
+    siteIndex index = (17 * site - 97) & mod;
     node* temp = table[index];
 
-    while (temp != NULL) {
+    while (temp != nullptr) {
         if (site == temp->value) {
             return true;
         }
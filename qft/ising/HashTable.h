@@ -5,14 +5,15 @@ This is based on https://inspirehep.net/literature/1386200 ,
 Lattice Simulations of Nonperturbative Quantum Field Theories
 by David Schaich
 */
-#ifndef _HASHTABLE_H
-#define _HASHTABLE_H
+#ifndef _HASH_TABLE_H
+#define _HASH_TABLE_H
 
 #include <vector>
+#include "SiteStorage.h"  // siteIndex.
 
 // The original aim of this struct was to avoid the overhead of a class.
 struct node {
-    unsigned int value;
+    siteIndex value;
     node* next;
 };
 
@@ -23,12 +24,12 @@ class HashTable {
         ~HashTable();
 
         // Member functions.
-        void insert(unsigned int site);
-        bool find(unsigned int site);
+        void insert(siteIndex site);
+        bool find(siteIndex site);
         void clear();
 
         // Member data.
-        unsigned int size;
+        siteIndex size;
         unsigned int tableNumber;
         unsigned int mod;
         std::vector<node*> table;
@@ -36,4 +37,4 @@ class HashTable {
 };
 
 
-#endif //_HASHTABLE_H
\ No newline at end of file
+#endif //_HASH_TABLE_H
\ No newline at end of file
@@ -0,0 +1,71 @@
+/* HypothesisTests.cpp
+Two-sample Kolmogorov-Smirnov and chi-square tests.
+*/
+#include "HypothesisTests.h"
+#include <algorithm>   // sort, upper_bound, max.
+#include <cmath>       // sqrt, fabs.
+#include <stdexcept>   // For std::runtime_error
+
+// Cephes, built from cython/cephes.
+extern "C" {
+double kolmogorov(double y);
+double chdtrc(double df, double x);
+}
+
+
+TestResult ksTest(std::vector<double> a, std::vector<double> b) {
+    if (a.empty() || b.empty())
+        throw std::runtime_error("The Kolmogorov-Smirnov test needs two non-empty samples");
+    std::sort(a.begin(), a.end());
+    std::sort(b.begin(), b.end());
+
+    // Both distribution functions step over the values equal to x at once, so ties don't
+    // count as distance.
+    double n1 = a.size(), n2 = b.size();
+    std::size_t i = 0, j = 0;
+    double d = 0;
+    while (i < a.size() && j < b.size()) {
+        double x = std::min(a[i], b[j]);
+        while (i < a.size() && a[i] <= x)
+            i++;
+        while (j < b.size() && b[j] <= x)
+            j++;
+        d = std::max(d, std::fabs(i / n1 - j / n2));
+    }
+
+    double n = std::sqrt(n1 * n2 / (n1 + n2));
+    return {"ks", d, 0, std::min(1.0, kolmogorov((n + 0.12 + 0.11 / n) * d))};
+}
+
+TestResult chiSquareTest(const std::vector<double>& a, const std::vector<double>& b, unsigned int bins) {
+    if (a.empty() || a.size() != b.size())
+        throw std::runtime_error("The chi-square test needs two non-empty samples of the same size");
+
+    std::vector<double> pooled(a);
+    pooled.insert(pooled.end(), b.begin(), b.end());
+    std::sort(pooled.begin(), pooled.end());
+    std::vector<double> edges;
+    for (unsigned int k = 1; k < bins; k++) {
+        double edge = pooled[pooled.size() * k / bins];
+        if (edges.empty() || edge > edges.back())
+            edges.push_back(edge);
+    }
+
+    std::vector<double> countA(edges.size() + 1, 0), countB(edges.size() + 1, 0);
+    for (double x : a)
+        countA[std::upper_bound(edges.begin(), edges.end(), x) - edges.begin()]++;
+    for (double x : b)
+        countB[std::upper_bound(edges.begin(), edges.end(), x) - edges.begin()]++;
+
+    double chi2 = 0;
+    unsigned int used = 0;
+    for (std::size_t k = 0; k < countA.size(); k++) {
+        if (countA[k] + countB[k] == 0)
+            continue;
+        chi2 += (countA[k] - countB[k]) * (countA[k] - countB[k]) / (countA[k] + countB[k]);
+        used++;
+    }
+    if (used < 2)
+        return {"chi2", 0, 0, 1};
+    return {"chi2", chi2, used - 1, chdtrc(used - 1, chi2)};
+}
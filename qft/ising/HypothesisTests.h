@@ -0,0 +1,32 @@
+/* HypothesisTests.h
+Two-sample tests of whether two sets of independent measurements come from the same
+distribution, the way Equivalence checks a new update kernel against the reference one.
+
+    ks          Kolmogorov-Smirnov: the largest distance D between the two empirical
+                distribution functions. The p-value is Kolmogorov's limiting distribution
+                at (sqrt(n) + 0.12 + 0.11 / sqrt(n)) D, n = n1 n2 / (n1 + n2), as in
+                Numerical Recipes. It is conservative for discrete values such as the energy.
+    chi2        chi-square on bins holding about the same share of the pooled values, bins
+                with tied edges merged, with the p-value of bins - 1 degrees of freedom.
+                Both samples must have the same size.
+
+The p-values come from kolmogorov and chdtrc of Cephes (cython/cephes).
+*/
+#ifndef _HYPOTHESIS_TESTS_H
+#define _HYPOTHESIS_TESTS_H
+
+#include <string>
+#include <vector>
+
+
+struct TestResult {
+    std::string test;
+    double statistic;
+    unsigned int df;   // Degrees of freedom of chi2, 0 for ks.
+    double p;
+};
+
+TestResult ksTest(std::vector<double> a, std::vector<double> b);
+TestResult chiSquareTest(const std::vector<double>& a, const std::vector<double>& b, unsigned int bins);
+
+#endif // _HYPOTHESIS_TESTS_H
@@ -6,34 +6,59 @@ Lattice Simulations of Nonperturbative Quantum Field Theories
 by David Schaich
 */
 #include "Lattice.h"
+#include "WolffEstimators.h"
 #include <cstdio>    // For fflush and stdout.
 #include <stdexcept> // For std::runtime_error
 #include <string>    // For std::to_string()
 #include <fstream>
 #include <iostream>
 #include <filesystem>
+#include <algorithm>  // max, min.
+
+
+Lattice::Lattice(unsigned int x, unsigned int y, unsigned int RNSeed)
+    : Lattice(std::vector<unsigned int>{x, y}, RNSeed) {}
+
+// The sites are stored with x running fastest, then y, then z and t. With helical boundary
+// conditions the neighbours along dimension d are simply site +- strides[d] modulo the size,
+// and strides[d] is the product of the sizes of the dimensions before d.
+Lattice::Lattice(const std::vector<unsigned int>& sizes, unsigned int RNSeed, const std::filesystem::path& spinFile) {
+    if (sizes.size() < 2 || sizes.size() > maxDimensions)
+        throw std::runtime_error("Lattices must have between 2 and " + std::to_string(maxDimensions) + " dimensions");
+
+    dimensions = sizes.size();
+    dims = sizes;
+    strides.resize(dimensions);
+    latticeSize = 1;
+    for (unsigned int d = 0; d < dimensions; d++) {
+        strides[d] = latticeSize;
+        latticeSize *= dims[d];
+    }
 
-
-Lattice::Lattice(unsigned int x, unsigned int y, unsigned int RNSeed) {
-    cluster = new HashTable();
+    // Around a quarter of the lattice size of lists keeps them short (see HashTable.cpp).
+    // The lists cost more than the spins, so there are at most 2^22 of them on huge lattices.
+    unsigned int tableNumber = 1;
+    while (tableNumber < latticeSize / 4 && tableNumber < (1u << 22))
+        tableNumber *= 2;
+    cluster = new HashTable(tableNumber);
     generator = gsl_rng_alloc(gsl_rng_mt19937);  // Mersenne twister.
     gsl_rng_set(generator, RNSeed);
 
     temp = (float)RNSeed / 100;
     beta = 1.0 / temp;
-    xDim = x;
-    yDim = y;
-    latticeSize = x * y;
+    xDim = dims[0];
+    yDim = dims[1];
 
     // Note: the instantiation of the lattice vector was missing from the code in the thesis.
     // We added it.
-    lattice = std::vector<int>(latticeSize, 1);
+    // The spins are a byte each, in anonymous pages or in the pages of spinFile.
+    lattice = MappedArray<std::int8_t>(latticeSize, 1, spinFile);
 
     // Give everyone a random initial state.
     // Note: since we modified the way the lattice vector is instantiated,
     // we only need to flip spins from the default value of 1.
     // This is also different from the code in the thesis.
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (gsl_rng_uniform(generator) < 0.5) {
             lattice[i] = -1;
         }
@@ -77,9 +102,12 @@ Lattice::Lattice(unsigned int x, unsigned int y, unsigned int RNSeed) {
     -\beta \Delta E = beta 8J
 
     So the change in energy is either 4J or 8J.
+
+    In D dimensions a site has 2D neighbours and the positive changes are 4J, 8J, ..., 4DJ.
     */
-    exponentials[0] = gsl_sf_exp(-beta * 4);
-    exponentials[1] = gsl_sf_exp(-beta * 8);
+    exponentials.resize(dimensions);
+    for (unsigned int k = 0; k < dimensions; k++)
+        exponentials[k] = gsl_sf_exp(-beta * 4 * (k + 1));
 
     randomU = gsl_rng_uniform(generator);
     probability = 1 - gsl_sf_exp(-2 * beta);
@@ -87,14 +115,29 @@ Lattice::Lattice(unsigned int x, unsigned int y, unsigned int RNSeed) {
     totalEnergy = calcTotalEnergy();
 }
 
-Lattice::Lattice() {
-    Lattice(32, 32, 227);
+// Note: this used to call the other constructor on a temporary, leaving this one uninitialized.
+Lattice::Lattice() : Lattice(32, 32, 227) {}
+
+Lattice::~Lattice() {
+    delete cluster;
+    gsl_rng_free(generator);
 }
 
-Lattice::~Lattice() {}
+// The draw is the same as floor(latticeSize * u) as long as 32 bits of randomness address
+// every site, larger lattices combine two 32 bit draws of the Mersenne twister.
+siteIndex Lattice::getRandomSite() {
+    return getRandomIndex(latticeSize);
+}
+
+siteIndex Lattice::getRandomIndex(siteIndex n) {
+    if (n <= (siteIndex(1) << 32))
+        return (siteIndex)(n * gsl_rng_uniform(generator));
+    siteIndex high = gsl_rng_get(generator);
+    return ((high << 32) | gsl_rng_get(generator)) % n;
+}
 
 void Lattice::printLattice() {
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (i % xDim == 0)
             printf("\n");
 
@@ -116,7 +159,7 @@ void Lattice::saveLatticeToFile(const std::filesystem::path& dirPath, const std:
         throw std::runtime_error("Failed to open file for writing: " + fullPath.string());
     }
 
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (i % xDim == 0)
             file << "\n";
 
@@ -132,7 +175,7 @@ void Lattice::saveLatticeToFile(const std::filesystem::path& dirPath, const std:
 }
 
 void Lattice::printCluster() {
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (i % xDim == 0)
             printf("\n");
 
@@ -179,80 +222,112 @@ void Lattice::printCluster() {
 
 Remember that the 2D lattice is linearized and is thus represented as a 1D lattice.
 So the above is just {1, 2, 3, 4, 5, 6, 7, 8, 9}.
+
+In 3D and 4D the same holds for every dimension: the neighbours along z are n \pm x*y,
+and along t n \pm x*y*z, modulo the size of the lattice.
 */
-void Lattice::getHalfNeighbours(unsigned int site) {
-    if (site < latticeSize - xDim) {
-        // If not in the last row...
-        // Then the next X is +1 to the right, and the next Y is a full xDim below.
-        nextX = site + 1;
-        nextY = site + xDim;
-    } else if (site < latticeSize - 1) {
-        // If site is in the last row but not on the last site...
-        // Then next X is still +1 to the rightn, but next Y is at the first row.
-        nextX = site + 1;
-        nextY = site + xDim - latticeSize;
-    } else {  // site = latticeSize - 1
-        // If site is in the last row in the last element, then wrap around.
-        // Then next X is the begining, and next Y is a row right below the begining.
-        nextX = 0;
-        nextY = xDim;
+void Lattice::getHalfNeighbours(siteIndex site) {
+    for (unsigned int d = 0; d < dimensions; d++) {
+        // If the site is within a stride of the end of the array, wrap around to the begining.
+        siteIndex next = site + strides[d];
+        nextSite[d] = (next >= latticeSize) ? next - latticeSize : next;
     }
 }
 
-// getNeighbours relies on getHalfneighbours to figure out the next X and Y positions
+// getNeighbours relies on getHalfneighbours to figure out the next positions
 // using helical boundary conditions. This function then just focuses on the previous
-// X and Y positions.
+// positions.
 // Note: also note that this snippet reveals a bug in the Ising model code snippet,
 // as the first if statement for determining prevX and prevY should have the conditional
 // (site >= xDim), instead of (site > xDim).
-void Lattice::getNeighbours(unsigned int site) {
+void Lattice::getNeighbours(siteIndex site) {
     getHalfNeighbours(site);
 
-    if (site >= xDim) {  // If site is below the 1st row...
-        // Then the prev X is just 1 to the left, and xDim to the top.
-        prevX = site - 1;
-        prevY = site - xDim;
-    } else if (site > 0) {  // If site is not the first element but it is in the first row...
-        // Then previous X is to the left and prev Y is in the last row,
-        // wrapping around to the end of the array.
-        prevX = site - 1;
-        prevY = site + latticeSize - xDim;
-    } else {  // site = 0
-        // Since the site is the first element, then prev X is the last element of the array.
-        // And prev Y is xDim above the last element of the array.
-        prevX = latticeSize - 1;
-        prevY = latticeSize - xDim;
-    }
+    for (unsigned int d = 0; d < dimensions; d++)
+        prevSite[d] = (site >= strides[d]) ? site - strides[d] : site + latticeSize - strides[d];
 }
 
 // calcHalfenergy only counts half the interactions in the model because its used by calcTotalenergy
 // so we do half to avoid double counting interactions.
-int Lattice::calcHalfenergy(unsigned int site) {
+int Lattice::calcHalfenergy(siteIndex site) {
     getHalfNeighbours(site);
 
-    return -lattice[site] * (lattice[nextX] + lattice[nextY]);
+    int sum = 0;
+    for (unsigned int d = 0; d < dimensions; d++)
+        sum += lattice[nextSite[d]];
+    return -lattice[site] * sum;
+}
+
+// neighbourSum adds up the neighbours of site without going through nextSite and prevSite.
+int Lattice::neighbourSum(siteIndex site) const {
+    int sum = 0;
+    for (unsigned int d = 0; d < dimensions; d++) {
+        siteIndex next = site + strides[d];
+        sum += lattice[(next >= latticeSize) ? next - latticeSize : next];
+        sum += lattice[(site >= strides[d]) ? site - strides[d] : site + latticeSize - strides[d]];
+    }
+    return sum;
 }
 
-int Lattice::calcEnergy(unsigned int site) {
+int Lattice::calcEnergy(siteIndex site) {
     getNeighbours(site);
 
-    return -lattice[site] * (lattice[nextX] + lattice[nextY] + lattice[prevX] + lattice[prevY]);
+    int sum = 0;
+    for (unsigned int d = 0; d < dimensions; d++)
+        sum += lattice[nextSite[d]] + lattice[prevSite[d]];
+    return -lattice[site] * sum;
 }
 
 double Lattice::calcTotalEnergy() {
     totalEnergy = 0;
-    for (unsigned int i = 0; i < latticeSize; i++)
+    for (siteIndex i = 0; i < latticeSize; i++)
         totalEnergy += calcHalfenergy(i);
     return totalEnergy / latticeSize;
 }
 
 double Lattice::calcMagnetization() {
-    int magnet = 0;
-    for (unsigned int i = 0; i < latticeSize; i++)
+    long long magnet = 0;
+    for (siteIndex i = 0; i < latticeSize; i++)
         magnet += lattice[i];
     return (double)magnet / latticeSize;
 }
 
+// The half energies are summed as in calcTotalEnergy, so both give the same result.
+double Lattice::calcTotalEnergy(const std::int8_t* spins) const {
+    double energy = 0;
+    for (siteIndex i = 0; i < latticeSize; i++) {
+        int sum = 0;
+        for (unsigned int d = 0; d < dimensions; d++) {
+            siteIndex next = i + strides[d];
+            sum += spins[(next >= latticeSize) ? next - latticeSize : next];
+        }
+        energy += -spins[i] * sum;
+    }
+    return energy / latticeSize;
+}
+
+double Lattice::calcMagnetization(const std::int8_t* spins) const {
+    long long magnet = 0;
+    for (siteIndex i = 0; i < latticeSize; i++)
+        magnet += spins[i];
+    return (double)magnet / latticeSize;
+}
+
+void Lattice::packSpins(std::uint64_t* words) const {
+    for (siteIndex w = 0; w * 64 < latticeSize; w++) {
+        std::uint64_t bits = 0;
+        siteIndex end = std::min<siteIndex>(64, latticeSize - w * 64);
+        for (siteIndex b = 0; b < end; b++)
+            bits |= (std::uint64_t)(lattice[w * 64 + b] > 0) << b;
+        words[w] = bits;
+    }
+}
+
+void Lattice::unpackSpins(const std::uint64_t* words, siteIndex count, std::int8_t* spins) {
+    for (siteIndex i = 0; i < count; i++)
+        spins[i] = ((words[i / 64] >> (i % 64)) & 1) ? 1 : -1;
+}
+
 // calcSpecificHeat takes as input the average and the squared energies per spin.
 double Lattice::calcSpecificHeat(double avgEnergy, double sqrdEnergy) {
     double diff = sqrdEnergy - (avgEnergy * avgEnergy);
@@ -265,8 +340,8 @@ double Lattice::calcSusceptibility(double avgMagnet, double sqrdMagnet) {
     return beta * diff * latticeSize;
 }
 
-unsigned int Lattice::flipped(unsigned int site) {
-    unsigned int spin = lattice[site];
+int Lattice::flipped(siteIndex site) {
+    int spin = lattice[site];
     // A spin should never be anything other than +1 or -1.
     if (spin != 1 && spin != -1) {
         throw std::runtime_error("Lattice integrity violation at index " + std::to_string(site) + ", the spin was: " + std::to_string(spin));
@@ -299,7 +374,13 @@ The 2 states that result in a the system's energy increasing are:
 Note that the initial energy is negative for these 2 states - the energies for the states that
 are always accepted is 0J -> 0J, 2J -> -2J, and 4J -> -4J.
 */
-bool Lattice::metropolis(unsigned int site) {
+bool Lattice::metropolis(siteIndex site) {
+    return metropolis(site, generator);
+}
+
+// This one only reads the lattice and writes the spin at site, so threads with generators of
+// their own can update sites that aren't neighbours at the same time.
+bool Lattice::metropolis(siteIndex site, gsl_rng* rng) {
     // Performance obten makes us skip steps, but something that can prevent a million erroneous
     // runs is a great time-saving investment.
     if (lattice[site] != 1 && lattice[site] != -1) {
@@ -307,13 +388,13 @@ bool Lattice::metropolis(unsigned int site) {
     }
 
 
-    // This result of calcEnergy is only the initial energy. Reemember that we can tell from the
-    // initial/current energy of the state whether the transition will be accepted or whether it will
+    // The energy of the site, calcEnergy(site) = -spin * neighbourSum(site), is only the initial
+    // energy. Reemember that we can tell from the initial/current energy of the state whether the transition will be accepted or whether it will
     // be probabilistically accepted: only the initial states with energy -4J and -2J require us to compute
     // their Boltzmann factors for a probabilistic acceptance.
     // Hence, we are converting the computed current energy to obtain the "final" energy.
     // That way we can use a slightly easier to read logic...
-    int finalE = -calcEnergy(site);
+    int finalE = lattice[site] * neighbourSum(site);
 
     // The three possible transition where we go from a state of higher energy to a lower one
     // correspond to states where the final energy is 0J, -2J, or -4J.
@@ -324,11 +405,10 @@ bool Lattice::metropolis(unsigned int site) {
     }
 
     // Since it isn't a lower energy state, let's accept the flip based on the Boltzman factor.
-    randomU = gsl_rng_uniform(generator);
-    // The value at 0 is the Boltzmann factor -4beta, the next one is -8beta.
+    // The value at 0 is the Boltzmann factor -4beta, the next one is -8beta, up to -4D beta.
+    // Note: this used to be stored in probability, which the cluster updates rely on.
     int exp_index = (int)(finalE/2) - 1;
-    probability = exponentials[exp_index];
-    if (randomU < probability) {
+    if (gsl_rng_uniform(rng) < exponentials[exp_index]) {
         lattice[site] = flipped(site);
         return true;
     }
@@ -336,41 +416,30 @@ bool Lattice::metropolis(unsigned int site) {
 }
 
 // growCluster is a method used by Wolff.
-void Lattice::growCluster(unsigned int site, int spin) {
-    getNeighbours(site);
-
-    unsigned int curNextX = nextX;
-    unsigned int curNextY = nextY;
-    unsigned int curPrevX = prevX;
-    unsigned int curPrevY = prevY;
-
-    // TODO: the way the probability variable is iffy and should be fixed.
-    if (lattice[curPrevX] == spin && !cluster->find(curPrevX)) {
-        randomU = gsl_rng_uniform(generator);
-        if (randomU < probability) {
-            cluster->insert(curPrevX);
-            growCluster(curPrevX, spin);
-        }
-    }
-    if (lattice[curNextX] == spin && !cluster->find(curNextX)) {
-        randomU = gsl_rng_uniform(generator);
-        if (randomU < probability) {
-            cluster->insert(curNextX);
-            growCluster(curNextX, spin);
-        }
-    }
-    if (lattice[curPrevY] == spin && !cluster->find(curPrevY)) {
-        randomU = gsl_rng_uniform(generator);
-        if (randomU < probability) {
-            cluster->insert(curPrevY);
-            growCluster(curPrevY, spin);
+// growCluster adds the aligned neighbours of the cluster with probability 1 - exp(-2 beta).
+// Note: the thesis grows the cluster recursively, which overflows the stack near the critical
+// temperature on large lattices, so we keep the sites still to be visited on a stack instead.
+void Lattice::growCluster(siteIndex site, int spin) {
+    std::vector<siteIndex> toVisit(1, site);
+
+    while (!toVisit.empty()) {
+        getNeighbours(toVisit.back());
+        toVisit.pop_back();
+
+        siteIndex neighbours[2 * maxDimensions];
+        for (unsigned int d = 0; d < dimensions; d++) {
+            neighbours[2 * d] = prevSite[d];
+            neighbours[2 * d + 1] = nextSite[d];
         }
-    }
-    if (lattice[curNextY] == spin && !cluster->find(curNextY)) {
-        randomU = gsl_rng_uniform(generator);
-        if (randomU < probability) {
-            cluster->insert(curNextY);
-            growCluster(curNextY, spin);
+        for (unsigned int k = 0; k < 2 * dimensions; k++) {
+            siteIndex neighbour = neighbours[k];
+            if (lattice[neighbour] == spin && !cluster->find(neighbour)) {
+                randomU = gsl_rng_uniform(generator);
+                if (randomU < probability) {
+                    cluster->insert(neighbour);
+                    toVisit.push_back(neighbour);
+                }
+            }
         }
     }
 }
@@ -379,35 +448,86 @@ void Lattice::flipCluster() {
     // Note: we rewrote this code. The original listing had a non-existent type Node.
     // And it also mentioned bits like `cluster->table[i]->head`, where head was never implemented
     // in the code sample for the HashTable.
-    for (unsigned int i = 0; i < 97; i++) {
-        if (cluster->table.size() != 0) {
-            node* temp = cluster->table[i];
-            for (unsigned int j = 0; j < cluster->table.size(); j++) {
-                lattice[temp->value] *= -1;
-                temp = temp->next;
-            }
-        }
+    for (node* head : cluster->table) {
+        for (node* n = head; n != nullptr; n = n->next)
+            lattice[n->value] *= -1;
     }
 }
 
 void Lattice::flipComplement() {
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (!cluster->find(i))
             lattice[i] *= -1;
     }
 }
 
+// measureCluster hands the sites of the wolff cluster to the improved estimators.
+void Lattice::measureCluster() {
+    std::vector<siteIndex> members;
+    members.reserve(cluster->size);
+    for (node* head : cluster->table) {
+        for (node* n = head; n != nullptr; n = n->next)
+            members.push_back(n->value);
+    }
+    estimators->add(members, [this](siteIndex site) { return cluster->find(site); },
+                    [](siteIndex) { return 1.0; });
+}
+
 // wolff returns the size of the cluster.
-unsigned int Lattice::wolff(unsigned int site) {
+siteIndex Lattice::wolff(siteIndex site) {
     cluster->insert(site);
     growCluster(site, lattice[site]);
+    if (estimators)
+        measureCluster();
 
     if (cluster->size >= latticeSize/2)
         flipComplement();
     else
         flipCluster();
 
-    unsigned int clusterSize = cluster->size;
+    siteIndex clusterSize = cluster->size;
     cluster->clear();
     return clusterSize;
-}
\ No newline at end of file
+}
+siteIndex Lattice::findRoot(siteIndex site) {
+    while (parent[site] != site) {
+        parent[site] = parent[parent[site]];  // Path halving.
+        site = parent[site];
+    }
+    return site;
+}
+
+// swendsenWang puts a bond between every pair of aligned neighbours with probability
+// 1 - exp(-2 beta), then flips every connected cluster with probability 1/2.
+// It returns the number of clusters.
+unsigned int Lattice::swendsenWang() {
+    parent.resize(latticeSize);
+    for (siteIndex i = 0; i < latticeSize; i++)
+        parent[i] = i;
+
+    for (siteIndex i = 0; i < latticeSize; i++) {
+        getHalfNeighbours(i);
+        for (unsigned int d = 0; d < dimensions; d++) {
+            siteIndex neighbour = nextSite[d];
+            if (lattice[neighbour] == lattice[i] && gsl_rng_uniform(generator) < probability) {
+                siteIndex a = findRoot(i);
+                siteIndex b = findRoot(neighbour);
+                if (a != b)
+                    parent[std::max(a, b)] = std::min(a, b);
+            }
+        }
+    }
+
+    // Roots come before the rest of their cluster, so one pass decides every cluster.
+    std::vector<signed char> flip(latticeSize, 0);
+    unsigned int clusters = 0;
+    for (siteIndex i = 0; i < latticeSize; i++) {
+        siteIndex root = findRoot(i);
+        if (root == i) {
+            flip[i] = (gsl_rng_uniform(generator) < 0.5) ? -1 : 1;
+            clusters++;
+        }
+        lattice[i] *= flip[root];
+    }
+    return clusters;
+}
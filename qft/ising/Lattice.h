@@ -9,19 +9,28 @@ by David Schaich
 #define _LATTICE_H
 
 #include "HashTable.h"
+#include "SiteStorage.h"
+#include <cstdint>
 #include <vector>
 #include <filesystem>        // filesystem::path.
 #include <gsl/gsl_rng.h>     // Random number generators.
 #include <gsl/gsl_sf_exp.h>  // Exponential functions.
 
+class WolffEstimators;
+
 
 class Lattice {
     public:
+    static const unsigned int maxDimensions = 4;
+
     // Data.
-    std::vector<int> lattice;  // Values must be 1, -1.
+    MappedArray<std::int8_t> lattice;  // Values must be 1, -1.
     unsigned int xDim;         // x dimension of the lattice.
     unsigned int yDim;         // y dimension of the lattice.
-    unsigned int latticeSize;  // Number of sites in the lattice
+    siteIndex latticeSize;     // Number of sites in the lattice
+    unsigned int dimensions;   // 2, 3 or 4.
+    std::vector<unsigned int> dims;     // Size of every dimension, x first.
+    std::vector<siteIndex> strides;     // Distance between neighbours along every dimension.
 
     float temp;          // kT in energy units (k=1).
     float beta;          // 1/kT in energy units (k=1).
@@ -29,21 +38,22 @@ class Lattice {
     double probability;  // Probability of flipping or adding to a cluster.
                          // SHOULD NOT change for wolff.
     
-    double exponentials[2];
+    std::vector<double> exponentials;  // exp(-4 beta k) for k = 1, ..., dimensions.
     double totalEnergy;
 
-    // Neighboring lattice sites.
-    unsigned int nextX;
-    unsigned int prevX;
-    unsigned int nextY;
-    unsigned int prevY;
+    // Neighboring lattice sites along every dimension, [0] is x and [1] is y.
+    siteIndex nextSite[maxDimensions];
+    siteIndex prevSite[maxDimensions];
 
     HashTable* cluster;
     gsl_rng* generator;
+    WolffEstimators* estimators = nullptr;  // Measures every wolff cluster when set.
 
     
     // Methods.
     Lattice(unsigned int x, unsigned int y, unsigned int RNSeed);
+    // The spins are kept in spinFile if one is given, which lets the lattice outgrow the memory.
+    Lattice(const std::vector<unsigned int>& dims, unsigned int RNSeed, const std::filesystem::path& spinFile = {});
     Lattice();
     ~Lattice();
 
@@ -51,26 +61,45 @@ class Lattice {
     void saveLatticeToFile(const std::filesystem::path& dirPath, const std::string& filename);
     void printCluster();
 
+    // Uniformly distributed, also on lattices with more than 2^32 sites.
+    siteIndex getRandomSite();
+    // Uniform in [0, n) the same way, for the site lists of the updates.
+    siteIndex getRandomIndex(siteIndex n);
+
     // Periodicboundary conditions.
-    void getHalfNeighbours(unsigned int site);
-    void getNeighbours(unsigned int site);
+    void getHalfNeighbours(siteIndex site);
+    void getNeighbours(siteIndex site);
 
-    int calcHalfenergy(unsigned int site);
-    int calcEnergy(unsigned int site);
+    int calcHalfenergy(siteIndex site);
+    int calcEnergy(siteIndex site);
+    int neighbourSum(siteIndex site) const;
     double calcTotalEnergy();
     double calcMagnetization();
+    // The same per spin, of a copy of the spins (see packSpins), without touching the lattice.
+    double calcTotalEnergy(const std::int8_t* spins) const;
+    double calcMagnetization(const std::int8_t* spins) const;
     double calcSpecificHeat(double avgEnergy, double squared);
     double calcSusceptibility(double avgMagnet, double sqrdMagnet);
 
-    bool metropolis(unsigned int site);  // Returns whether or not the site flipped.
-    void growCluster(unsigned int site, int spin);
+    // packSpins copies the spins one bit per spin, 1 for up, into (latticeSize + 63) / 64 words.
+    void packSpins(std::uint64_t* words) const;
+    static void unpackSpins(const std::uint64_t* words, siteIndex count, std::int8_t* spins);
+
+    bool metropolis(siteIndex site);  // Returns whether or not the site flipped.
+    bool metropolis(siteIndex site, gsl_rng* rng);  // Thread safe, draws from rng.
+    void growCluster(siteIndex site, int spin);
     void flipCluster();
     void flipComplement();
-    unsigned int wolff(unsigned int site);
+    siteIndex wolff(siteIndex site);
+    unsigned int swendsenWang();  // Returns the number of clusters.
 
     private:
     // Making this to avoid bugs where we confuse a '*' for a '+' or any other sort of operator.
-    unsigned int flipped(unsigned int site);
+    int flipped(siteIndex site);
+    void measureCluster();
+
+    std::vector<siteIndex> parent;  // Union-find forest of the Swendsen-Wang clusters.
+    siteIndex findRoot(siteIndex site);
 };
 
 #endif // _LATTICE_H
\ No newline at end of file
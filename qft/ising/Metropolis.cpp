@@ -6,17 +6,39 @@ This is based on https://inspirehep.net/literature/1386200 ,
 Lattice Simulations of Nonperturbative Quantum Field Theories
 by David Schaich
 */
+#include <algorithm>         // max.
 #include <cmath>             // floor, sqrt.
 #include <cstdio>            // printf.
 #include <cstdlib>           // atoi.
 #include <fstream>
 #include <iostream>          // cerr.
+#include <limits>            // numeric_limits.
 #include <filesystem>        // filesystem::path.
+#include <memory>            // unique_ptr.
+#include <mutex>
+#include <thread>            // hardware_concurrency.
 #include <gsl/gsl_sf_log.h>  // Natural log.
+#include "Clusters.h"
+#include "Columns.h"
+#include "Correlations.h"
+#include "CreutzDemon.h"
+#include "Equilibration.h"
 #include "Lattice.h"
+#include "MeasurementPipeline.h"
+#include "NFoldWay.h"
+#include "Options.h"
+#include "PerfCounters.h"
+#include "Resampling.h"
+#include "ResultCache.h"
+#include "StripSweeper.h"
+#include "Trace.h"
+#include "Trajectory.h"
+#include "UpdateScheduler.h"
+#include "WolffEstimators.h"
 
 
 void writeArrayToTextFile(const double* array, size_t size, const std::string& filename) {
+    TraceScope scope("write autocorrelation");
     std::ofstream file(filename);
     if (!file.is_open()) {
         throw std::runtime_error("Failed to open file for writing: " + filename);;
@@ -32,8 +54,41 @@ void writeArrayToTextFile(const double* array, size_t size, const std::string& f
 
 
 int main(int argc, char** const argv) {
-    if (argc != 10) {
-        fprintf(stderr, "Usage: %s xDim yDim init sampleSize temp autocorrelation.txt dir-lattice-snaptshots snapshot-prefix 10\n", argv[0]);
+    if (argc < 10) {
+        fprintf(stderr, "Usage: %s xDim yDim init sampleSize temp autocorrelation.txt dir-lattice-snaptshots snapshot-prefix 10 [options]\n", argv[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --zDim=1              z dimension, for a 3D lattice\n");
+        fprintf(stderr, "  --tDim=1              t dimension, for a 4D lattice\n");
+        fprintf(stderr, "  --mmap=spins.bin      keep the spins in this file, for lattices larger than the memory\n");
+        fprintf(stderr, "  --sequential          metropolis sweeps visit the sites in order instead of at random\n");
+        fprintf(stderr, "  --sweep-threads=0     sweep strips of the lattice on this many pinned threads (0 uses every core)\n");
+        fprintf(stderr, "  --perf                report hardware performance counters per phase on stderr\n");
+        fprintf(stderr, "  --trace=trace.json    write a Chrome trace_event timeline of the run\n");
+        fprintf(stderr, "  --trace-sweeps=1      number of sweeps covered by each traced sweep event\n");
+        fprintf(stderr, "  --trace-buffer=65536  number of trace events kept per thread\n");
+        fprintf(stderr, "  --resample=32         append blocked jackknife errors for E, |M|, C, chi and the Binder cumulant\n");
+        fprintf(stderr, "  --bootstrap=0         use this many bootstrap resamples instead of the jackknife\n");
+        fprintf(stderr, "  --bootstrap-seed=temp seed of the bootstrap random number streams\n");
+        fprintf(stderr, "  --threads=0           threads for the bootstrap (0 uses every core)\n");
+        fprintf(stderr, "  --series=series.txt   save the energy and magnetization of every measurement (see Reweight),\n");
+        fprintf(stderr, "                        as columns numpy can map if the name ends in .col (see columnar.py)\n");
+        fprintf(stderr, "  --trajectory=traj.bin record the spins after every sweep as keyframes and deltas (see Replay)\n");
+        fprintf(stderr, "  --keyframe=100        records between the keyframes of --trajectory\n");
+        fprintf(stderr, "  --correlations=xi.txt save G(r) and S(k), report the second-moment correlation length\n");
+        fprintf(stderr, "  --clusters=sizes.txt  label every cluster, save the size distribution and report percolation\n");
+        fprintf(stderr, "                        and the Fortuin-Kasteleyn improved susceptibility\n");
+        fprintf(stderr, "  --cluster-threads=1   threads labelling the clusters (0 uses every core)\n");
+        fprintf(stderr, "  --nfold               rejection-free n-fold way dynamics, for low temperatures\n");
+        fprintf(stderr, "  --demon=1             equilibrate microcanonically with this many Creutz demons\n");
+        fprintf(stderr, "  --algorithm=auto      sample with metropolis, wolff, swendsen-wang, mixed, or the cheapest (auto)\n");
+        fprintf(stderr, "  --improved=g.txt      improved estimators of chi and xi from the wolff clusters of --algorithm,\n");
+        fprintf(stderr, "                        and their G(r) if a file is given\n");
+        fprintf(stderr, "  --trial=500           at most this many steps of every candidate update timed by --algorithm,\n");
+        fprintf(stderr, "                        which takes the second half of init\n");
+        fprintf(stderr, "  --adaptive            stop equilibrating once MSER detects equilibrium (init is then the maximum)\n");
+        fprintf(stderr, "                        and space the measurements by the running tau_int\n");
+        fprintf(stderr, "  --async=2             measure packed copies of the spins on this many threads while sweeping\n");
+        fprintf(stderr, "  --cache=results-cache replay the output of a run already in this cache, or store it there\n");
         fflush(stderr);
         exit(1);
     }
@@ -47,11 +102,65 @@ int main(int argc, char** const argv) {
     std::filesystem::path dirPath = argv[7];     // Path where to store snaptshots.
     std::string snapshotPrefix = argv[8];        // Prefix for the snaptshots.
     unsigned int snapFrequency = atoi(argv[9]);  // Frequency with which to store snapshots.
+    Options options(argc, argv, 10);
+
+    // The flags that can't work together are rejected before the run rather than after it. The
+    // adaptive checks only run between Metropolis sweeps, and the threaded sweeps can't drive
+    // the n-fold way or the cluster updates.
+    if (options.has("adaptive") && (options.has("demon") || options.has("nfold")))
+        throw std::runtime_error("--adaptive can't be combined with --demon or --nfold");
+    if (options.has("sweep-threads") && (options.has("nfold") || options.has("algorithm")))
+        throw std::runtime_error("--sweep-threads can't be combined with --nfold or --algorithm");
+    if (options.has("algorithm") && options.has("nfold"))
+        throw std::runtime_error("--algorithm and --nfold can't be combined");
+    if (options.has("async") && options.has("adaptive"))
+        throw std::runtime_error("--async and --adaptive can't be combined, the spacing needs every measurement at once");
+    if (options.has("resample") && (options.getUInt("resample", 32) < 2 || sampleSize < 2))
+        throw std::runtime_error("--resample needs at least 2 bins and 2 measurements");
+
+    // Hardware counters are only opened on request, opening them is not free.
+    std::unique_ptr<PerfCounters> perf;
+    if (options.has("perf"))
+        perf = std::make_unique<PerfCounters>();
+
+    std::string traceFile = options.get("trace", "");
+    if (!traceFile.empty())
+        Trace::enable(options.getUInt("trace-buffer", 65536));
+    bool tracing = Trace::enabled();
+
+    // A run already in the cache is replayed: its output line and files are written back.
+    // Snapshots, traces and counters describe the run itself, runs asking for them always run.
+    std::unique_ptr<ResultCache> cache;
+    std::string description;
+    if (options.has("cache") && snapFrequency == 0 && !tracing && !options.has("perf")) {
+        cache = std::make_unique<ResultCache>(options.get("cache", "results-cache"));
+        description = ResultCache::describe(argc, argv);
+        CacheEntry entry;
+        if (cache->lookup(description, entry)) {
+            fputs(entry.restoreFiles().c_str(), stdout);
+            fprintf(stderr, "cache: replayed from %s\n", options.get("cache", "results-cache").c_str());
+            return 0;
+        }
+    }
+
+    uint64_t sweepStart = 0;
+    uint64_t phaseStart = 0;
 
     float temp = (float)RNSeed / 100;
 
-    unsigned int randomSite;
-    unsigned int latticeSize = xDim * yDim;
+    // Dimensions of size 1 are left out, --tDim without --zDim gives a 3D lattice.
+    std::vector<unsigned int> dims = {xDim, yDim};
+    for (const char* name : {"zDim", "tDim"}) {
+        if (options.getUInt(name, 1) > 1)
+            dims.push_back(options.getUInt(name, 1));
+    }
+    siteIndex latticeSize = 1;
+    for (unsigned int size : dims)
+        latticeSize *= size;
+    // Sequential sweeps stream through the spins, which the pages of a huge lattice need.
+    bool sequential = options.has("sequential");
+    // Sweep events are only recorded every traceSweeps sweeps to keep the overhead down.
+    unsigned int traceSweeps = std::max(1u, options.getUInt("trace-sweeps", 1));
 
     double avgEnergy = 0.0;
     double avgMagnet = 0.0;
@@ -65,42 +174,341 @@ int main(int argc, char** const argv) {
     double magnetData[sampleSize];
     
 
-    Lattice* lattice = new Lattice(xDim, xDim, RNSeed);
+    // Note: this used to be Lattice(xDim, xDim, RNSeed), which ignored yDim.
+    Lattice* lattice = new Lattice(dims, RNSeed, options.get("mmap", ""));
 
-    // Initialize and equilibrate the lattice.
-    for (unsigned int i = 0; i < init*latticeSize; i++) {
-        randomSite = (int) floor(latticeSize * gsl_rng_uniform(lattice->generator));
-        lattice->metropolis(randomSite);
+    // Threaded sweeps replace the single site metropolis updates, the spins are moved to the
+    // NUMA nodes of the threads unless they are kept in a file.
+    std::unique_ptr<StripSweeper<Lattice>> sweeper;
+    if (options.has("sweep-threads")) {
+        sweeper = std::make_unique<StripSweeper<Lattice>>(lattice, options.getUInt("sweep-threads", 0), RNSeed, !options.has("mmap"));
+        sweeper->report(stderr);
+    }
 
-        if (snapFrequency > 0 && i%snapFrequency == 0) {
-            std::string filename = snapshotPrefix + "-equil-" + std::to_string(i/latticeSize) + ".txt";
-            lattice->saveLatticeToFile(dirPath, filename);
+    // The time series are what the multiple histogram reweighting needs. A .col file gets the
+    // columnar format, which the notebooks map with columnar.py.
+    std::ofstream series;
+    std::unique_ptr<ColumnWriter> seriesColumns;
+    std::string seriesFile = options.get("series", "series.txt");
+    if (options.has("series") && std::filesystem::path(seriesFile).extension() == ".col") {
+        std::vector<std::string> names = {"energy", "magnetization", "abs_magnetization"};
+        ColumnAttributes attributes = {{"temp", RNSeed / 100.0}, {"latticeSize", (double)latticeSize}, {"dimensions", (double)dims.size()}};
+        seriesColumns = std::make_unique<ColumnWriter>(seriesFile, names, sampleSize, attributes);
+    } else if (options.has("series")) {
+        series.open(seriesFile);
+        if (!series.is_open())
+            throw std::runtime_error("Failed to open file for writing: " + seriesFile);
+        series << "# temp=" << temp << " latticeSize=" << latticeSize << "\n";
+        series << "# energy per spin, magnetization per spin\n";
+        series.precision(std::numeric_limits<double>::max_digits10);
+    }
+
+    // The correlations are measured with an FFT of the spins at every measurement.
+    std::unique_ptr<Correlations> correlations;
+    if (options.has("correlations"))
+        correlations = std::make_unique<Correlations>(dims);
+
+    // Every measurement labels the geometric clusters and the Fortuin-Kasteleyn ones.
+    std::unique_ptr<ClusterLabeller> labeller;
+    ClusterStatistics clusterStatistics;
+    if (options.has("clusters"))
+        labeller = std::make_unique<ClusterLabeller>(dims, options.getUInt("cluster-threads", 1), RNSeed);
+
+    // The n-fold way replaces the single site Metropolis updates, sweeps are then units of time.
+    // Its buckets are built from the spins, so after --demon they are built once the demons are done.
+    std::unique_ptr<NFoldWay> nfold;
+    if (options.has("nfold") && !options.has("demon"))
+        nfold = std::make_unique<NFoldWay>(lattice);
+    // With --algorithm the trials of the updates are the second half of the equilibration.
+    unsigned int trialSweeps = options.has("algorithm") ? init / 2 : 0;
+    unsigned int equilibrationSweeps = init - trialSweeps;
+    unsigned long long equilibrationUpdates = (unsigned long long)equilibrationSweeps * latticeSize;
+    unsigned long long samplingUpdates = 0;
+
+    // The trajectory counts time in sweeps, or in steps of the algorithm chosen by --algorithm.
+    // The lattice is recorded whenever a whole number of them is done, starting with sweep 0.
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    unsigned long long sweepsDone = 0;
+    if (options.has("trajectory")) {
+        trajectory = std::make_unique<TrajectoryWriter>(options.get("trajectory", "trajectory.bin"), dims,
+                                                        options.getUInt("keyframe", 100));
+        trajectory->record(0, lattice->lattice);
+    }
+    // recordSweeps also ends a traced "sweeps" event every traceSweeps of them.
+    unsigned int tracedSweeps = 0;
+    auto recordSweeps = [&](unsigned long long sweeps) {
+        sweepsDone += sweeps;
+        tracedSweeps += sweeps;
+        if (tracing && tracedSweeps >= traceSweeps) {
+            Trace::complete("sweeps", sweepStart);
+            sweepStart = Trace::now();
+            tracedSweeps = 0;
+        }
+        if (trajectory) {
+            TraceScope scope("trajectory");
+            trajectory->record(sweepsDone, lattice->lattice);
+        }
+    };
+
+    // Cluster updates are only used on request, once the scheduler has chosen one.
+    std::unique_ptr<UpdateScheduler> scheduler;
+    UpdateAlgorithm algorithm = UpdateAlgorithm::Metropolis;
+
+    // advance runs the given number of sweeps of the update of the run, or steps of the one
+    // chosen by --algorithm, and returns the site updates (n-fold way flips) they did. The n-fold
+    // way and the threaded sweeps are recorded all at once, the others one sweep at a time.
+    auto advance = [&](unsigned int sweeps) -> unsigned long long {
+        if (nfold) {
+            unsigned long long eventsBefore = nfold->getEvents();
+            nfold->advance(sweeps);
+            recordSweeps(sweeps);
+            return nfold->getEvents() - eventsBefore;
+        }
+        if (sweeper) {
+            sweeper->sweep(sweeps);
+            recordSweeps(sweeps);
+            return (unsigned long long)sweeps * latticeSize;
         }
+        unsigned long long updates = 0;
+        for (unsigned int s = 0; s < sweeps; s++) {
+            if (scheduler) {
+                updates += scheduler->step(algorithm);
+            } else {
+                for (siteIndex i = 0; i < latticeSize; i++)
+                    lattice->metropolis(sequential ? i : lattice->getRandomSite());
+                updates += latticeSize;
+            }
+            recordSweeps(1);
+        }
+        return updates;
+    };
+
+    // Initialize and equilibrate the lattice.
+    if (perf) perf->begin("equilibration");
+    if (tracing) phaseStart = sweepStart = Trace::now();
+    if (options.has("demon")) {
+        // Microcanonical sweeps at the energy of the infinite lattice, no random numbers needed.
+        if (lattice->dimensions != 2)
+            throw std::runtime_error("--demon needs the exact energy of the 2D lattice");
+        CreutzDemon demon(lattice, options.getUInt("demon", 1));
+        demon.setEnergy((int)lround(CreutzDemon::onsagerEnergy(temp) * latticeSize));
+        unsigned long long flips = 0;
+        for (unsigned int s = 0; s < equilibrationSweeps; s++) {
+            // The first half of the sweeps thermalizes the demons, the second measures them.
+            if (s == equilibrationSweeps / 2)
+                demon.resetStatistics();
+            flips += demon.sweep();
+            recordSweeps(1);
+        }
+        equilibrationUpdates = flips;
+        fprintf(stderr, "demon: energy %f per spin, demon temperature %f\n",
+                (double)demon.getEnergy() / latticeSize, demon.temperature());
+        if (options.has("nfold"))
+            nfold = std::make_unique<NFoldWay>(lattice);
+    } else {
+        // With --adaptive the energy and |M| after every sweep are fed to MSER, which is checked
+        // every 64 sweeps. Coarsening domains can leave the energy almost flat while |M| still grows.
+        bool adaptive = options.has("adaptive");
+        EquilibrationDetector detector, magnetDetector;
+        unsigned int snapSweeps = std::max<siteIndex>(1, snapFrequency / latticeSize);
+        equilibrationUpdates = 0;
+        for (unsigned int s = 0; s < equilibrationSweeps; s++) {
+            if (snapFrequency > 0 && s % snapSweeps == 0) {
+                TraceScope scope("snapshot");
+                std::string filename = snapshotPrefix + "-equil-" + std::to_string(s) + ".txt";
+                lattice->saveLatticeToFile(dirPath, filename);
+            }
+            equilibrationUpdates += advance(1);
+
+            if (adaptive) {
+                detector.add(lattice->calcTotalEnergy());
+                magnetDetector.add(fabs(lattice->calcMagnetization()));
+                if (detector.size() % 64 == 0 && detector.equilibrated() && magnetDetector.equilibrated())
+                    break;
+            }
+        }
+        if (adaptive) {
+            bool equilibrated = detector.equilibrated() && magnetDetector.equilibrated();
+            fprintf(stderr, "adaptive: %s after %zu of %u sweeps, MSER truncation at sweep %zu\n",
+                    equilibrated ? "equilibrated" : "not equilibrated", detector.size(), equilibrationSweeps,
+                    std::max(detector.truncation(), magnetDetector.truncation()));
+        }
+    }
+    if (tracing && tracedSweeps > 0)
+        Trace::complete("sweeps", sweepStart);
+
+    // The scheduler decides between the updates and how often to measure. Its trials and the
+    // steps of the chosen update finish the equilibration.
+    if (options.has("algorithm")) {
+        TraceScope scope("scheduling");
+        std::string name = options.get("algorithm", "auto");
+        std::vector<UpdateAlgorithm> candidates = {UpdateAlgorithm::Metropolis, UpdateAlgorithm::Wolff,
+                                                   UpdateAlgorithm::SwendsenWang, UpdateAlgorithm::Mixed};
+        if (name != "auto")
+            candidates = {parseAlgorithm(name)};
+        scheduler = std::make_unique<UpdateScheduler>(lattice);
+        algorithm = scheduler->choose(candidates, options.getUInt("trial", 500),
+                                      (unsigned long long)trialSweeps * latticeSize);
+        equilibrationUpdates += scheduler->getUpdates();
+        scheduler->report(stderr);
+    }
+    if (perf) perf->end("equilibration", equilibrationUpdates);
+    if (tracing)
+        Trace::complete("equilibration", phaseStart);
+
+    // The wolff clusters of the sampling are measured as they are grown, the trials aren't.
+    std::unique_ptr<WolffEstimators> estimators;
+    if (options.has("improved")) {
+        estimators = std::make_unique<WolffEstimators>(dims, !options.get("improved", "").empty());
+        lattice->estimators = estimators.get();
     }
 
-    // Take data every 5 sweeps (somewhat arbitrary value based on checking out the 
-    // autocorrelation times).
-    // TODO: elaborate on what and why. Evaluate how the critical slowing down is affected by this
-    // parameter.
+    // By default a measurement is taken every 5 sweeps. That is a compromise rather than a
+    // derived value: away from T_c the autocorrelation time of the measurements is a few of them,
+    // near T_c it is hundreds (the autocorTime column of data/slowing). Correlated measurements
+    // widen the error bars, which use 2 tau_int / sampleSize, rather than bias the averages.
+    // --adaptive moves the spacing towards the running tau_int of |M| instead, and --algorithm
+    // measures every stride steps of the chosen update, about tau_int of the trials apart.
+    // The measurement phase overlaps the sampling one, every measurement visits all sites.
     unsigned int counter = 0;
-    for (unsigned int i = 0; i < sampleSize * latticeSize * 5; i++) {
-        randomSite = (int) floor(latticeSize * gsl_rng_uniform(lattice->generator));
-        lattice->metropolis(randomSite);
+    // accumulate adds measurement i to the sums, once energyData[i] and magnetData[i] hold E and M.
+    auto accumulate = [&](unsigned int i) {
+        avgEnergy += energyData[i];
+        avgMagnet += magnetData[i];
+        if (series.is_open())
+            series << energyData[i] << "\t" << magnetData[i] << "\n";
+        if (seriesColumns)
+            seriesColumns->append({energyData[i], magnetData[i], fabs(magnetData[i])});
+        magnetData[i] = fabs(magnetData[i]);
+        AvgMagnetAbs += magnetData[i];
+
+        sqrEnergy += (energyData[i] * energyData[i]);
+        sqrMagnet += (magnetData[i] * magnetData[i]);
+    };
+    auto measureSpins = [&](const std::int8_t* spins) {
+        if (correlations) {
+            TraceScope fftScope("correlations");
+            correlations->add(spins);
+        }
+        if (labeller) {
+            TraceScope clusterScope("clusters");
+            labeller->label(spins, ClusterLabeller::geometric);
+            clusterStatistics.addGeometric(*labeller);
+            labeller->label(spins, lattice->beta);
+            clusterStatistics.addImproved(*labeller);
+        }
+    };
+
+    // With --async the sweeps only pack the spins into a snapshot, worker threads measure it.
+    // The sums are taken in order once they are done, so the output doesn't change. The
+    // correlations and the clusters are measured one snapshot at a time, in any order.
+    typedef std::vector<std::uint64_t> PackedSpins;
+    std::unique_ptr<MeasurementPipeline<PackedSpins>> pipeline;
+    unsigned int asyncWorkers = 0;
+    std::mutex measureSpinsMutex;
+    std::vector<std::vector<std::int8_t>> unpacked;
+    if (options.has("async")) {
+        asyncWorkers = options.getUInt("async", 2);
+        if (asyncWorkers == 0)
+            asyncWorkers = std::max(1u, std::thread::hardware_concurrency() - 1);
+        unpacked.assign(asyncWorkers, std::vector<std::int8_t>(latticeSize));
+        pipeline = std::make_unique<MeasurementPipeline<PackedSpins>>(asyncWorkers, 4 * asyncWorkers,
+            [&](unsigned int worker, std::uint64_t index, const PackedSpins& snapshot) {
+                TraceScope scope("measurement");
+                std::int8_t* spins = unpacked[worker].data();
+                Lattice::unpackSpins(snapshot.data(), latticeSize, spins);
+                energyData[index] = lattice->calcTotalEnergy(spins);
+                magnetData[index] = lattice->calcMagnetization(spins);
+                if (correlations || labeller) {
+                    std::lock_guard<std::mutex> lock(measureSpinsMutex);
+                    measureSpins(spins);
+                }
+            });
+    }
 
-        if (i % (latticeSize*5) == 0) {
+    auto measure = [&]() {
+        TraceScope scope("measurement");
+        if (perf) perf->begin("measurement");
+        if (pipeline) {
+            PackedSpins& snapshot = pipeline->acquire();
+            snapshot.resize((latticeSize + 63) / 64);
+            lattice->packSpins(snapshot.data());
+            pipeline->publish();
+        } else {
             energyData[counter] = lattice->calcTotalEnergy();
-            avgEnergy += energyData[counter];
-
             magnetData[counter] = lattice->calcMagnetization();
-            avgMagnet += magnetData[counter];
-            magnetData[counter] = fabs(magnetData[counter]);
-            AvgMagnetAbs += magnetData[counter];
-
-            sqrEnergy += (energyData[counter] * energyData[counter]);
-            sqrMagnet += (magnetData[counter] * magnetData[counter]);
+            accumulate(counter);
+            measureSpins(lattice->lattice.begin());
+        }
 
-            counter++;
+        counter++;
+        if (perf) perf->end("measurement", latticeSize);
+    };
+
+    if (perf) perf->begin("sampling");
+    if (tracing) phaseStart = sweepStart = Trace::now();
+    // The spacing of --adaptive starts at 5 sweeps and follows tau_int of |M|, up to 1000 sweeps.
+    bool adaptive = options.has("adaptive") && !scheduler;
+    MeasurementSpacing spacing(5, 1000);
+    tracedSweeps = 0;
+    for (unsigned int m = 0; m < sampleSize; m++) {
+        measure();
+        unsigned int gap = scheduler ? scheduler->getStride() : 5;
+        if (adaptive) {
+            spacing.add(magnetData[counter - 1]);
+            gap = spacing.gap();
         }
+        samplingUpdates += advance(gap);
+    }
+    if (nfold)
+        fprintf(stderr, "nfold: %llu flips in %.0f sweeps, %.3g flips per site and sweep\n",
+                nfold->getEvents(), nfold->getTime(), nfold->getEvents() / (nfold->getTime() * latticeSize));
+    if (adaptive)
+        fprintf(stderr, "adaptive: measuring every %u sweeps, tau_int %.2f sweeps\n", spacing.gap(), spacing.tau());
+    if (pipeline) {
+        TraceScope scope("draining measurements");
+        pipeline->finish();
+        for (unsigned int i = 0; i < counter; i++)
+            accumulate(i);
+        fprintf(stderr, "async: %u measurements on %u workers, the sweeps waited for them %llu times\n",
+                counter, asyncWorkers, pipeline->getStalls());
+    }
+    if (perf) {
+        perf->end("sampling", samplingUpdates);
+        perf->report(stderr);
+    }
+    if (trajectory) {
+        // A text snapshot takes a byte per site plus the line breaks.
+        fprintf(stderr, "trajectory: %llu records, %llu keyframes, %llu bytes, %.3g bytes per record against %llu per snapshot\n",
+                trajectory->getRecords(), trajectory->getKeyframes(), trajectory->getBytes(),
+                (double)trajectory->getBytes() / trajectory->getRecords(),
+                (unsigned long long)(latticeSize + latticeSize / xDim + 1));
+    }
+    if (correlations) {
+        correlations->write(options.get("correlations", "correlations.txt"));
+        fprintf(stderr, "correlations: xi_2nd");
+        for (unsigned int d = 0; d < correlations->getDimensions(); d++)
+            fprintf(stderr, " %c %f", "xyzt"[d], correlations->correlationLength(d));
+        if (correlations->size() >= 2) {
+            ResamplingResult xi = correlations->meanCorrelationLength(std::min<unsigned int>(32, correlations->size()));
+            fprintf(stderr, ", mean %f +- %f", xi.value, xi.error);
+        }
+        fprintf(stderr, " over %zu measurements\n", correlations->size());
+    }
+    if (estimators) {
+        lattice->estimators = nullptr;
+        if (!options.get("improved", "").empty())
+            estimators->write(options.get("improved", ""));
+        estimators->report(stderr, lattice->beta);
+    }
+    if (labeller) {
+        clusterStatistics.write(options.get("clusters", "clusters.txt"));
+        clusterStatistics.report(stderr, lattice->beta);
+    }
+    if (tracing) {
+        if (tracedSweeps > 0) Trace::complete("sweeps", sweepStart);
+        Trace::complete("sampling", phaseStart);
+        phaseStart = Trace::now();
     }
 
     // Take averages.
@@ -110,11 +518,46 @@ int main(int argc, char** const argv) {
     sqrEnergy /= sampleSize;
     sqrMagnet /= sampleSize;
 
-    // Add bootstrapping here...
-    // TODO: the author's comment was literal.
     specificHeat = lattice->calcSpecificHeat(avgEnergy, sqrEnergy);
     susceptibility = lattice->calcSusceptibility(AvgMagnetAbs, sqrMagnet);
 
+    // The errors of the derived quantities come from resampling the binned series.
+    // They are only computed on request since they add columns to the output.
+    std::vector<double> resampled;
+    if (options.has("resample")) {
+        TraceScope scope("resampling");
+        std::vector<std::vector<double>> primary(5, std::vector<double>(sampleSize));
+        for (unsigned int i = 0; i < sampleSize; i++) {
+            primary[0][i] = energyData[i];
+            primary[1][i] = energyData[i] * energyData[i];
+            primary[2][i] = magnetData[i];
+            primary[3][i] = magnetData[i] * magnetData[i];
+            primary[4][i] = primary[3][i] * primary[3][i];
+        }
+        // Short runs get fewer bins, every bin holds at least one measurement.
+        Resampler resampler(primary, std::min(options.getUInt("resample", 32), sampleSize));
+
+        double beta = lattice->beta;
+        double size = latticeSize;
+        std::vector<DerivedQuantity> quantities = {
+            [](const std::vector<double>& a) { return a[0]; },
+            [](const std::vector<double>& a) { return a[2]; },
+            [=](const std::vector<double>& a) { return beta * beta * size * (a[1] - a[0] * a[0]); },
+            [=](const std::vector<double>& a) { return beta * size * (a[3] - a[2] * a[2]); },
+            [](const std::vector<double>& a) { return 1 - a[4] / (3 * a[3] * a[3]); },
+        };
+
+        unsigned int resamples = options.getUInt("bootstrap", 0);
+        for (const DerivedQuantity& f : quantities) {
+            ResamplingResult result = (resamples > 0)
+                ? resampler.bootstrap(f, resamples, options.getUInt("bootstrap-seed", RNSeed), options.getUInt("threads", 0))
+                : resampler.jackknife(f);
+            resampled.push_back(result.error);
+        }
+        // The Binder cumulant is not part of the default output, so we add its value too.
+        resampled.insert(resampled.end() - 1, resampler.estimate(quantities.back()));
+    }
+
     delete lattice;
 
     // Now its time for some autocorrelation and standard deviation madness.
@@ -177,12 +620,49 @@ int main(int argc, char** const argv) {
         magnetStdDev = sqrt(magnetStdDev);
     }
 
-    printf("%d,%d,%d,%d,%d,", xDim, yDim, init, sampleSize, RNSeed);
-    printf("%f,%lf,", temp, autocorTime);
-    printf("%lf,%lf,", avgEnergy, energyStdDev);
-    printf("%lf,%lf,", AvgMagnetAbs, magnetStdDev);
-    printf("%lf,%lf,", specificHeat, susceptibility);
-    printf("%lf,%lf\n", avgMagnet, scaleFactor);
+    if (tracing) {
+        Trace::complete("analysis", phaseStart);
+        Trace::write(traceFile);
+    }
+
+    char columns[512];
+    snprintf(columns, sizeof(columns), "%d,%d,%d,%d,%d,%f,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf",
+             xDim, yDim, init, sampleSize, RNSeed, temp, autocorTime, avgEnergy, energyStdDev,
+             AvgMagnetAbs, magnetStdDev, specificHeat, susceptibility, avgMagnet, scaleFactor);
+    std::string line = columns;
+    // errE, errMAbs, errC, errChi, binder, errBinder.
+    for (double value : resampled) {
+        snprintf(columns, sizeof(columns), ",%lf", value);
+        line += columns;
+    }
+    // The schedule of --algorithm: the update and the steps between measurements.
+    if (scheduler) {
+        snprintf(columns, sizeof(columns), ",%s,%u", algorithmName(algorithm).c_str(), scheduler->getStride());
+        line += columns;
+    }
+    line += "\n";
+    fputs(line.c_str(), stdout);
+
+    if (cache) {
+        // The files still being written are closed first.
+        series.close();
+        seriesColumns.reset();
+        trajectory.reset();
+        CacheEntry entry;
+        entry.blobs.emplace_back("stdout", line);
+        entry.addFile(autocorFile);
+        std::vector<std::pair<std::string, std::string>> outputs = {
+            {"series", "series.txt"}, {"trajectory", "trajectory.bin"},
+            {"correlations", "correlations.txt"}, {"clusters", "clusters.txt"},
+        };
+        for (const auto& [name, fallback] : outputs) {
+            if (options.has(name))
+                entry.addFile(options.get(name, fallback));
+        }
+        if (!options.get("improved", "").empty())
+            entry.addFile(options.get("improved", ""));
+        cache->store(description, entry);
+    }
 
     return 0;
 }
\ No newline at end of file
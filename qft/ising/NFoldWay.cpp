@@ -0,0 +1,106 @@
+/* NFoldWay.cpp
+Rejection-free n-fold way dynamics of the Ising lattice.
+*/
+#include "NFoldWay.h"
+#include <cmath>  // log.
+
+
+NFoldWay::NFoldWay(Lattice* l) : lattice(l), time(0.0), events(0) {
+    // Flipping a site of energy e changes the total energy by -2e. In 2D the classes are
+    // e = -4 (dE = 8), e = -2 (dE = 4), and e = 0, 2, 4, which always flip.
+    unsigned int d = lattice->dimensions;
+    numClasses = 2 * d + 1;
+    rates.assign(numClasses, 1.0);
+    for (unsigned int c = 0; c < d; c++)
+        rates[c] = lattice->exponentials[d - c - 1];
+    buckets.resize(numClasses);
+
+    siteClass.assign(lattice->latticeSize, 0);
+    position.assign(lattice->latticeSize, 0);
+    for (siteIndex site = 0; site < lattice->latticeSize; site++)
+        insert(site, classOf(site));
+}
+
+unsigned int NFoldWay::classOf(siteIndex site) {
+    return (unsigned int)(lattice->calcEnergy(site) + 2 * (int)lattice->dimensions) / 2;
+}
+
+void NFoldWay::insert(siteIndex site, unsigned int c) {
+    siteClass[site] = (unsigned char)c;
+    position[site] = buckets[c].size();
+    buckets[c].push_back(site);
+}
+
+// remove swaps the last site of the bucket into the hole.
+void NFoldWay::remove(siteIndex site) {
+    std::vector<siteIndex>& bucket = buckets[siteClass[site]];
+    siteIndex last = bucket.back();
+    bucket[position[site]] = last;
+    position[last] = position[site];
+    bucket.pop_back();
+}
+
+void NFoldWay::reclassify(siteIndex site) {
+    unsigned int c = classOf(site);
+    if (c != siteClass[site]) {
+        remove(site);
+        insert(site, c);
+    }
+}
+
+double NFoldWay::totalRate() const {
+    double total = 0.0;
+    for (unsigned int c = 0; c < numClasses; c++)
+        total += rates[c] * buckets[c].size();
+    return total;
+}
+
+void NFoldWay::flip(siteIndex site) {
+    lattice->lattice[site] *= -1;
+
+    lattice->getNeighbours(site);
+    siteIndex neighbours[2 * Lattice::maxDimensions];
+    for (unsigned int d = 0; d < lattice->dimensions; d++) {
+        neighbours[2 * d] = lattice->nextSite[d];
+        neighbours[2 * d + 1] = lattice->prevSite[d];
+    }
+    reclassify(site);
+    for (unsigned int k = 0; k < 2 * lattice->dimensions; k++)
+        reclassify(neighbours[k]);
+}
+
+unsigned long long NFoldWay::advance(double sweeps) {
+    double until = time + sweeps;
+    unsigned long long flips = 0;
+
+    while (true) {
+        // Every sweep proposes each site once on average, so the rate per sweep of
+        // accepted flips is the sum of the acceptance probabilities.
+        double total = totalRate();
+        double wait = -log(gsl_rng_uniform_pos(lattice->generator)) / total;
+        if (time + wait > until) {
+            // The waiting time is memoryless, so the one we drew can be dropped.
+            time = until;
+            break;
+        }
+        time += wait;
+
+        double target = gsl_rng_uniform(lattice->generator) * total;
+        unsigned int c = 0;
+        while (c < numClasses - 1 && (buckets[c].empty() || target >= rates[c] * buckets[c].size())) {
+            target -= rates[c] * buckets[c].size();
+            c++;
+        }
+        // Rounding can leave us on an empty class at the end, step back to one that isn't.
+        while (buckets[c].empty())
+            c--;
+
+        const std::vector<siteIndex>& bucket = buckets[c];
+        siteIndex index = lattice->getRandomIndex(bucket.size());
+        flip(bucket[index]);
+        flips++;
+    }
+
+    events += flips;
+    return flips;
+}
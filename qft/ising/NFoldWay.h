@@ -0,0 +1,56 @@
+/* NFoldWay.h
+Rejection-free n-fold way (Bortz, Kalos, Lebowitz) dynamics of the Ising lattice.
+
+A single spin flip can only change the energy by one of five amounts, depending
+on how many of the four neighbours are aligned with the spin (see the table in
+Lattice.cpp), or of 2D + 1 amounts in D dimensions. The sites are kept in one
+bucket per class, and the buckets
+are updated incrementally when a spin and its neighbours change class. Every
+event picks a class with probability proportional to its total Metropolis rate,
+flips a uniformly chosen site of that class, and advances a continuous clock
+by an exponentially distributed waiting time.
+
+Time is measured in Metropolis sweeps (N proposals), so advance(5) reproduces,
+in distribution, five sweeps of random site Metropolis updates. At low
+temperature almost every Metropolis proposal is rejected, while here the cost
+is proportional to the number of accepted flips.
+*/
+#ifndef _NFOLDWAY_H
+#define _NFOLDWAY_H
+
+#include "Lattice.h"
+#include <vector>
+
+
+class NFoldWay {
+    public:
+    explicit NFoldWay(Lattice* lattice);
+
+    // Runs events until the clock has advanced by the given number of sweeps.
+    // Returns the number of spins that were flipped.
+    unsigned long long advance(double sweeps);
+
+    double getTime() const { return time; }
+    unsigned long long getEvents() const { return events; }
+
+    private:
+    Lattice* lattice;
+    unsigned int numClasses;
+    std::vector<double> rates;    // Metropolis acceptance of a flip in each class.
+    double time;                  // In sweeps.
+    unsigned long long events;
+
+    std::vector<std::vector<siteIndex>> buckets;
+    std::vector<unsigned char> siteClass;
+    std::vector<siteIndex> position;  // Index of every site inside its bucket.
+
+    // The class is the current energy of the site, -2D, ..., 2D in steps of 2, shifted to 0..2D.
+    unsigned int classOf(siteIndex site);
+    void insert(siteIndex site, unsigned int c);
+    void remove(siteIndex site);
+    void reclassify(siteIndex site);
+    double totalRate() const;
+    void flip(siteIndex site);
+};
+
+#endif // _NFOLDWAY_H
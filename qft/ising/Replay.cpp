@@ -0,0 +1,51 @@
+/* Replay.cpp
+Replays a trajectory recorded by Metropolis --trajectory.
+
+Without a sweep it prints the energy and magnetization per spin of every
+record, one line each:
+sweep,energy,magnetization
+
+With a sweep it prints the lattice at the last record at or before that sweep,
+in the format of the snapshots of Metropolis ('x' for up, 'o' for down).
+
+Usage: ./Replay trajectory.bin [sweep]
+*/
+#include <cstdio>            // printf.
+#include <cstdlib>           // strtoull.
+#include <vector>
+#include "Lattice.h"
+#include "Trajectory.h"
+
+
+int main(int argc, char** const argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s trajectory.bin [sweep]\n", argv[0]);
+        fflush(stderr);
+        exit(1);
+    }
+
+    TrajectoryReader reader(argv[1]);
+    std::vector<std::int8_t> spins;
+
+    // The observables are those of Lattice, the seed is irrelevant since the spins are replaced.
+    Lattice lattice(reader.getDims(), 100);
+    auto copySpins = [&]() {
+        std::copy(spins.begin(), spins.end(), lattice.lattice.begin());
+    };
+
+    if (argc > 2) {
+        unsigned long long sweep = strtoull(argv[2], nullptr, 10);
+        size_t record = reader.seek(sweep, spins);
+        copySpins();
+        fprintf(stderr, "replay: sweep %llu\n", reader.getSweep(record));
+        lattice.printLattice();
+        return 0;
+    }
+
+    for (size_t record = 0; record < reader.getRecords(); record++) {
+        reader.load(record, spins);
+        copySpins();
+        printf("%llu,%lf,%lf\n", reader.getSweep(record), lattice.calcTotalEnergy(), lattice.calcMagnetization());
+    }
+    return 0;
+}
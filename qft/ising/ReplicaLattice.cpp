@@ -0,0 +1,129 @@
+/* ReplicaLattice.cpp
+Many independent replicas of the same 2D Ising lattice updated in lock-step.
+*/
+#include "ReplicaLattice.h"
+#include <cmath>      // exp, ldexp.
+#include <stdexcept>  // For std::runtime_error
+
+
+// splitmix64 spreads the seed over the xoshiro states, as recommended by its authors.
+static uint64_t splitmix64(uint64_t& x) {
+    uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+static uint32_t threshold(double probability) {
+    double scaled = ldexp(probability, 32);
+    return (scaled >= 4294967295.0) ? 0xffffffffu : (uint32_t)scaled;
+}
+
+ReplicaLattice::ReplicaLattice(unsigned int x, unsigned int y, unsigned int r, double temp, uint64_t seed)
+    : xDim(x), yDim(y), latticeSize(x * y), replicas(r), beta(1.0 / temp) {
+    // The neighbours of a site must differ from it, the update relies on it.
+    if (replicas == 0 || xDim < 2 || yDim < 2)
+        throw std::runtime_error("A replica lattice needs at least one replica and two rows and columns");
+
+    exponentials[0] = exp(-beta * 4);
+    exponentials[1] = exp(-beta * 8);
+    thresholds[0] = threshold(exponentials[0]);
+    thresholds[1] = threshold(exponentials[1]);
+
+    neighbours.resize(4 * (size_t)latticeSize);
+    for (unsigned int site = 0; site < latticeSize; site++) {
+        neighbours[4 * site + 0] = (site + 1) % latticeSize;
+        neighbours[4 * site + 1] = (site + latticeSize - 1) % latticeSize;
+        neighbours[4 * site + 2] = (site + xDim) % latticeSize;
+        neighbours[4 * site + 3] = (site + latticeSize - xDim % latticeSize) % latticeSize;
+    }
+
+    rng0.resize(replicas);
+    rng1.resize(replicas);
+    rng2.resize(replicas);
+    rng3.resize(replicas);
+    for (unsigned int lane = 0; lane < replicas; lane++) {
+        uint64_t state = seed * 0x100000001b3ULL + lane;
+        uint64_t a = splitmix64(state), b = splitmix64(state);
+        rng0[lane] = (uint32_t)a;
+        rng1[lane] = (uint32_t)(a >> 32);
+        rng2[lane] = (uint32_t)b;
+        rng3[lane] = (uint32_t)(b >> 32) | 1u;  // The state must not be all zeros.
+    }
+
+    // Random initial states, like Lattice.
+    spins.resize((size_t)latticeSize * replicas);
+    for (unsigned int site = 0; site < latticeSize; site++) {
+        for (unsigned int lane = 0; lane < replicas; lane++) {
+            uint32_t result = rng0[lane] + rng3[lane];
+            uint32_t t = rng1[lane] << 9;
+            rng2[lane] ^= rng0[lane];
+            rng3[lane] ^= rng1[lane];
+            rng1[lane] ^= rng2[lane];
+            rng0[lane] ^= rng3[lane];
+            rng2[lane] ^= t;
+            rng3[lane] = (rng3[lane] << 11) | (rng3[lane] >> 21);
+            spins[(size_t)site * replicas + lane] = (result >> 31) ? 1 : -1;
+        }
+    }
+}
+
+// updateLanes offers every replica a flip of one site. GCC only trusts restrict on
+// parameters, which is what lets it vectorize this loop without runtime alias checks.
+static void updateLanes(unsigned int n, uint32_t t4, uint32_t t8, int8_t* __restrict spin,
+                        const int8_t* __restrict nextX, const int8_t* __restrict prevX,
+                        const int8_t* __restrict nextY, const int8_t* __restrict prevY,
+                        uint32_t* __restrict s0, uint32_t* __restrict s1,
+                        uint32_t* __restrict s2, uint32_t* __restrict s3) {
+    // Everything below is straight-line code over the lanes, no branches.
+    for (unsigned int r = 0; r < n; r++) {
+        uint32_t u = s0[r] + s3[r];
+        uint32_t t = s1[r] << 9;
+        s2[r] ^= s0[r];
+        s3[r] ^= s1[r];
+        s1[r] ^= s2[r];
+        s0[r] ^= s3[r];
+        s2[r] ^= t;
+        s3[r] = (s3[r] << 11) | (s3[r] >> 21);
+
+        // The energy change of the flip is 2 * e, e in {-4, -2, 0, 2, 4}.
+        int e = spin[r] * (nextX[r] + prevX[r] + nextY[r] + prevY[r]);
+        uint32_t limit = (e == 2) ? t4 : t8;
+        bool flip = (e <= 0) | (u < limit);
+        spin[r] = flip ? (int8_t)-spin[r] : spin[r];
+    }
+}
+
+void ReplicaLattice::sweep() {
+    const unsigned int n = replicas;
+    int8_t* base = spins.data();
+    for (unsigned int site = 0; site < latticeSize; site++) {
+        const uint32_t* nb = &neighbours[4 * (size_t)site];
+        updateLanes(n, thresholds[0], thresholds[1], base + (size_t)site * n,
+                    base + (size_t)nb[0] * n, base + (size_t)nb[1] * n,
+                    base + (size_t)nb[2] * n, base + (size_t)nb[3] * n,
+                    rng0.data(), rng1.data(), rng2.data(), rng3.data());
+    }
+}
+
+void ReplicaLattice::measure(std::vector<double>& energy, std::vector<double>& magnet) const {
+    const unsigned int n = replicas;
+    std::vector<int32_t> e(n, 0), m(n, 0);
+
+    for (unsigned int site = 0; site < latticeSize; site++) {
+        const int8_t* spin = &spins[(size_t)site * n];
+        const int8_t* nextX = &spins[(size_t)neighbours[4 * (size_t)site + 0] * n];
+        const int8_t* nextY = &spins[(size_t)neighbours[4 * (size_t)site + 2] * n];
+        for (unsigned int r = 0; r < n; r++) {
+            e[r] -= spin[r] * (nextX[r] + nextY[r]);
+            m[r] += spin[r];
+        }
+    }
+
+    energy.resize(n);
+    magnet.resize(n);
+    for (unsigned int r = 0; r < n; r++) {
+        energy[r] = (double)e[r] / latticeSize;
+        magnet[r] = (double)m[r] / latticeSize;
+    }
+}
@@ -0,0 +1,53 @@
+/* ReplicaLattice.h
+Many independent replicas of the same 2D Ising lattice updated in lock-step.
+
+Site i of every replica is stored contiguously, spins[i * replicas + r], as
+one byte per spin, so that the loop over replicas at a fixed site reads and
+writes consecutive memory and the compiler can turn it into AVX2/AVX-512
+instructions (32 or 64 replicas per instruction).
+
+Every sweep visits the sites in memory order (a sequential sweep, which also
+satisfies balance) and offers every replica a Metropolis flip of that site.
+Each replica has its own xoshiro128+ random number stream, stored one state
+word per array so that the generators advance in the same vector loop. The
+acceptance uses the same Boltzmann factors as Lattice::exponentials, turned
+into 32-bit thresholds, and no branches: a replica flips when the flip lowers
+the energy or its random number is below the threshold of the energy change.
+
+Neighbours follow the helical boundary conditions of Lattice.
+*/
+#ifndef _REPLICALATTICE_H
+#define _REPLICALATTICE_H
+
+#include <cstdint>
+#include <vector>
+
+
+class ReplicaLattice {
+    public:
+    ReplicaLattice(unsigned int x, unsigned int y, unsigned int replicas, double temp, uint64_t seed);
+
+    void sweep();
+
+    // Energy and magnetization per spin of every replica.
+    void measure(std::vector<double>& energy, std::vector<double>& magnet) const;
+
+    unsigned int getReplicas() const { return replicas; }
+    unsigned int getLatticeSize() const { return latticeSize; }
+    double getBeta() const { return beta; }
+
+    private:
+    unsigned int xDim;
+    unsigned int yDim;
+    unsigned int latticeSize;
+    unsigned int replicas;
+    double beta;
+    double exponentials[2];   // exp(-4 beta), exp(-8 beta), as in Lattice.
+    uint32_t thresholds[2];   // The same as fractions of 2^32.
+
+    std::vector<int8_t> spins;
+    std::vector<uint32_t> neighbours;  // nextX, prevX, nextY, prevY of every site.
+    std::vector<uint32_t> rng0, rng1, rng2, rng3;  // xoshiro128+ state of every replica.
+};
+
+#endif // _REPLICALATTICE_H
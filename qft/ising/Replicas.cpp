@@ -0,0 +1,95 @@
+/* Replicas.cpp
+Runs many independent chains of the same 2D Ising lattice in one process with
+ReplicaLattice and prints the observables of every chain, one line each:
+xDim,yDim,init,sampleSize,RNSeed,T,replica,avgE,avgMAbs,c,chi,binder
+
+The mean over the chains and its standard error, which needs no
+autocorrelation analysis since the chains are independent, and the
+throughput are reported on stderr.
+
+Usage: ./Replicas xDim yDim init sampleSize temp replicas [--seed=1]
+The temperature is given as 100x kT, as in Metropolis.
+*/
+#include <algorithm>         // max.
+#include <chrono>
+#include <cmath>             // sqrt.
+#include <cstdio>            // printf.
+#include <cstdlib>           // atoi.
+#include <vector>
+#include "Options.h"
+#include "ReplicaLattice.h"
+
+
+int main(int argc, char** const argv) {
+    if (argc < 7) {
+        fprintf(stderr, "Usage: %s xDim yDim init sampleSize temp replicas [options]\n", argv[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --seed=1              seed of the random number streams of the replicas\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    unsigned int xDim = atoi(argv[1]);
+    unsigned int yDim = atoi(argv[2]);
+    unsigned int init = atoi(argv[3]);
+    unsigned int sampleSize = atoi(argv[4]);
+    unsigned int RNSeed = atoi(argv[5]);  // 100x temperature.
+    unsigned int replicas = atoi(argv[6]);
+    Options options(argc, argv, 7);
+
+    double temp = (double)RNSeed / 100;
+    ReplicaLattice lattice(xDim, yDim, replicas, temp, options.getUInt("seed", 1));
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < init; i++)
+        lattice.sweep();
+
+    // Measure every 5 sweeps, as Metropolis does.
+    std::vector<double> energy, magnet;
+    std::vector<double> sumE(replicas, 0.0), sumE2(replicas, 0.0);
+    std::vector<double> sumM(replicas, 0.0), sumM2(replicas, 0.0), sumM4(replicas, 0.0);
+    for (unsigned int i = 0; i < sampleSize; i++) {
+        for (unsigned int j = 0; j < 5; j++)
+            lattice.sweep();
+        lattice.measure(energy, magnet);
+        for (unsigned int r = 0; r < replicas; r++) {
+            double m = fabs(magnet[r]);
+            sumE[r] += energy[r];
+            sumE2[r] += energy[r] * energy[r];
+            sumM[r] += m;
+            sumM2[r] += m * m;
+            sumM4[r] += m * m * m * m;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Observables of every chain, and their mean and standard error over the chains.
+    double beta = lattice.getBeta();
+    double size = lattice.getLatticeSize();
+    const char* names[5] = {"avgE", "avgMAbs", "c", "chi", "binder"};
+    std::vector<double> mean(5, 0.0), sqr(5, 0.0);
+    for (unsigned int r = 0; r < replicas; r++) {
+        double e = sumE[r] / sampleSize, e2 = sumE2[r] / sampleSize;
+        double m = sumM[r] / sampleSize, m2 = sumM2[r] / sampleSize, m4 = sumM4[r] / sampleSize;
+        double values[5] = {e, m, beta * beta * size * (e2 - e * e), beta * size * (m2 - m * m), 1 - m4 / (3 * m2 * m2)};
+
+        printf("%d,%d,%d,%d,%d,%f,%u", xDim, yDim, init, sampleSize, RNSeed, temp, r);
+        for (unsigned int k = 0; k < 5; k++) {
+            printf(",%lf", values[k]);
+            mean[k] += values[k];
+            sqr[k] += values[k] * values[k];
+        }
+        printf("\n");
+    }
+
+    for (unsigned int k = 0; k < 5; k++) {
+        mean[k] /= replicas;
+        double variance = (replicas > 1) ? (sqr[k] / replicas - mean[k] * mean[k]) * replicas / (replicas - 1) : 0.0;
+        fprintf(stderr, "replicas: %-8s %lf +- %lf\n", names[k], mean[k], sqrt(std::max(variance, 0.0) / replicas));
+    }
+    double updates = (double)(init + 5.0 * sampleSize) * size * replicas;
+    fprintf(stderr, "replicas: %u chains, %.3g site updates per second, %.3g ns per site update\n",
+            replicas, updates / seconds, seconds * 1e9 / updates);
+
+    return 0;
+}
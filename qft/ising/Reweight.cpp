@@ -0,0 +1,64 @@
+/* Reweight.cpp
+Combines the time series of a handful of Metropolis runs (written with
+--series) with multiple histogram reweighting and writes the observables on a
+fine temperature grid, errors included.
+
+Usage: ./Reweight Tmin Tmax points run-1.txt run-2.txt ... [options]
+Temperatures are in kT units, i.e. 2.2 rather than the 220 given to Metropolis.
+*/
+#include <cstdio>            // printf.
+#include <cstdlib>           // atoi, atof.
+#include <string>
+#include <vector>
+#include "Options.h"
+#include "Reweighting.h"
+
+
+int main(int argc, char** const argv) {
+    // The list of series has no fixed length, options start at the first "--" argument.
+    int first = 1;
+    while (first < argc && std::string(argv[first]).rfind("--", 0) != 0)
+        first++;
+
+    if (first < 5) {
+        fprintf(stderr, "Usage: %s Tmin Tmax points series-1.txt [series-2.txt ...] [options]\n", argv[0]);
+        fprintf(stderr, "Options:\n");
+        fprintf(stderr, "  --bins=16             jackknife blocks per run\n");
+        fprintf(stderr, "  --threads=0           worker threads (0 uses every core)\n");
+        fprintf(stderr, "  --tolerance=1e-10     convergence of the free energies\n");
+        fprintf(stderr, "  --iterations=100000   maximum number of self-consistency iterations\n");
+        fflush(stderr);
+        exit(1);
+    }
+
+    double tempMin = atof(argv[1]);
+    double tempMax = atof(argv[2]);
+    unsigned int points = atoi(argv[3]);
+    Options options(argc, argv, first);
+
+    std::vector<ReweightingRun> runs;
+    for (int i = 4; i < first; i++)
+        runs.push_back(readSeries(argv[i]));
+
+    MultiHistogram histogram(runs, options.getUInt("bins", 16), options.getUInt("threads", 0));
+    unsigned int iterations = histogram.solve(options.getDouble("tolerance", 1e-10), options.getUInt("iterations", 100000));
+
+    fprintf(stderr, "reweight: %zu runs converged after %u iterations\n", runs.size(), iterations);
+    for (size_t k = 0; k < runs.size(); k++)
+        fprintf(stderr, "reweight:   T=%f n=%zu lnZ=%f\n", runs[k].temp, runs[k].energy.size(), histogram.getLogZ()[k]);
+
+    std::vector<double> temps;
+    for (unsigned int i = 0; i < points; i++)
+        temps.push_back((points > 1) ? tempMin + (tempMax - tempMin) * i / (points - 1) : tempMin);
+
+    // Same column names as the notebooks use for the Metropolis output.
+    printf("T,avgE,stdE,avgMAbs,stdM,c,errC,m,errChi,binder,errBinder\n");
+    for (const ReweightedPoint& p : histogram.reweight(temps)) {
+        printf("%f,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf\n", p.temp,
+            p.energy, p.energyErr, p.magnetAbs, p.magnetAbsErr,
+            p.specificHeat, p.specificHeatErr, p.susceptibility, p.susceptibilityErr,
+            p.binder, p.binderErr);
+    }
+
+    return 0;
+}
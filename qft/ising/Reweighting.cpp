@@ -0,0 +1,314 @@
+/* Reweighting.cpp
+Ferrenberg-Swendsen multiple histogram reweighting (WHAM) of Ising runs.
+*/
+#include "Reweighting.h"
+#include "Columns.h"
+#include <algorithm>   // max, min.
+#include <cmath>       // exp, log, sqrt, fabs.
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <stdexcept>   // For std::runtime_error
+#include <thread>
+
+namespace {
+
+// LogSum accumulates ln(sum_i exp(x_i)) without overflowing.
+struct LogSum {
+    double max = -std::numeric_limits<double>::infinity();
+    double sum = 0.0;
+
+    void add(double x) {
+        if (x <= max) {
+            sum += std::exp(x - max);
+        } else {
+            sum = sum * std::exp(max - x) + 1.0;
+            max = x;
+        }
+    }
+    void merge(const LogSum& other) {
+        if (other.sum == 0.0)
+            return;
+        if (other.max <= max) {
+            sum += other.sum * std::exp(other.max - max);
+        } else {
+            sum = sum * std::exp(max - other.max) + other.sum;
+            max = other.max;
+        }
+    }
+    double value() const { return max + std::log(sum); }
+};
+
+// parallelFor splits [0, count) into one contiguous range per thread.
+void parallelFor(size_t count, unsigned int threads, const std::function<void(size_t, size_t, unsigned int)>& body) {
+    unsigned int used = (unsigned int)std::max<size_t>(1, std::min<size_t>(threads, count));
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < used; t++) {
+        pool.emplace_back(body, count * t / used, count * (t + 1) / used, t);
+    }
+    body(0, count / used, 0);
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+// Sums of the reweighted observables over a set of measurements.
+struct WeightedSums {
+    double w = 0, wE = 0, wE2 = 0, wM = 0, wM2 = 0, wM4 = 0;
+
+    void add(const WeightedSums& o, double sign) {
+        w += sign * o.w; wE += sign * o.wE; wE2 += sign * o.wE2;
+        wM += sign * o.wM; wM2 += sign * o.wM2; wM4 += sign * o.wM4;
+    }
+};
+
+const unsigned int numObservables = 5;
+
+// observables computes <e>, <|m|>, C, chi and the Binder cumulant from the sums.
+void observables(const WeightedSums& s, double beta, double latticeSize, double* out) {
+    double e = s.wE / s.w;
+    double e2 = s.wE2 / s.w;
+    double m = s.wM / s.w;
+    double m2 = s.wM2 / s.w;
+    double m4 = s.wM4 / s.w;
+
+    out[0] = e / latticeSize;
+    out[1] = m;
+    out[2] = beta * beta * (e2 - e * e) / latticeSize;
+    out[3] = beta * latticeSize * (m2 - m * m);
+    out[4] = 1 - m4 / (3 * m2 * m2);
+}
+
+}  // namespace
+
+
+MultiHistogram::MultiHistogram(const std::vector<ReweightingRun>& input, unsigned int nBins, unsigned int nThreads)
+    : runs(input.size()), bins(nBins), threads(nThreads) {
+    if (runs == 0) {
+        throw std::runtime_error("Reweighting needs at least one run");
+    }
+    if (bins == 0) {
+        bins = 1;
+    }
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    latticeSize = input[0].latticeSize;
+    for (unsigned int k = 0; k < runs; k++) {
+        const ReweightingRun& run = input[k];
+        if (run.latticeSize != latticeSize) {
+            throw std::runtime_error("All the reweighted runs must use the same lattice size");
+        }
+        if (run.energy.size() < bins || run.energy.size() != run.magnet.size()) {
+            throw std::runtime_error("Run at T=" + std::to_string(run.temp) + " has too few measurements");
+        }
+
+        beta.push_back(1.0 / run.temp);
+        logCounts.push_back(std::log((double)run.energy.size()));
+        size_t n = run.energy.size();
+        for (size_t t = 0; t < n; t++) {
+            energy.push_back(run.energy[t]);
+            magnet.push_back(std::fabs(run.magnet[t]));
+            block.push_back(k * bins + (unsigned int)(t * bins / n));
+        }
+    }
+
+    logZ.assign(runs, 0.0);
+    logDenominator.assign(energy.size(), 0.0);
+}
+
+void MultiHistogram::updateDenominators() {
+    parallelFor(energy.size(), threads, [&](size_t begin, size_t end, unsigned int) {
+        for (size_t s = begin; s < end; s++) {
+            LogSum denominator;
+            for (unsigned int j = 0; j < runs; j++) {
+                denominator.add(logCounts[j] - beta[j] * energy[s] - logZ[j]);
+            }
+            logDenominator[s] = denominator.value();
+        }
+    });
+}
+
+unsigned int MultiHistogram::solve(double tolerance, unsigned int maxIterations) {
+    std::vector<std::vector<LogSum>> partial(threads, std::vector<LogSum>(runs));
+
+    for (unsigned int iteration = 1; iteration <= maxIterations; iteration++) {
+        updateDenominators();
+
+        for (auto& sums : partial) {
+            std::fill(sums.begin(), sums.end(), LogSum());
+        }
+        parallelFor(energy.size(), threads, [&](size_t begin, size_t end, unsigned int t) {
+            for (unsigned int k = 0; k < runs; k++) {
+                LogSum& sum = partial[t][k];
+                for (size_t s = begin; s < end; s++) {
+                    sum.add(-beta[k] * energy[s] - logDenominator[s]);
+                }
+            }
+        });
+
+        std::vector<double> updated(runs);
+        for (unsigned int k = 0; k < runs; k++) {
+            LogSum total;
+            for (const auto& sums : partial) {
+                total.merge(sums[k]);
+            }
+            updated[k] = total.value();
+        }
+
+        // Only ratios of partition functions matter, so we fix Z of the first run to 1.
+        double change = 0.0;
+        for (unsigned int k = 0; k < runs; k++) {
+            updated[k] -= updated[0];
+            change = std::max(change, std::fabs(updated[k] - logZ[k]));
+        }
+        logZ = updated;
+        if (change < tolerance) {
+            updateDenominators();
+            return iteration;
+        }
+    }
+
+    updateDenominators();
+    throw std::runtime_error("The reweighting equations did not converge in " + std::to_string(maxIterations)
+        + " iterations, do the energy histograms of neighbouring runs overlap?");
+}
+
+ReweightedPoint MultiHistogram::reweightOne(double temp) const {
+    double b = 1.0 / temp;
+
+    // Shift every log-weight by the largest one before exponentiating.
+    double shift = -std::numeric_limits<double>::infinity();
+    for (size_t s = 0; s < energy.size(); s++) {
+        shift = std::max(shift, -b * energy[s] - logDenominator[s]);
+    }
+
+    unsigned int blocks = runs * bins;
+    std::vector<WeightedSums> perBlock(blocks);
+    WeightedSums total;
+    for (size_t s = 0; s < energy.size(); s++) {
+        double w = std::exp(-b * energy[s] - logDenominator[s] - shift);
+        double m2 = magnet[s] * magnet[s];
+        WeightedSums& sums = perBlock[block[s]];
+        sums.w += w;
+        sums.wE += w * energy[s];
+        sums.wE2 += w * energy[s] * energy[s];
+        sums.wM += w * magnet[s];
+        sums.wM2 += w * m2;
+        sums.wM4 += w * m2 * m2;
+    }
+    for (const auto& sums : perBlock) {
+        total.add(sums, 1.0);
+    }
+
+    double value[numObservables];
+    observables(total, b, latticeSize, value);
+
+    // Blocked jackknife, leaving out one block of one run at a time.
+    double mean[numObservables] = {0};
+    double sqrd[numObservables] = {0};
+    unsigned int used = 0;
+    for (const auto& sums : perBlock) {
+        WeightedSums leftOut = total;
+        leftOut.add(sums, -1.0);
+        if (leftOut.w <= 0) {
+            continue;
+        }
+        double estimate[numObservables];
+        observables(leftOut, b, latticeSize, estimate);
+        for (unsigned int i = 0; i < numObservables; i++) {
+            mean[i] += estimate[i];
+            sqrd[i] += estimate[i] * estimate[i];
+        }
+        used++;
+    }
+
+    double error[numObservables] = {0};
+    if (used > 1) {
+        for (unsigned int i = 0; i < numObservables; i++) {
+            mean[i] /= used;
+            double variance = sqrd[i] / used - mean[i] * mean[i];
+            error[i] = std::sqrt((used - 1) * std::max(0.0, variance));
+        }
+    }
+
+    ReweightedPoint point;
+    point.temp = temp;
+    point.energy = value[0];
+    point.energyErr = error[0];
+    point.magnetAbs = value[1];
+    point.magnetAbsErr = error[1];
+    point.specificHeat = value[2];
+    point.specificHeatErr = error[2];
+    point.susceptibility = value[3];
+    point.susceptibilityErr = error[3];
+    point.binder = value[4];
+    point.binderErr = error[4];
+    return point;
+}
+
+std::vector<ReweightedPoint> MultiHistogram::reweight(const std::vector<double>& temps) const {
+    std::vector<ReweightedPoint> points(temps.size());
+    parallelFor(temps.size(), threads, [&](size_t begin, size_t end, unsigned int) {
+        for (size_t i = begin; i < end; i++) {
+            points[i] = reweightOne(temps[i]);
+        }
+    });
+    return points;
+}
+
+ReweightingRun readSeries(const std::string& path) {
+    if (ColumnReader::isColumnar(path)) {
+        ColumnReader columns(path);
+        ReweightingRun run;
+        run.temp = columns.attribute("temp");
+        run.latticeSize = columns.attribute("latticeSize");
+        run.energy = columns.column("energy");
+        for (double& e : run.energy)
+            e *= run.latticeSize;
+        run.magnet = columns.column("magnetization");
+        return run;
+    }
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file for reading: " + path);
+    }
+
+    ReweightingRun run;
+    run.temp = 0;
+    run.latticeSize = 0;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::istringstream fields(line);
+        if (line[0] == '#') {
+            // Header, e.g. "# temp=2.200000 latticeSize=1024".
+            std::string token;
+            while (fields >> token) {
+                if (token.rfind("temp=", 0) == 0)
+                    run.temp = std::stod(token.substr(5));
+                else if (token.rfind("latticeSize=", 0) == 0)
+                    run.latticeSize = std::stoul(token.substr(12));
+            }
+            continue;
+        }
+
+        double e, m;
+        if (!(fields >> e >> m)) {
+            throw std::runtime_error("Malformed line in " + path + ": " + line);
+        }
+        run.energy.push_back(e * run.latticeSize);
+        run.magnet.push_back(m);
+    }
+
+    if (run.temp <= 0 || run.latticeSize == 0) {
+        throw std::runtime_error("Missing temp or latticeSize in the header of " + path);
+    }
+    return run;
+}
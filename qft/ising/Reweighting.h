@@ -0,0 +1,77 @@
+/* Reweighting.h
+Ferrenberg-Swendsen multiple histogram reweighting (WHAM) of Ising runs.
+
+Each run at inverse temperature beta_k contributes the total energy E and the
+magnetization per spin m of its measurements. The self-consistency equations
+
+    Z_k = sum_s exp(-beta_k E_s) / sum_j n_j exp(-beta_j E_s) / Z_j
+
+are solved for the partition functions of the runs, entirely in log-space so
+that lattices with E ~ 10^6 don't overflow. With the Z_k known, any inverse
+temperature in (and a little beyond) the range covered by the runs can be
+reweighted from all the measurements at once.
+
+Every measurement is treated as independent, so the runs should be sampled
+at intervals comparable to their autocorrelation times. Errors come from a
+blocked jackknife over consecutive blocks of each run, keeping the solved
+free energies fixed (this neglects their own, much smaller, fluctuations).
+*/
+#ifndef _REWEIGHTING_H
+#define _REWEIGHTING_H
+
+#include <string>
+#include <vector>
+
+
+struct ReweightingRun {
+    double temp;
+    unsigned int latticeSize;
+    std::vector<double> energy;  // Total energy of every measurement.
+    std::vector<double> magnet;  // Magnetization per spin of every measurement.
+};
+
+// ReweightedPoint holds the observables in the same units as the Metropolis output.
+struct ReweightedPoint {
+    double temp;
+    double energy, energyErr;                  // Per spin.
+    double magnetAbs, magnetAbsErr;            // Per spin.
+    double specificHeat, specificHeatErr;
+    double susceptibility, susceptibilityErr;
+    double binder, binderErr;
+};
+
+class MultiHistogram {
+    public:
+    // threads == 0 uses every core.
+    MultiHistogram(const std::vector<ReweightingRun>& runs, unsigned int bins, unsigned int threads);
+
+    // solve iterates the self-consistency equations, returns the number of iterations.
+    unsigned int solve(double tolerance, unsigned int maxIterations);
+    const std::vector<double>& getLogZ() const { return logZ; }
+
+    std::vector<ReweightedPoint> reweight(const std::vector<double>& temps) const;
+
+    private:
+    unsigned int runs;
+    unsigned int bins;  // Jackknife blocks per run.
+    unsigned int threads;
+    unsigned int latticeSize;
+
+    // All the measurements of all the runs, one after the other.
+    std::vector<double> energy;
+    std::vector<double> magnet;
+    std::vector<unsigned int> block;  // Global jackknife block of every measurement.
+
+    std::vector<double> beta;
+    std::vector<double> logCounts;    // ln n_k.
+    std::vector<double> logZ;
+    std::vector<double> logDenominator;  // ln sum_j n_j exp(-beta_j E_s) / Z_j for every measurement.
+
+    void updateDenominators();
+    ReweightedPoint reweightOne(double temp) const;
+};
+
+// readSeries loads a time series written by Metropolis --series, as text or columns.
+ReweightingRun readSeries(const std::string& path);
+
+#endif // _REWEIGHTING_H
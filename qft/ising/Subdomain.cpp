@@ -0,0 +1,125 @@
+/* Subdomain.cpp
+The part of an Ising lattice owned by one process of a decomposed run.
+*/
+#include "Subdomain.h"
+#include "Resampling.h"  // streamSeed.
+#include <algorithm>     // copy.
+#include <stdexcept>
+#include <string>
+#include <gsl/gsl_sf_exp.h>
+
+
+Subdomain::Subdomain(const std::vector<unsigned int>& dims, unsigned int r, HaloExchange* e,
+                     double temp, unsigned long seed)
+    : rank(r), exchange(e), dimensions(dims.size()) {
+    if (dimensions < 2 || dimensions > Lattice::maxDimensions)
+        throw std::runtime_error("Lattices must have between 2 and " + std::to_string(Lattice::maxDimensions) + " dimensions");
+
+    strides.resize(dimensions);
+    latticeSize = 1;
+    for (unsigned int d = 0; d < dimensions; d++) {
+        strides[d] = latticeSize;
+        latticeSize *= dims[d];
+    }
+    sliceSize = strides.back();
+
+    siteIndex slices = dims.back();
+    unsigned int strips = 2 * exchange->getProcesses();
+    if (slices < strips)
+        throw std::runtime_error("Decomposing into " + std::to_string(exchange->getProcesses()) +
+                                 " processes needs at least " + std::to_string(strips) + " slices along the last dimension");
+    siteIndex begin = (2 * rank) * slices / strips * sliceSize;
+    siteIndex middle = (2 * rank + 1) * slices / strips * sliceSize;
+    siteIndex end = (2 * rank + 2) * slices / strips * sliceSize;
+    blockSize = end - begin;
+    evenSize = middle - begin;
+
+    double beta = 1.0 / temp;
+    for (unsigned int k = 0; k < dimensions; k++)
+        exponentials[k] = gsl_sf_exp(-beta * 4 * (k + 1));
+
+    generator = gsl_rng_alloc(gsl_rng_mt19937);
+    gsl_rng_set(generator, streamSeed(seed, rank));
+
+    // A random start, then everyone fills in their halos.
+    spins.assign(blockSize + 2 * sliceSize, 1);
+    for (siteIndex i = sliceSize; i < sliceSize + blockSize; i++) {
+        if (gsl_rng_uniform(generator) < 0.5)
+            spins[i] = -1;
+    }
+    publish(true);
+    publish(false);
+    exchange->wait();
+    receive(true);
+    receive(false);
+    // Nobody publishes again before everyone has their halos.
+    exchange->wait();
+}
+
+Subdomain::~Subdomain() {
+    gsl_rng_free(generator);
+}
+
+void Subdomain::publish(bool firstSlice) {
+    if (firstSlice)
+        std::copy(spins.begin() + sliceSize, spins.begin() + 2 * sliceSize, exchange->first(rank));
+    else
+        std::copy(spins.begin() + blockSize, spins.begin() + blockSize + sliceSize, exchange->last(rank));
+}
+
+void Subdomain::receive(bool upperHalo) {
+    unsigned int processes = exchange->getProcesses();
+    if (upperHalo) {
+        const std::int8_t* next = exchange->first((rank + 1) % processes);
+        std::copy(next, next + sliceSize, spins.begin() + sliceSize + blockSize);
+    } else {
+        const std::int8_t* previous = exchange->last((rank + processes - 1) % processes);
+        std::copy(previous, previous + sliceSize, spins.begin());
+    }
+}
+
+// The halos make every neighbour of the block a plain offset, there is no wrapping.
+unsigned long long Subdomain::update(siteIndex begin, siteIndex end) {
+    unsigned long long flips = 0;
+    for (siteIndex i = begin; i < end; i++) {
+        int sum = 0;
+        for (unsigned int d = 0; d < dimensions; d++)
+            sum += spins[i + strides[d]] + spins[i - strides[d]];
+
+        // As in Lattice::metropolis, the energy after the flip decides.
+        int finalE = spins[i] * sum;
+        if (finalE <= 0 || gsl_rng_uniform(generator) < exponentials[finalE / 2 - 1]) {
+            spins[i] = -spins[i];
+            flips++;
+        }
+    }
+    return flips;
+}
+
+unsigned long long Subdomain::sweep() {
+    unsigned long long flips = update(sliceSize, sliceSize + evenSize);
+    publish(true);
+    exchange->wait();
+    receive(true);
+
+    flips += update(sliceSize + evenSize, sliceSize + blockSize);
+    publish(false);
+    exchange->wait();
+    receive(false);
+    return flips;
+}
+
+// Both halos are up to date after a sweep, so every process can count its bonds to the next sites.
+void Subdomain::measure(double& energy, double& magnet) {
+    double sums[2] = {0.0, 0.0};
+    for (siteIndex i = sliceSize; i < sliceSize + blockSize; i++) {
+        int next = 0;
+        for (unsigned int d = 0; d < dimensions; d++)
+            next += spins[i + strides[d]];
+        sums[0] -= spins[i] * next;
+        sums[1] += spins[i];
+    }
+    exchange->sum(rank, sums, 2);
+    energy = sums[0] / latticeSize;
+    magnet = sums[1] / latticeSize;
+}
@@ -0,0 +1,66 @@
+/* Subdomain.h
+The part of an Ising lattice owned by one process of a decomposed run.
+
+The lattice is cut along its last dimension into two strips per process, as in
+StripSweeper, and subdomain r owns strips 2r and 2r + 1. Around them it keeps a
+halo of one slice on either side with copies of the boundary slices of the
+neighbouring subdomains. No neighbour of the block is more than a slice away,
+also across the helical boundary, so the halos are all a sweep needs.
+
+A sweep updates the even strip, publishes its first slice, waits for everyone
+and copies the first slice of the next subdomain into the upper halo. Then it
+updates the odd strip, publishes its last slice, waits, and copies the last
+slice of the previous subdomain into the lower halo. Neighbouring strips are
+never updated at the same time, so this is the same dynamics as StripSweeper.
+*/
+#ifndef _SUBDOMAIN_H
+#define _SUBDOMAIN_H
+
+#include "HaloExchange.h"
+#include "Lattice.h"  // siteIndex, maxDimensions.
+#include <cstdint>
+#include <vector>
+#include <gsl/gsl_rng.h>
+
+
+class Subdomain {
+    public:
+    Subdomain(const std::vector<unsigned int>& dims, unsigned int rank, HaloExchange* exchange,
+              double temp, unsigned long seed);
+    ~Subdomain();
+
+    Subdomain(const Subdomain&) = delete;
+    Subdomain& operator=(const Subdomain&) = delete;
+
+    // sweep returns the number of flipped spins of this subdomain.
+    unsigned long long sweep();
+
+    // measure returns the energy and magnetization per site of the whole lattice,
+    // every process has to call it and gets the same values.
+    void measure(double& energy, double& magnet);
+
+    siteIndex getLatticeSize() const { return latticeSize; }
+    siteIndex getBlockSize() const { return blockSize; }
+
+    private:
+    unsigned int rank;
+    HaloExchange* exchange;
+    unsigned int dimensions;
+    std::vector<siteIndex> strides;
+    siteIndex latticeSize;
+    siteIndex sliceSize;
+    siteIndex blockSize;
+    siteIndex evenSize;  // Sites in the even strip, the odd one follows it.
+
+    // The lower halo, the block and the upper halo, one byte per spin.
+    std::vector<std::int8_t> spins;
+    double exponentials[Lattice::maxDimensions];  // exp(-4 beta k) for k = 1, ..., dimensions.
+    gsl_rng* generator;
+
+    // update performs a metropolis step on the sites in [begin, end) of spins.
+    unsigned long long update(siteIndex begin, siteIndex end);
+    void publish(bool firstSlice);
+    void receive(bool upperHalo);
+};
+
+#endif // _SUBDOMAIN_H
@@ -0,0 +1,205 @@
+/* Trajectory.cpp
+A compact record of the spins of a run for studying its dynamics.
+*/
+#include "Trajectory.h"
+#include <algorithm>  // max.
+#include <cstring>    // memcmp.
+#include <stdexcept>  // runtime_error.
+
+
+static const char magic[8] = {'I', 'S', 'I', 'N', 'G', 'T', 'R', 'J'};
+static const std::uint32_t version = 1;
+
+static void putVarint(std::vector<std::uint8_t>& out, std::uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((std::uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((std::uint8_t)value);
+}
+
+static std::uint64_t getVarint(const std::uint8_t*& in, const std::uint8_t* end) {
+    std::uint64_t value = 0;
+    for (unsigned int shift = 0; in < end && shift < 64; shift += 7) {
+        std::uint8_t byte = *in++;
+        value |= (std::uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    throw std::runtime_error("Corrupt trajectory delta");
+}
+
+template <typename T>
+static void put(std::ofstream& file, T value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template <typename T>
+static T get(std::ifstream& file) {
+    T value;
+    file.read(reinterpret_cast<char*>(&value), sizeof(value));
+    return value;
+}
+
+
+TrajectoryWriter::TrajectoryWriter(const std::filesystem::path& path, const std::vector<unsigned int>& dims,
+                                   unsigned int interval)
+    : file(path, std::ios::binary), latticeSize(1), keyframeInterval(std::max(1u, interval)), sinceKeyframe(0),
+      bytes(0), records(0), keyframes(0) {
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file for writing: " + path.string());
+    for (unsigned int size : dims)
+        latticeSize *= size;
+
+    file.write(magic, sizeof(magic));
+    put<std::uint32_t>(file, version);
+    put<std::uint32_t>(file, dims.size());
+    for (unsigned int size : dims)
+        put<std::uint32_t>(file, size);
+    bytes = file.tellp();
+}
+
+void TrajectoryWriter::write(char type, unsigned long long sweep) {
+    file.put(type);
+    put<std::uint64_t>(file, sweep);
+    put<std::uint64_t>(file, payload.size());
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+    if (!file)
+        throw std::runtime_error("Failed to write the trajectory");
+    bytes += 1 + 2 * sizeof(std::uint64_t) + payload.size();
+    records++;
+}
+
+void TrajectoryWriter::record(unsigned long long sweep, const MappedArray<std::int8_t>& spins) {
+    siteIndex keyframeBytes = (latticeSize + 7) / 8;
+
+    bool keyframe = previous.empty() || sinceKeyframe + 1 >= keyframeInterval;
+    if (!keyframe) {
+        payload.clear();
+        siteIndex last = 0;
+        for (siteIndex i = 0; i < latticeSize; i++) {
+            if (spins[i] != previous[i]) {
+                putVarint(payload, i - last);
+                last = i;
+                previous[i] = spins[i];
+            }
+        }
+        // At high temperatures most spins change, the bits are then cheaper.
+        keyframe = payload.size() >= keyframeBytes;
+    }
+
+    if (keyframe) {
+        payload.assign(keyframeBytes, 0);
+        for (siteIndex i = 0; i < latticeSize; i++) {
+            if (spins[i] == 1)
+                payload[i / 8] |= 1 << (i % 8);
+        }
+        previous.assign(spins.begin(), spins.end());
+        write('K', sweep);
+        sinceKeyframe = 0;
+        keyframes++;
+    } else {
+        write('D', sweep);
+        sinceKeyframe++;
+    }
+}
+
+
+TrajectoryReader::TrajectoryReader(const std::filesystem::path& path)
+    : file(path, std::ios::binary), name(path.string()), latticeSize(1), loaded(0), loadedInto(nullptr) {
+    if (!file.is_open())
+        throw std::runtime_error("Failed to open file for reading: " + name);
+
+    char header[sizeof(magic)];
+    file.read(header, sizeof(header));
+    if (!file || std::memcmp(header, magic, sizeof(magic)) != 0 || get<std::uint32_t>(file) != version)
+        throw std::runtime_error(name + " is not a trajectory");
+    std::uint32_t dimensions = get<std::uint32_t>(file);
+    for (std::uint32_t d = 0; d < dimensions; d++) {
+        dims.push_back(get<std::uint32_t>(file));
+        latticeSize *= dims.back();
+    }
+
+    // The index only holds the headers, the payloads are skipped. A truncated last record,
+    // e.g. of a run that was killed, is left out.
+    std::streamoff end = file.seekg(0, std::ios::end).tellg();
+    file.seekg(sizeof(magic) + (2 + dimensions) * sizeof(std::uint32_t));
+    while (true) {
+        Entry entry;
+        entry.type = file.get();
+        entry.sweep = get<std::uint64_t>(file);
+        entry.bytes = get<std::uint64_t>(file);
+        if (!file)
+            break;
+        entry.offset = file.tellg();
+        if (entry.offset + (std::streamoff)entry.bytes > end)
+            break;
+        if (entry.type != 'K' && entry.type != 'D')
+            throw std::runtime_error(name + " has a corrupt record after sweep " +
+                                     (entries.empty() ? std::string("0") : std::to_string(entries.back().sweep)));
+        if (entries.empty() && entry.type != 'K')
+            throw std::runtime_error(name + " doesn't start with a keyframe");
+        entries.push_back(entry);
+        file.seekg(entry.bytes, std::ios::cur);
+    }
+    file.clear();
+    loaded = entries.size();
+}
+
+void TrajectoryReader::apply(std::size_t record, std::vector<std::int8_t>& spins) {
+    const Entry& entry = entries[record];
+    payload.resize(entry.bytes);
+    file.seekg(entry.offset);
+    file.read(reinterpret_cast<char*>(payload.data()), entry.bytes);
+    if (!file)
+        throw std::runtime_error("Failed to read " + name);
+
+    if (entry.type == 'K') {
+        spins.resize(latticeSize);
+        for (siteIndex i = 0; i < latticeSize; i++)
+            spins[i] = (payload[i / 8] >> (i % 8) & 1) ? 1 : -1;
+    } else {
+        const std::uint8_t* in = payload.data();
+        const std::uint8_t* end = in + payload.size();
+        siteIndex site = 0;
+        while (in < end) {
+            site += getVarint(in, end);
+            if (site >= latticeSize)
+                throw std::runtime_error("Corrupt trajectory delta at sweep " + std::to_string(entry.sweep));
+            spins[site] = -spins[site];
+        }
+    }
+}
+
+void TrajectoryReader::load(std::size_t record, std::vector<std::int8_t>& spins) {
+    if (record >= entries.size())
+        throw std::runtime_error(name + " has only " + std::to_string(entries.size()) + " records");
+
+    std::size_t keyframe = record;
+    while (entries[keyframe].type != 'K')
+        keyframe--;
+    // Carry on from the last record loaded into spins if it lies between the keyframe and this one.
+    std::size_t first = keyframe;
+    if (&spins == loadedInto && loaded < entries.size() && loaded >= keyframe && loaded <= record)
+        first = loaded + 1;
+    for (std::size_t r = first; r <= record; r++)
+        apply(r, spins);
+    loaded = record;
+    loadedInto = &spins;
+}
+
+std::size_t TrajectoryReader::seek(unsigned long long sweep, std::vector<std::int8_t>& spins) {
+    if (entries.empty() || entries.front().sweep > sweep)
+        throw std::runtime_error(name + " has no record at or before sweep " + std::to_string(sweep));
+    // The sweeps only ever grow, so the records can be bisected.
+    std::size_t low = 0, high = entries.size();
+    while (high - low > 1) {
+        std::size_t middle = (low + high) / 2;
+        if (entries[middle].sweep <= sweep)
+            low = middle;
+        else
+            high = middle;
+    }
+    load(low, spins);
+    return low;
+}
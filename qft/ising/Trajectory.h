@@ -0,0 +1,92 @@
+/* Trajectory.h
+A compact record of the spins of a run for studying its dynamics.
+
+TrajectoryWriter stores the spins after every recorded sweep. Most of them are
+deltas: the sites that changed since the previous record, which is every spin a
+metropolis step flipped or every site of the flipped clusters, minus those that
+flipped back. The indices are sorted and written as LEB128 varints of the gaps
+between them, so a delta costs a byte or two per changed site. Every
+keyframeInterval records, and whenever a delta would be larger, a keyframe
+with all spins packed in bits is written instead.
+
+TrajectoryReader indexes the records on opening and replays the spins at any
+sweep from the nearest keyframe before it. Stepping forwards continues from
+the record loaded last instead of going back to the keyframe.
+
+The file starts with "ISINGTRJ", a version, the number of dimensions and their
+sizes. Every record is a type byte ('K' or 'D'), the sweep and the size of the
+payload in bytes. Integers are stored in the byte order of the machine.
+*/
+#ifndef _TRAJECTORY_H
+#define _TRAJECTORY_H
+
+#include "SiteStorage.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+class TrajectoryWriter {
+    public:
+    TrajectoryWriter(const std::filesystem::path& path, const std::vector<unsigned int>& dims,
+                     unsigned int keyframeInterval = 100);
+
+    // record stores the spins after the given number of sweeps, the first record is a keyframe.
+    void record(unsigned long long sweep, const MappedArray<std::int8_t>& spins);
+
+    unsigned long long getBytes() const { return bytes; }
+    unsigned long long getRecords() const { return records; }
+    unsigned long long getKeyframes() const { return keyframes; }
+
+    private:
+    std::ofstream file;
+    siteIndex latticeSize;
+    unsigned int keyframeInterval;
+    unsigned int sinceKeyframe;
+    std::vector<std::int8_t> previous;
+    std::vector<std::uint8_t> payload;
+    unsigned long long bytes;
+    unsigned long long records;
+    unsigned long long keyframes;
+
+    void write(char type, unsigned long long sweep);
+};
+
+class TrajectoryReader {
+    public:
+    explicit TrajectoryReader(const std::filesystem::path& path);
+
+    const std::vector<unsigned int>& getDims() const { return dims; }
+    siteIndex getLatticeSize() const { return latticeSize; }
+    std::size_t getRecords() const { return entries.size(); }
+    unsigned long long getSweep(std::size_t record) const { return entries[record].sweep; }
+
+    // load sets spins to those of record number record.
+    void load(std::size_t record, std::vector<std::int8_t>& spins);
+
+    // seek loads the last record at or before sweep and returns its number.
+    std::size_t seek(unsigned long long sweep, std::vector<std::int8_t>& spins);
+
+    private:
+    struct Entry {
+        char type;
+        unsigned long long sweep;
+        std::streamoff offset;  // Of the payload.
+        std::uint64_t bytes;
+    };
+
+    std::ifstream file;
+    std::string name;
+    std::vector<unsigned int> dims;
+    siteIndex latticeSize;
+    std::vector<Entry> entries;
+    std::vector<std::uint8_t> payload;
+    std::size_t loaded;  // The record given to load last, entries.size() if none.
+    const std::vector<std::int8_t>* loadedInto;
+
+    void apply(std::size_t record, std::vector<std::int8_t>& spins);
+};
+
+#endif // _TRAJECTORY_H
@@ -0,0 +1,348 @@
+/* TransferMatrix.cpp
+Exact observables of Ising strips from their transfer matrix, applied a site at a time.
+*/
+#include "TransferMatrix.h"
+#include <algorithm>   // max, min, swap.
+#include <atomic>
+#include <cmath>       // exp, log, fabs.
+#include <condition_variable>
+#include <limits>
+#include <mutex>
+#include <stdexcept>   // For std::runtime_error
+#include <thread>
+
+namespace {
+
+// Barrier holds the threads of the infinite strip between the factors.
+class Barrier {
+    public:
+    explicit Barrier(unsigned int parties) : count(parties), waiting(0), generation(0) {}
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        unsigned long long arrived = generation;
+        if (++waiting == count) {
+            waiting = 0;
+            generation++;
+            condition.notify_all();
+        } else {
+            condition.wait(lock, [&]() { return generation != arrived; });
+        }
+    }
+
+    private:
+    unsigned int count;
+    unsigned int waiting;
+    unsigned long long generation;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
+
+// Rows the infinite strip may take to converge, and how close the growth of two rows must be.
+const unsigned int maxRows = 100000;
+const double rowTolerance = 1e-13;
+// The cumulants grow over blocks of rows until the growth of two blocks agrees to
+// blockTolerance, for at most maxBlocks blocks.
+const unsigned int maxBlocks = 16;
+const double blockTolerance = 1e-9;
+
+// Beyond this the 2^L start windows of a finite lattice take too long.
+const unsigned int maxFiniteWidth = 16;
+const unsigned int maxWidth = 24;
+
+}
+
+StripBoundary parseBoundary(const std::string& name) {
+    if (name == "helical")
+        return StripBoundary::helical;
+    if (name == "torus")
+        return StripBoundary::torus;
+    throw std::runtime_error("Unknown boundary " + name + ", expected helical or torus");
+}
+
+TransferMatrix::TransferMatrix(unsigned int stripWidth, StripBoundary stripBoundary, unsigned int nThreads)
+    : width(stripWidth), boundary(stripBoundary), threads(nThreads), iterations(0) {
+    if (width < 2 || width > maxWidth)
+        throw std::runtime_error("The width of the strip must be between 2 and " + std::to_string(maxWidth));
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    states = std::size_t(1) << width;
+}
+
+ExactResult TransferMatrix::solve(double temp, unsigned int length) {
+    if (temp <= 0)
+        throw std::runtime_error("The temperature must be positive");
+    double beta = 1.0 / temp;
+    for (int h = -3; h <= 3; h++)
+        boltzmann[h + 3] = std::exp(beta * h);
+    return (length == 0) ? solveInfinite(temp) : solveFinite(temp, length);
+}
+
+/* The window before site i holds spin i - 1 - k in bit k, a set bit being an up spin. Laying
+down spin s gives the window w' = (w << 1 | s) modulo 2^L, so window w' = 2j + s comes from
+j and j + 2^(L-1), which differ in the spin i - L that dropped out. The new spin couples to
+that one, to spin i - 1 (bit 0 of j) and on the last column of a torus to spin i - L + 1
+(bit L - 2 of j). With g = s h, s the new spin and h the sum of the ones it couples to, the
+factor is exp(beta g) and the site adds -g to the energy and s to the magnetization.
+*/
+double TransferMatrix::apply(const Weights& in, Weights& out, unsigned int column, double scale,
+                             std::size_t begin, std::size_t end, bool withMoments) const {
+    std::size_t half = states / 2;
+    bool left = boundary == StripBoundary::helical || column > 0;
+    bool wrap = boundary == StripBoundary::torus && column == width - 1;
+    const double* v = in[0].data();
+    double* nv = out[0].data();
+    double largest = 0;
+
+    for (std::size_t w = begin; w < end; w++) {
+        int spin = (w & 1) ? 1 : -1;
+        std::size_t j = w >> 1;
+        int h = (left ? (int)(j & 1) * 2 - 1 : 0) + (wrap ? (int)((j >> (width - 2)) & 1) * 2 - 1 : 0);
+        // Dropping a down spin from j, or an up spin from j + half.
+        int g0 = spin * (h - 1);
+        int g1 = spin * (h + 1);
+        double w0 = boltzmann[g0 + 3] * scale;
+        double w1 = boltzmann[g1 + 3] * scale;
+        nv[w] = w0 * v[j] + w1 * v[j + half];
+        largest = std::max(largest, nv[w]);
+        if (!withMoments)
+            continue;
+
+        const std::size_t p[2] = {j, j + half};
+        const double weight[2] = {w0, w1};
+        const double e[2] = {(double)-g0, (double)-g1};
+        double s = spin;
+        double sums[moments - 1] = {0, 0, 0, 0, 0, 0};
+        for (int t = 0; t < 2; t++) {
+            double v0 = v[p[t]];
+            double e1 = in[1][p[t]], e2 = in[2][p[t]];
+            double m1 = in[3][p[t]], m2 = in[4][p[t]], m3 = in[5][p[t]], m4 = in[6][p[t]];
+            // (X + x)^n expanded, s^2 = 1.
+            sums[0] += weight[t] * (e1 + e[t] * v0);
+            sums[1] += weight[t] * (e2 + 2 * e[t] * e1 + e[t] * e[t] * v0);
+            sums[2] += weight[t] * (m1 + s * v0);
+            sums[3] += weight[t] * (m2 + 2 * s * m1 + v0);
+            sums[4] += weight[t] * (m3 + 3 * s * m2 + 3 * m1 + s * v0);
+            sums[5] += weight[t] * (m4 + 4 * s * m3 + 6 * m2 + 4 * s * m1 + v0);
+        }
+        for (unsigned int m = 1; m < moments; m++)
+            out[m][w] = sums[m - 1];
+    }
+    return largest;
+}
+
+// The trace from a start window equals the trace from its flip, with the odd moments of M
+// negated, so only the windows with a down spin in bit L - 1 are started from.
+ExactResult TransferMatrix::solveFinite(double temp, unsigned int length) {
+    if (width > maxFiniteWidth)
+        throw std::runtime_error("Finite lattices wider than " + std::to_string(maxFiniteWidth) + " take too long, use the infinite strip");
+
+    struct Trace {
+        double logScale;
+        double sums[moments];
+    };
+    std::size_t sites = (std::size_t)width * length;
+    std::size_t starts = states / 2;
+    std::vector<Trace> traces(starts);
+    std::atomic<std::size_t> next(0);
+
+    auto work = [&]() {
+        Weights a, b;
+        for (unsigned int m = 0; m < moments; m++) {
+            a[m].resize(states);
+            b[m].resize(states);
+        }
+        for (std::size_t start; (start = next++) < starts;) {
+            for (unsigned int m = 0; m < moments; m++)
+                std::fill(a[m].begin(), a[m].end(), 0.0);
+            a[0][start] = 1;
+
+            Weights* in = &a;
+            Weights* out = &b;
+            double scale = 1, logScale = 0;
+            for (std::size_t i = 0; i < sites; i++) {
+                logScale -= std::log(scale);
+                scale = 1 / apply(*in, *out, i % width, scale, 0, states, true);
+                std::swap(in, out);
+            }
+            traces[start].logScale = logScale;
+            for (unsigned int m = 0; m < moments; m++)
+                traces[start].sums[m] = (*in)[m][start];
+        }
+    };
+
+    unsigned int used = (unsigned int)std::min<std::size_t>(threads, starts);
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < used; t++)
+        pool.emplace_back(work);
+    work();
+    for (auto& thread : pool)
+        thread.join();
+
+    double reference = -std::numeric_limits<double>::infinity();
+    for (const Trace& trace : traces)
+        reference = std::max(reference, trace.logScale);
+    double sums[moments] = {0, 0, 0, 0, 0, 0, 0};
+    for (const Trace& trace : traces) {
+        double factor = std::exp(trace.logScale - reference);
+        for (unsigned int m = 0; m < moments; m++)
+            sums[m] += factor * trace.sums[m];
+    }
+
+    double n = (double)sites;
+    double beta = 1.0 / temp;
+    double e = sums[1] / sums[0], e2 = sums[2] / sums[0];
+    double m2 = sums[4] / sums[0] / (n * n);
+    double m4 = sums[6] / sums[0] / (n * n * n * n);
+
+    ExactResult result;
+    result.temp = temp;
+    // The flipped starts double Z, their odd moments cancel.
+    result.freeEnergy = -temp * (reference + std::log(2 * sums[0])) / n;
+    result.energy = e / n;
+    result.specificHeat = beta * beta * (e2 - e * e) / n;
+    result.magnetSqrd = m2;
+    result.magnetQuart = m4;
+    result.susceptibility = beta * n * m2;
+    result.binder = 1 - m4 / (3 * m2 * m2);
+    return result;
+}
+
+/* The weights start flat, which keeps them symmetric under a flip of every spin, and are
+power iterated a row at a time until the growth of a row, the dominant eigenvalue, settles.
+The moments then start from zero. The cumulants of E and M over the n sites laid down are n
+times their densities plus a boundary term that converges like the eigenvectors, so the
+densities are the growth of the cumulants over a block of rows, once it stops changing from
+block to block. E only needs the eigenvectors symmetric under the flip and converges about as
+fast as the eigenvalue. M couples to the antisymmetric ones, which below the critical
+temperature are nearly as large, so the susceptibility can take far more rows and is left
+NaN if it hasn't settled after maxBlocks blocks.
+*/
+ExactResult TransferMatrix::solveInfinite(double temp) {
+    // Threads only pay off once a factor has enough windows to split.
+    unsigned int used = (unsigned int)std::max<std::size_t>(1, std::min<std::size_t>(threads, states / 4096));
+    Weights a, b;
+    for (unsigned int m = 0; m < moments; m++) {
+        a[m].assign(states, (m == 0) ? 1.0 : 0.0);
+        b[m].resize(states);
+    }
+
+    Barrier barrier(used);
+    std::vector<double> largest[2] = {std::vector<double>(used), std::vector<double>(used)};
+    std::vector<std::vector<double>> partialSums(used, std::vector<double>(5));
+    double logRow = 0;
+    bool converged = false, susceptibilityConverged = false;
+    unsigned int power = 0;
+    double density[3];    // Of <E>, <E^2> - <E>^2 and <M^2> - <M>^2, per site.
+
+    auto work = [&](unsigned int worker) {
+        std::size_t begin = states * worker / used;
+        std::size_t end = states * (worker + 1) / used;
+        Weights* in = &a;
+        Weights* out = &b;
+        double scale = 1;
+        int parity = 0;
+
+        // layRow applies the factors of a row and returns the log of its growth.
+        auto layRow = [&](bool withMoments) {
+            double growth = 0;
+            for (unsigned int column = 0; column < width; column++) {
+                largest[parity][worker] = apply(*in, *out, column, scale, begin, end, withMoments);
+                barrier.wait();
+                double top = 0;
+                for (double value : largest[parity])
+                    top = std::max(top, value);
+                scale = 1 / top;
+                growth += std::log(top);
+                std::swap(in, out);
+                parity ^= 1;
+            }
+            return growth;
+        };
+        // cumulate computes the cumulants of the sites laid down so far. The partial sums
+        // are only written again after the next rows, when every thread has read them.
+        auto cumulate = [&](double* cumulants) {
+            for (unsigned int m = 0; m < 5; m++) {
+                double sum = 0;
+                for (std::size_t w = begin; w < end; w++)
+                    sum += (*in)[m][w];
+                partialSums[worker][m] = sum;
+            }
+            barrier.wait();
+            double sums[5] = {0, 0, 0, 0, 0};
+            for (const auto& partial : partialSums)
+                for (unsigned int m = 0; m < 5; m++)
+                    sums[m] += partial[m];
+            double e = sums[1] / sums[0], m1 = sums[3] / sums[0];
+            cumulants[0] = e;
+            cumulants[1] = sums[2] / sums[0] - e * e;
+            cumulants[2] = sums[4] / sums[0] - m1 * m1;
+        };
+
+        double previous = layRow(false);
+        unsigned int count = 1, settled = 0;
+        while (settled < 2 && count < maxRows) {
+            double growth = layRow(false);
+            count++;
+            settled = (std::fabs(growth - previous) <= rowTolerance * std::max(1.0, std::fabs(growth))) ? settled + 1 : 0;
+            previous = growth;
+        }
+
+        for (unsigned int m = 1; m < moments; m++)
+            std::fill((*in)[m].begin() + begin, (*in)[m].begin() + end, 0.0);
+        barrier.wait();
+        unsigned int block = std::max(count, 8u);
+        double before[3], after[3], growth[3], last[3];
+        bool done[3] = {false, false, false};
+        for (unsigned int r = 0; r < block; r++)
+            layRow(true);
+        cumulate(before);
+        for (unsigned int blocks = 1; blocks <= maxBlocks && !(done[0] && done[1] && done[2]); blocks++) {
+            for (unsigned int r = 0; r < block; r++)
+                layRow(true);
+            cumulate(after);
+            // A settled density is kept, later blocks only add rounding errors to it.
+            for (unsigned int q = 0; q < 3; q++) {
+                if (done[q])
+                    continue;
+                growth[q] = (after[q] - before[q]) / ((double)block * width);
+                done[q] = blocks > 1 && std::fabs(growth[q] - last[q]) <= blockTolerance * std::max(1.0, std::fabs(growth[q]));
+                last[q] = growth[q];
+                before[q] = after[q];
+            }
+        }
+
+        if (worker == 0) {
+            logRow = previous;
+            converged = settled == 2 && done[0] && done[1];
+            susceptibilityConverged = done[2];
+            power = count;
+            for (unsigned int q = 0; q < 3; q++)
+                density[q] = growth[q];
+        }
+    };
+
+    // Every thread takes the same decisions from the same maxima and sums, so they all stop
+    // together and none is left waiting at the barrier.
+    std::vector<std::thread> pool;
+    for (unsigned int t = 1; t < used; t++)
+        pool.emplace_back(work, t);
+    work(0);
+    for (auto& thread : pool)
+        thread.join();
+    iterations = power;
+    if (!converged)
+        throw std::runtime_error("The infinite strip did not converge at T=" + std::to_string(temp));
+
+    double beta = 1.0 / temp;
+    ExactResult result;
+    result.temp = temp;
+    result.freeEnergy = -temp * logRow / width;
+    result.energy = density[0];
+    result.specificHeat = beta * beta * density[1];
+    result.magnetSqrd = 0;
+    result.magnetQuart = 0;
+    result.susceptibility = susceptibilityConverged ? beta * density[2] : std::numeric_limits<double>::quiet_NaN();
+    result.binder = std::numeric_limits<double>::quiet_NaN();
+    return result;
+}
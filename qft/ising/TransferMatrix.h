@@ -0,0 +1,87 @@
+/* TransferMatrix.h
+Exact observables of Ising strips of width L, the reference new engines are checked against.
+
+The state is the window of the last L spins laid down, 2^L weights. Laying down the next
+spin is a sparse factor: every new window has two predecessors, the windows that differ in
+the spin dropping out of it. Spin i of the window couples to spin i - 1 and spin i - L, so
+L sites apply the transfer matrix of a row, without ever building it.
+
+Two boundaries are solved:
+    helical  site i neighbours i +- 1 and i +- L modulo the size, the lattice of Metropolis
+             with xDim = L, so its results compare with the simulations directly.
+    torus    rows of L sites closed on themselves, the last site of a row also couples to the
+             first one. The window still holds it, only the factor of that column changes.
+
+An L x M lattice is the trace of the matrix to the power L M, taken from every start window.
+Alongside the weights the sums weighted by E, E^2 and M to M^4 are carried through the
+factors, which gives the moments exactly without differentiating. The work grows as
+4^L L M, so finite lattices are practical up to L ~ 12. The infinite strip, M = 0 below,
+power iterates the weights to the dominant eigenvector and takes the free energy from its
+eigenvalue, and the energy, specific heat and susceptibility per spin from the growth rates
+of the cumulants. It handles L up to ~ 20. Below the critical temperature the susceptibility
+of the strip is too large to converge and comes out NaN.
+
+The finite traces split the start windows between threads, the infinite strip splits the
+windows of every factor between them. Temperatures are in kT units.
+*/
+#ifndef _TRANSFER_MATRIX_H
+#define _TRANSFER_MATRIX_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+enum class StripBoundary { helical, torus };
+
+StripBoundary parseBoundary(const std::string& name);
+
+// ExactResult holds the observables per spin, as in the Metropolis output. On the infinite
+// strip the magnetization moments vanish, only the susceptibility is left.
+struct ExactResult {
+    double temp;
+    double freeEnergy;      // -kT ln Z / N.
+    double energy;
+    double specificHeat;
+    double magnetSqrd;      // <m^2>.
+    double magnetQuart;     // <m^4>.
+    double susceptibility;  // beta N <m^2>, <m> = 0 without a field.
+    double binder;          // 1 - <m^4> / 3 <m^2>^2.
+};
+
+class TransferMatrix {
+    public:
+    // threads = 0 uses every core.
+    TransferMatrix(unsigned int width, StripBoundary boundary, unsigned int threads);
+
+    // solve returns the observables of the width x length lattice, length = 0 for the
+    // infinite strip.
+    ExactResult solve(double temp, unsigned int length);
+
+    unsigned int getWidth() const { return width; }
+    // Rows the last infinite strip took to converge.
+    unsigned int getIterations() const { return iterations; }
+
+    private:
+    // The weights of the windows followed by their sums weighted by E, E^2, M, ..., M^4.
+    static const unsigned int moments = 7;
+    typedef std::vector<double> Weights[moments];
+
+    unsigned int width;
+    StripBoundary boundary;
+    unsigned int threads;
+    std::size_t states;
+    unsigned int iterations;
+    double boltzmann[7];    // exp(beta h) for a spin times its neighbour sum h = -3 ... 3.
+
+    // apply lays down the spin of the given column, computing the new windows [begin, end)
+    // from all of in, scaled by scale. It returns the largest new weight. Without moments
+    // only the weights are updated.
+    double apply(const Weights& in, Weights& out, unsigned int column, double scale,
+                 std::size_t begin, std::size_t end, bool withMoments) const;
+
+    ExactResult solveFinite(double temp, unsigned int length);
+    ExactResult solveInfinite(double temp);
+};
+
+#endif // _TRANSFER_MATRIX_H
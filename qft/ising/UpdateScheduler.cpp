@@ -0,0 +1,106 @@
+/* UpdateScheduler.cpp
+Chooses between local and cluster updates of the Ising lattice at run time.
+*/
+#include "UpdateScheduler.h"
+#include <algorithm>  // max, min_element.
+#include <chrono>
+#include <cmath>      // ceil.
+#include <stdexcept>  // For std::runtime_error
+
+
+std::string algorithmName(UpdateAlgorithm algorithm) {
+    switch (algorithm) {
+        case UpdateAlgorithm::Metropolis: return "metropolis";
+        case UpdateAlgorithm::Wolff: return "wolff";
+        case UpdateAlgorithm::SwendsenWang: return "swendsen-wang";
+        case UpdateAlgorithm::Mixed: return "mixed";
+    }
+    return "unknown";
+}
+
+UpdateAlgorithm parseAlgorithm(const std::string& name) {
+    for (UpdateAlgorithm algorithm : {UpdateAlgorithm::Metropolis, UpdateAlgorithm::Wolff,
+                                      UpdateAlgorithm::SwendsenWang, UpdateAlgorithm::Mixed}) {
+        if (name == algorithmName(algorithm))
+            return algorithm;
+    }
+    throw std::runtime_error("Unknown update algorithm: " + name);
+}
+
+UpdateScheduler::UpdateScheduler(Lattice* l) : lattice(l), chosen(UpdateAlgorithm::Metropolis), stride(1), updates(0) {}
+
+unsigned long long UpdateScheduler::step(UpdateAlgorithm algorithm) {
+    siteIndex size = lattice->latticeSize;
+    unsigned long long done = 0;
+
+    if (algorithm == UpdateAlgorithm::Metropolis || algorithm == UpdateAlgorithm::Mixed) {
+        for (siteIndex i = 0; i < size; i++)
+            lattice->metropolis(lattice->getRandomSite());
+        done += size;
+    }
+    if (algorithm == UpdateAlgorithm::Wolff || algorithm == UpdateAlgorithm::Mixed)
+        done += lattice->wolff(lattice->getRandomSite());
+    if (algorithm == UpdateAlgorithm::SwendsenWang) {
+        lattice->swendsenWang();
+        done += size;
+    }
+    return done;
+}
+
+UpdateTrial UpdateScheduler::trial(UpdateAlgorithm algorithm, unsigned int steps, unsigned long long budget) {
+    unsigned long long start = updates;
+    for (unsigned int i = 0; i < steps && updates - start < budget / 2; i++)
+        updates += step(algorithm);
+
+    // Only the updates are timed, the measurements cost the same whatever the algorithm.
+    std::vector<double> magnet, energy;
+    std::chrono::steady_clock::duration elapsed{};
+    unsigned long long measured = 0;
+    while (magnet.size() < 2 || (magnet.size() < steps && updates - start < budget)) {
+        auto begin = std::chrono::steady_clock::now();
+        unsigned long long done = step(algorithm);
+        elapsed += std::chrono::steady_clock::now() - begin;
+        measured += done;
+        updates += done;
+        magnet.push_back(fabs(lattice->calcMagnetization()));
+        energy.push_back(lattice->calcTotalEnergy());
+    }
+
+    UpdateTrial result;
+    result.algorithm = algorithm;
+    result.tau = std::max(integratedAutocorrelationTime(magnet), integratedAutocorrelationTime(energy));
+    result.secondsPerStep = std::chrono::duration<double>(elapsed).count() / magnet.size();
+    result.siteUpdatesPerStep = (double)measured / magnet.size();
+    result.costPerSample = 2 * result.tau * result.secondsPerStep;
+    return result;
+}
+
+UpdateAlgorithm UpdateScheduler::choose(const std::vector<UpdateAlgorithm>& candidates, unsigned int steps,
+                                        unsigned long long budget) {
+    if (candidates.empty())
+        throw std::runtime_error("No update algorithm to choose from");
+
+    trials.clear();
+    updates = 0;
+    for (UpdateAlgorithm algorithm : candidates)
+        trials.push_back(trial(algorithm, steps, budget / candidates.size()));
+
+    const UpdateTrial& best = *std::min_element(trials.begin(), trials.end(),
+        [](const UpdateTrial& a, const UpdateTrial& b) { return a.costPerSample < b.costPerSample; });
+    chosen = best.algorithm;
+    stride = std::max(1u, (unsigned int)ceil(best.tau));
+
+    // The steps the trials didn't take equilibrate with the chosen update.
+    while (updates < budget)
+        updates += step(chosen);
+    return chosen;
+}
+
+void UpdateScheduler::report(FILE* out) const {
+    for (const UpdateTrial& t : trials) {
+        fprintf(out, "schedule: %-14s tau %8.2f steps, %10.1f us per step, %10.1f site updates per step, %10.1f us per independent sample\n",
+                algorithmName(t.algorithm).c_str(), t.tau, t.secondsPerStep * 1e6, t.siteUpdatesPerStep, t.costPerSample * 1e6);
+    }
+    fprintf(out, "schedule: using %s, measuring every %u steps, %llu site updates of equilibration spent choosing\n",
+            algorithmName(chosen).c_str(), stride, updates);
+}
@@ -0,0 +1,73 @@
+/* UpdateScheduler.h
+Chooses between local and cluster updates of the Ising lattice at run time.
+
+Near the critical temperature the autocorrelation time of Metropolis sweeps
+blows up (see data/slowing), while far from it a Wolff cluster is a single
+site or the whole lattice and does little useful work. The scheduler runs a
+short trial of every candidate update at the end of the equilibration, out of
+its budget of site updates, measures the integrated autocorrelation time of
+|M| and E (in steps of that update) and the wall time per step, and picks the
+one with the lowest cost per independent sample, 2 tau_int * (time per step).
+
+One step is
+    metropolis:     one sweep of random site updates,
+    wolff:          one Wolff cluster,
+    swendsen-wang:  one Swendsen-Wang sweep,
+    mixed:          one Metropolis sweep followed by one Wolff cluster.
+*/
+#ifndef _UPDATESCHEDULER_H
+#define _UPDATESCHEDULER_H
+
+#include "Equilibration.h"
+#include "Lattice.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+enum class UpdateAlgorithm { Metropolis, Wolff, SwendsenWang, Mixed };
+
+std::string algorithmName(UpdateAlgorithm algorithm);
+UpdateAlgorithm parseAlgorithm(const std::string& name);  // Throws on unknown names.
+
+struct UpdateTrial {
+    UpdateAlgorithm algorithm;
+    double tau;              // Integrated autocorrelation time in steps.
+    double secondsPerStep;
+    double siteUpdatesPerStep;
+    double costPerSample;    // Seconds per independent sample.
+};
+
+class UpdateScheduler {
+    public:
+    explicit UpdateScheduler(Lattice* lattice);
+
+    // Runs one step of the given update and returns the number of site updates it did.
+    unsigned long long step(UpdateAlgorithm algorithm);
+
+    // Measures every candidate on an equal share of the budget of site updates, half of it to
+    // warm up and half measured, for at most the given number of steps each (at least 2 are
+    // measured), and returns the cheapest. What is left of the budget is spent on the chosen
+    // update. The trials are kept for report().
+    UpdateAlgorithm choose(const std::vector<UpdateAlgorithm>& candidates, unsigned int steps,
+                           unsigned long long budget);
+
+    // Site updates done by choose(), the trials included.
+    unsigned long long getUpdates() const { return updates; }
+
+    // Steps of the chosen update between measurements, so that they are about tau_int apart.
+    unsigned int getStride() const { return stride; }
+
+    void report(FILE* out) const;
+
+    private:
+    Lattice* lattice;
+    std::vector<UpdateTrial> trials;
+    UpdateAlgorithm chosen;
+    unsigned int stride;
+    unsigned long long updates;
+
+    UpdateTrial trial(UpdateAlgorithm algorithm, unsigned int steps, unsigned long long budget);
+};
+
+#endif // _UPDATESCHEDULER_H
@@ -0,0 +1,269 @@
+/* WangLandau.cpp
+Wang-Landau estimate of the density of states g(E) of the Ising lattice.
+*/
+#include "WangLandau.h"
+#include <algorithm>  // max, min.
+#include <cmath>      // exp, log, floor, ceil, lround.
+#include <cstdlib>    // abs.
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <stdexcept>  // For std::runtime_error
+#include <thread>
+
+
+WangLandau::WangLandau(Lattice* l, unsigned int minL, unsigned int maxL)
+    : lattice(l), minLevel(minL), maxLevel(maxL) {
+    unsigned int levels = numLevels(*lattice);
+    if (minLevel > maxLevel || maxLevel >= levels) {
+        throw std::runtime_error("Invalid Wang-Landau window [" + std::to_string(minLevel) + ", "
+            + std::to_string(maxLevel) + "] for " + std::to_string(levels) + " energy levels");
+    }
+
+    logG.assign(levels, 0.0);
+    histogram.assign(levels, 0);
+    visited.assign(levels, false);
+    magnetSums.assign(levels, 0.0);
+    magnetCounts.assign(levels, 0);
+
+    lattice->calcTotalEnergy();
+    energy = (int)lattice->totalEnergy;
+    magnet = (int)std::lround(lattice->calcMagnetization() * lattice->latticeSize);
+}
+
+unsigned int WangLandau::numLevels(const Lattice& l) {
+    return l.dimensions * l.latticeSize / 2 + 1;
+}
+
+unsigned int WangLandau::level(int e) const {
+    return (unsigned int)((e + (int)(lattice->dimensions * lattice->latticeSize)) / 4);
+}
+
+// enterWindow flips spins until the energy falls inside the window, only accepting
+// flips that don't take us further away from it.
+void WangLandau::enterWindow() {
+    int bonds = (int)(lattice->dimensions * lattice->latticeSize);
+    int low = 4 * (int)minLevel - bonds;
+    int high = 4 * (int)maxLevel - bonds;
+    auto distance = [=](int e) { return (e < low) ? low - e : (e > high) ? e - high : 0; };
+
+    unsigned long long attempts = 0;
+    const unsigned long long maxAttempts = 100000ULL * lattice->latticeSize;
+    while (distance(energy) > 0) {
+        if (attempts++ > maxAttempts) {
+            throw std::runtime_error("Could not drive the lattice into the energy window ["
+                + std::to_string(low) + ", " + std::to_string(high) + "]");
+        }
+        siteIndex site = lattice->getRandomSite();
+        int deltaE = -2 * lattice->calcEnergy(site);
+        if (distance(energy + deltaE) <= distance(energy)) {
+            magnet -= 2 * lattice->lattice[site];
+            lattice->lattice[site] *= -1;
+            energy += deltaE;
+        }
+    }
+}
+
+bool WangLandau::isFlat(double flatness) const {
+    unsigned long long total = 0;
+    unsigned long long smallest = std::numeric_limits<unsigned long long>::max();
+    unsigned int count = 0;
+    for (unsigned int l = minLevel; l <= maxLevel; l++) {
+        if (!visited[l])
+            continue;
+        total += histogram[l];
+        smallest = std::min(smallest, histogram[l]);
+        count++;
+    }
+    return count > 0 && (double)smallest >= flatness * (double)total / count;
+}
+
+void WangLandau::run(const WangLandauParams& params) {
+    enterWindow();
+
+    siteIndex latticeSize = lattice->latticeSize;
+    unsigned int current = level(energy);
+    double logF = 1.0;  // f = e at the start, as in the original paper.
+
+    while (logF > params.finalLogF) {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        bool accumulate = logF < params.accumulateLogF;
+
+        do {
+            for (unsigned long long i = 0; i < (unsigned long long)params.checkSweeps * latticeSize; i++) {
+                siteIndex site = lattice->getRandomSite();
+                int deltaE = -2 * lattice->calcEnergy(site);
+                unsigned int next = level(energy + deltaE);
+
+                if (next >= minLevel && next <= maxLevel) {
+                    double logRatio = logG[current] - logG[next];
+                    if (logRatio >= 0 || gsl_rng_uniform(lattice->generator) < exp(logRatio)) {
+                        magnet -= 2 * lattice->lattice[site];
+                        lattice->lattice[site] *= -1;
+                        energy += deltaE;
+                        current = next;
+                    }
+                }
+
+                logG[current] += logF;
+                histogram[current]++;
+                visited[current] = true;
+                if (accumulate) {
+                    magnetSums[current] += abs(magnet);
+                    magnetCounts[current]++;
+                }
+            }
+        } while (!isFlat(params.flatness));
+
+        logF /= 2;  // f -> sqrt(f).
+    }
+}
+
+std::vector<double> WangLandau::getMagnetAbs() const {
+    std::vector<double> averages(logG.size(), 0.0);
+    for (unsigned int l = 0; l < logG.size(); l++) {
+        if (magnetCounts[l] > 0)
+            averages[l] = magnetSums[l] / magnetCounts[l] / lattice->latticeSize;
+    }
+    return averages;
+}
+
+
+DensityOfStates sampleDensityOfStates(const std::vector<unsigned int>& dims, unsigned int seed,
+                                      unsigned int windows, double overlap, const WangLandauParams& params) {
+    if (windows == 0)
+        windows = 1;
+    if (overlap <= 0 || overlap >= 1)
+        throw std::runtime_error("The window overlap must be in (0, 1)");
+
+    std::vector<std::unique_ptr<Lattice>> lattices;
+    std::vector<std::unique_ptr<WangLandau>> walkers;
+    unsigned int latticeSize = 1;
+    for (unsigned int size : dims)
+        latticeSize *= size;
+    unsigned int bonds = dims.size() * latticeSize;
+    unsigned int levels = bonds / 2 + 1;
+    double width = (levels - 1) / (windows - (windows - 1) * overlap);
+    for (unsigned int w = 0; w < windows; w++) {
+        double start = w * width * (1 - overlap);
+        unsigned int low = (unsigned int)floor(start);
+        unsigned int high = std::min(levels - 1, (unsigned int)ceil(start + width));
+        lattices.push_back(std::make_unique<Lattice>(dims, seed + w));
+        walkers.push_back(std::make_unique<WangLandau>(lattices.back().get(), low, high));
+    }
+
+    std::vector<std::thread> pool;
+    std::vector<std::exception_ptr> errors(windows);
+    for (unsigned int w = 0; w < windows; w++) {
+        pool.emplace_back([&, w]() {
+            try {
+                walkers[w]->run(params);
+            } catch (...) {
+                errors[w] = std::current_exception();
+            }
+        });
+    }
+    for (auto& thread : pool)
+        thread.join();
+    for (auto& error : errors) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    // Glue the windows together. Each window is shifted to match the ones below it on
+    // average over their common levels, and it takes over in the middle of the overlap.
+    std::vector<double> logG = walkers[0]->getLogG();
+    std::vector<double> magnetAbs = walkers[0]->getMagnetAbs();
+    std::vector<bool> visited = walkers[0]->getVisited();
+    for (unsigned int w = 1; w < windows; w++) {
+        const WangLandau& walker = *walkers[w];
+        const std::vector<double>& windowLogG = walker.getLogG();
+        std::vector<double> windowMagnet = walker.getMagnetAbs();
+        unsigned int overlapEnd = walkers[w - 1]->getMaxLevel();
+
+        double shift = 0.0;
+        unsigned int common = 0;
+        for (unsigned int l = walker.getMinLevel(); l <= overlapEnd; l++) {
+            if (visited[l] && walker.getVisited()[l]) {
+                shift += logG[l] - windowLogG[l];
+                common++;
+            }
+        }
+        if (common == 0)
+            throw std::runtime_error("Wang-Landau windows " + std::to_string(w - 1) + " and " + std::to_string(w) + " do not overlap");
+        shift /= common;
+
+        unsigned int takeOver = (walker.getMinLevel() + overlapEnd) / 2;
+        for (unsigned int l = walker.getMinLevel(); l <= walker.getMaxLevel(); l++) {
+            if (walker.getVisited()[l] && (l > takeOver || !visited[l])) {
+                logG[l] = windowLogG[l] + shift;
+                magnetAbs[l] = windowMagnet[l];
+                visited[l] = true;
+            }
+        }
+    }
+
+    DensityOfStates dos;
+    dos.latticeSize = latticeSize;
+    for (unsigned int l = 0; l < levels; l++) {
+        if (!visited[l])
+            continue;
+        dos.energy.push_back(4 * (int)l - (int)bonds);
+        dos.logG.push_back(logG[l]);
+        dos.magnetAbs.push_back(magnetAbs[l]);
+    }
+
+    // Normalize with the total number of states, sum g(E) = 2^N.
+    double largest = *std::max_element(dos.logG.begin(), dos.logG.end());
+    double sum = 0.0;
+    for (double value : dos.logG)
+        sum += exp(value - largest);
+    double norm = dos.latticeSize * log(2.0) - (largest + log(sum));
+    for (double& value : dos.logG)
+        value += norm;
+
+    return dos;
+}
+
+Thermodynamics thermodynamics(const DensityOfStates& dos, double temp) {
+    double beta = 1.0 / temp;
+    double size = dos.latticeSize;
+
+    double largest = -std::numeric_limits<double>::infinity();
+    for (size_t i = 0; i < dos.energy.size(); i++)
+        largest = std::max(largest, dos.logG[i] - beta * dos.energy[i]);
+
+    double z = 0.0, e = 0.0, e2 = 0.0, m = 0.0;
+    for (size_t i = 0; i < dos.energy.size(); i++) {
+        double weight = exp(dos.logG[i] - beta * dos.energy[i] - largest);
+        z += weight;
+        e += weight * dos.energy[i];
+        e2 += weight * dos.energy[i] * dos.energy[i];
+        m += weight * dos.magnetAbs[i];
+    }
+    e /= z;
+    e2 /= z;
+    m /= z;
+
+    Thermodynamics result;
+    result.temp = temp;
+    result.energy = e / size;
+    result.specificHeat = beta * beta * (e2 - e * e) / size;
+    result.freeEnergy = -temp * (largest + log(z)) / size;
+    result.entropy = (result.energy - result.freeEnergy) / temp;
+    result.magnetAbs = m;
+    return result;
+}
+
+void saveDensityOfStates(const DensityOfStates& dos, const std::string& filename) {
+    std::ofstream file(filename);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file for writing: " + filename);
+    }
+    file.precision(std::numeric_limits<double>::max_digits10);
+    file << "# latticeSize=" << dos.latticeSize << "\n";
+    file << "# E\tln g(E)\t<|M|>/N\n";
+    for (size_t i = 0; i < dos.energy.size(); i++)
+        file << dos.energy[i] << "\t" << dos.logG[i] << "\t" << dos.magnetAbs[i] << "\n";
+    file.close();
+}
@@ -0,0 +1,95 @@
+/* WangLandau.h
+Wang-Landau estimate of the density of states g(E) of the Ising lattice.
+
+The walker flips single spins of a Lattice like Metropolis does, but accepts
+a move from E to E' with probability min(1, g(E)/g(E')) and multiplies g(E)
+of the visited level by the modification factor f after every step. When the
+histogram of visits is flat, f is replaced by sqrt(f) and the histogram is
+cleared, until ln f is below the requested precision.
+
+In 2D the total energy only takes the values E = -2N, -2N + 4, ..., 2N, so
+the histogram has one bin per level, N + 1 of them. Some of them can never be
+reached (e.g. -2N + 4); a level only takes part in the flatness check once it
+has been visited. In D dimensions the levels run from -DN to DN, DN/2 + 1 of
+them.
+
+A walker can be restricted to a window of energy levels, so that several
+windows can be sampled in parallel and merged afterwards.
+*/
+#ifndef _WANGLANDAU_H
+#define _WANGLANDAU_H
+
+#include "Lattice.h"
+#include <string>
+#include <vector>
+
+
+struct WangLandauParams {
+    double flatness;            // Minimum histogram entry relative to the mean.
+    double finalLogF;           // Stop once ln f drops below this.
+    unsigned int checkSweeps;   // Sweeps between flatness checks.
+    double accumulateLogF;      // Microcanonical averages are collected once ln f is below this.
+};
+
+class WangLandau {
+    public:
+    // The walker owns neither the lattice nor its random number generator.
+    // Levels are indices into E = -2N + 4 * level.
+    WangLandau(Lattice* lattice, unsigned int minLevel, unsigned int maxLevel);
+
+    static unsigned int numLevels(const Lattice& lattice);
+
+    void run(const WangLandauParams& params);
+
+    unsigned int getMinLevel() const { return minLevel; }
+    unsigned int getMaxLevel() const { return maxLevel; }
+    // Indexed by level, only meaningful inside the window.
+    const std::vector<double>& getLogG() const { return logG; }
+    const std::vector<bool>& getVisited() const { return visited; }
+    // Average |M| per spin at each level.
+    std::vector<double> getMagnetAbs() const;
+
+    private:
+    Lattice* lattice;
+    unsigned int minLevel;
+    unsigned int maxLevel;
+    int energy;  // Current total energy.
+    int magnet;  // Current total magnetization.
+
+    std::vector<double> logG;
+    std::vector<unsigned long long> histogram;
+    std::vector<bool> visited;
+    std::vector<double> magnetSums;
+    std::vector<unsigned long long> magnetCounts;
+
+    unsigned int level(int e) const;
+    void enterWindow();
+    bool isFlat(double flatness) const;
+};
+
+// DensityOfStates is ln g(E) over the whole energy range.
+struct DensityOfStates {
+    std::vector<int> energy;
+    std::vector<double> logG;       // Normalized so that sum g(E) = 2^N.
+    std::vector<double> magnetAbs;  // Average |M| per spin at each energy.
+    unsigned int latticeSize;
+};
+
+// sampleDensityOfStates runs one Wang-Landau walker per window, each one on its own
+// lattice and thread, and glues the windows together where they overlap.
+DensityOfStates sampleDensityOfStates(const std::vector<unsigned int>& dims, unsigned int seed,
+                                      unsigned int windows, double overlap, const WangLandauParams& params);
+
+struct Thermodynamics {
+    double temp;
+    double energy;        // Per spin.
+    double specificHeat;  // Per spin.
+    double freeEnergy;    // Per spin.
+    double entropy;       // Per spin.
+    double magnetAbs;     // Per spin.
+};
+
+Thermodynamics thermodynamics(const DensityOfStates& dos, double temp);
+void saveDensityOfStates(const DensityOfStates& dos, const std::string& filename);
+
+#endif // _WANGLANDAU_H
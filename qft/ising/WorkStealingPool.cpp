@@ -0,0 +1,94 @@
+/* WorkStealingPool.cpp
+Implements the work stealing pool of the campaigns.
+*/
+#include "WorkStealingPool.h"
+#include <algorithm>  // max, sort.
+#include <exception>
+#include <thread>
+#include "Topology.h"
+#include "Trace.h"
+
+
+WorkStealingPool::WorkStealingPool(unsigned int count) : threads(count), steals(0) {
+    if (threads == 0)
+        threads = std::max<std::size_t>(1, Topology().getCpus().size());
+    queues = std::vector<WorkerQueue>(threads);
+}
+
+
+// take pops the largest task of the worker's own deque, or steals the largest one of the
+// deque with the most work left. It returns false once every deque is empty.
+bool WorkStealingPool::take(unsigned int worker, PoolTask& task) {
+    {
+        WorkerQueue& own = queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            own.cost -= task.cost;
+            return true;
+        }
+    }
+
+    // The victim may be emptied between looking at the loads and locking it, then we look again.
+    while (true) {
+        int victim = -1;
+        double most = 0.0;
+        for (unsigned int w = 0; w < threads; w++) {
+            std::lock_guard<std::mutex> lock(queues[w].mutex);
+            if (!queues[w].tasks.empty() && (victim < 0 || queues[w].cost > most)) {
+                victim = w;
+                most = queues[w].cost;
+            }
+        }
+        if (victim < 0)
+            return false;
+
+        WorkerQueue& other = queues[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (other.tasks.empty())
+            continue;
+        task = std::move(other.tasks.front());
+        other.tasks.pop_front();
+        other.cost -= task.cost;
+        steals++;
+        return true;
+    }
+}
+
+
+void WorkStealingPool::run(std::vector<PoolTask> tasks) {
+    std::stable_sort(tasks.begin(), tasks.end(),
+                     [](const PoolTask& a, const PoolTask& b) { return a.cost > b.cost; });
+    for (std::size_t i = 0; i < tasks.size(); i++) {
+        std::size_t round = i / threads, position = i % threads;
+        unsigned int w = (round % 2 == 0) ? position : threads - 1 - position;
+        queues[w].cost += tasks[i].cost;
+        queues[w].tasks.push_back(std::move(tasks[i]));
+    }
+
+    Topology topology;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+    for (unsigned int w = 0; w < threads; w++) {
+        workers.emplace_back([&, w]() {
+            Topology::pin(topology.cpuFor(w, threads));
+            Trace::setThreadName("pool-" + std::to_string(w));
+            PoolTask task;
+            while (take(w, task)) {
+                try {
+                    task.run(w);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(errorMutex);
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        });
+    }
+    for (std::thread& worker : workers)
+        worker.join();
+    if (error)
+        std::rethrow_exception(error);
+}
@@ -0,0 +1,53 @@
+/* WorkStealingPool.h
+Runs a set of independent tasks of very different lengths on a pool of pinned threads.
+
+The tasks carry an estimate of their cost. They are sorted largest first and dealt to the
+deques of the workers in a snake order (0, 1, ..., n-1, n-1, ..., 0, 0, 1, ...), which
+balances the estimated work of the deques. Every worker takes the largest task left in its
+own deque. A worker whose deque is empty steals the largest task of the deque with the most
+estimated work left, so the pool keeps starting the largest remaining tasks first and the
+long ones don't end up alone at the end of the run. The estimates only need to get the
+order roughly right.
+*/
+#ifndef _WORK_STEALING_POOL_H
+#define _WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+
+struct PoolTask {
+    double cost;                                  // Estimated, in any unit.
+    std::function<void(unsigned int worker)> run;
+};
+
+class WorkStealingPool {
+    public:
+    // threads workers are pinned to the cores node by node, 0 uses every core.
+    explicit WorkStealingPool(unsigned int threads);
+
+    // run returns once every task is done. An exception thrown by a task doesn't stop the
+    // others, the first one is rethrown once they are all done.
+    void run(std::vector<PoolTask> tasks);
+
+    unsigned int getThreads() const { return threads; }
+    unsigned long long getSteals() const { return steals; }
+
+    private:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<PoolTask> tasks;  // Largest first.
+        double cost = 0.0;           // Estimated work left in tasks.
+    };
+
+    bool take(unsigned int worker, PoolTask& task);
+
+    unsigned int threads;
+    std::vector<WorkerQueue> queues;
+    std::atomic<unsigned long long> steals;
+};
+
+#endif // _WORK_STEALING_POOL_H
@@ -23,12 +23,12 @@ running time decreased by around 20%.
 // HashTable.cpp
 #include "HashTable.h"
 
-Node::Node(unsigned int val) : value(val), next(nullptr) {}
+Node::Node(siteIndex val) : value(val), next(nullptr) {}
 
 HashTable::HashTable(unsigned int tableNum)
     : size(0), tableNumber(tableNum), table(tableNum) {}
 
-void HashTable::insert(unsigned int site) {
+void HashTable::insert(siteIndex site) {
     auto index = site % tableNumber;
     auto newNode = std::make_unique<Node>(site);
     // We wouldn't need the std::move if we had shared_ptrs.
@@ -37,7 +37,7 @@ void HashTable::insert(unsigned int site) {
     size++;
 }
 
-bool HashTable::find(unsigned int site) {
+bool HashTable::find(siteIndex site) {
     auto index = site % tableNumber;
     auto current = table[index].get();  // The .get() is not necessary for s shared_ptr.
     while (current) {
@@ -65,6 +65,6 @@ unsigned int HashTable::getTableSize() const {
     return tableNumber;
 }
 
-unsigned int HashTable::getNumberOfNodes() const {
+siteIndex HashTable::getNumberOfNodes() const {
     return size;
 }
\ No newline at end of file
@@ -3,12 +3,13 @@
 
 #include <memory>
 #include <vector>
+#include "SiteStorage.h"  // siteIndex.
 
 struct Node {
-    unsigned int value;
+    siteIndex value;
     std::unique_ptr<Node> next;
 
-    Node(unsigned int val);
+    Node(siteIndex val);
 };
 
 class HashTable {
@@ -16,16 +17,16 @@ public:
     explicit HashTable(unsigned int tableNumber = 4093);
     ~HashTable() = default;
 
-    void insert(unsigned int site);
-    bool find(unsigned int site);
+    void insert(siteIndex site);
+    bool find(siteIndex site);
     void clear();
 
     const std::vector<std::unique_ptr<Node>>& getTable() const;  // Expose table for external manipulation.
     unsigned int getTableSize() const;  // Get the size of the table.
-    unsigned int getNumberOfNodes() const;  // Get the total number of nodes.
+    siteIndex getNumberOfNodes() const;  // Get the total number of nodes.
 
 private:
-    unsigned int size;
+    siteIndex size;
     unsigned int tableNumber;
     std::vector<std::unique_ptr<Node>> table;
 };
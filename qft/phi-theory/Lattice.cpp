@@ -5,34 +5,66 @@ This is based on https://inspirehep.net/literature/1386200 ,
 Lattice Simulations of Nonperturbative Quantum Field Theories
 by David Schaich
 */
+#include <algorithm>         // min.
 #include <cmath>             // floor.
 #include <memory>
+#include <stdexcept>
+#include <vector>
 #include "HashTable.h"
 #include "Lattice.h"
+#include "WolffEstimators.h"
 #include <cstdio>            // For fflush and stdout.
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_sf_exp.h>  // Exp.
 
 
 Lattice::Lattice(double m, double l, unsigned int x, unsigned int y)
-    : muSquared(2 + (m / 2.0)), lambda(l / 4.0),
-      xDim(x), yDim(y), 
-      latticeSize(xDim * yDim),
-      lattice(latticeSize, 0),
+    : Lattice(m, l, std::vector<unsigned int>{x, y}) {}
+
+// The field and the cluster are the only per-site storage, the neighbours are computed
+// when they are needed so that huge lattices only pay for the field.
+// The lists of the cluster cost more than the field, so there are at most 2^22 of them.
+Lattice::Lattice(double m, double l, const std::vector<unsigned int>& dims,
+                 const std::filesystem::path& fieldFile)
+    : muSquared(dims.size() + (m / 2.0)), lambda(l / 4.0),
+      xDim(dims.at(0)), yDim(dims.at(1)),
+      dimensions(dims.size()),
+      strides(dimensions, 1),
+      latticeSize(productOf(dims)),
+      lattice(latticeSize, 0, fieldFile),
       generator(gsl_rng_alloc(gsl_rng_mt19937), gsl_rng_free),
-      neighbours(latticeSize),
-      cluster(std::make_unique<HashTable>(latticeSize / 4)) {
+      cluster(std::make_unique<HashTable>(std::min<siteIndex>(latticeSize / 4, 1u << 22))) {
 
-    gsl_rng_set(generator.get(), static_cast<unsigned int>(100 * m * lambda));
+    if (dimensions > siteNeighbours::maxDimensions) {
+        throw std::invalid_argument("Lattice: at most 4 dimensions are supported");
+    }
+    for (unsigned int d = 1; d < dimensions; ++d) {
+        strides[d] = strides[d - 1] * dims[d - 1];
+    }
+
+    // The seed wraps around for a negative mass, through a signed integer since converting a
+    // negative double straight to unsigned is undefined.
+    reseed(static_cast<unsigned int>(static_cast<long long>(100 * m * lambda)));
+}
+
+void Lattice::reseed(unsigned long seed) {
+    gsl_rng_set(generator.get(), seed);
 
-    for (unsigned int i = 0; i < latticeSize; ++i) {
+    for (siteIndex i = 0; i < latticeSize; ++i) {
         // Initialize the lattice with values [-1.5, 1.5).
         lattice[i] = genRandomPhiValue();
+    }
+}
 
-        // Initialize the neighbours vector. Calculate one siteNeighbours for each site.
-        neighbours[i] = std::make_unique<siteNeighbours>();
-        getHelicalNeighbours(i, neighbours[i].get());
+siteIndex Lattice::productOf(const std::vector<unsigned int>& dims) {
+    if (dims.size() < 2) {
+        throw std::invalid_argument("Lattice: at least 2 dimensions are required");
+    }
+    siteIndex product = 1;
+    for (unsigned int size : dims) {
+        product *= size;
     }
+    return product;
 }
 
 
@@ -40,8 +72,14 @@ double Lattice::genU() {
     return gsl_rng_uniform(generator.get());
 }
 
-unsigned int Lattice::getRandomSite() {
-    return (unsigned int) floor(latticeSize * genU());
+// The draw is the same as floor(latticeSize * u) as long as 32 bits of randomness address
+// every site, larger lattices combine two 32 bit draws of the Mersenne twister.
+siteIndex Lattice::getRandomSite() {
+    if (latticeSize <= (siteIndex(1) << 32)) {
+        return (siteIndex) floor(latticeSize * genU());
+    }
+    siteIndex high = gsl_rng_get(generator.get());
+    return ((high << 32) | gsl_rng_get(generator.get())) % latticeSize;
 }
 
 // genRandomPhiValue generates values in the range [-1.5, 1.5) uniformly.
@@ -51,48 +89,23 @@ double Lattice::genRandomPhiValue() {
 
 // getHelicalNeighbours computes the neighbours for the given site and stores them
 // in the siteNeighbours struct.
-// Note: that the author has a bug in the first else statement -> nextY should be
-// xDim. xDim - 1 gives you the last element in the same "row".
+// With helical boundary conditions the neighbours along dimension d are simply
+// site +- strides[d], wrapped around the end of the array. In 2D the strides are 1 and xDim.
+// Note: the author's snippet set nextY of the last site to xDim, but the wrap of
+// latticeSize - 1 + xDim is xDim - 1. xDim made the last site's bonds asymmetric.
 // 2nd Note: also note that this snippet reveals a bug in the Ising model code snippet,
 // as the first if statement for determining prevX and prevY should have the conditional
 // (site >= xDim), instead of (site > xDim).
-void Lattice::getHelicalNeighbours(unsigned int site, siteNeighbours* toInit) {
-    if (site < latticeSize - xDim) {
-        // If not in the last row...
-        // Then the next X is +1 to the right, and the next Y is a full xDim below.
-        toInit->nextX = site + 1;
-        toInit->nextY = site + xDim;
-    } else if (site < latticeSize - 1) {
-        // If site is in the last row but not on the last site...
-        // Then next X is still +1 to the rightn, but next Y is at the first row.
-        toInit->nextX = site + 1;
-        toInit->nextY = site + xDim - latticeSize;
-    } else {  // site = latticeSize - 1
-        // If site is in the last row in the last element, then wrap around.
-        // Then next X is the begining, and next Y is a row right below the begining.
-        toInit->nextX = 0;
-        toInit->nextY = xDim;
-    }
-
-    if (site >= xDim) {  // If site is below the 1st row...
-        // Then the prev X is just 1 to the left, and xDim to the top.
-        toInit->prevX = site - 1;
-        toInit->prevY = site - xDim;
-    } else if (site > 0) {  // If site is not the first element but it is in the first row...
-        // Then previous X is to the left and prev Y is in the last row,
-        // wrapping around to the end of the array.
-        toInit->prevX = site - 1;
-        toInit->prevY = site + latticeSize - xDim;
-    } else {  // site = 0
-        // Since the site is the first element, then prev X is the last element of the array.
-        // And prev Y is xDim above the last element of the array.
-        toInit->prevX = latticeSize - 1;
-        toInit->prevY = latticeSize - xDim;
+void Lattice::getHelicalNeighbours(siteIndex site, siteNeighbours* toInit) const {
+    for (unsigned int d = 0; d < dimensions; ++d) {
+        siteIndex next = site + strides[d];
+        toInit->next[d] = (next >= latticeSize) ? next - latticeSize : next;
+        toInit->prev[d] = (site >= strides[d]) ? site - strides[d] : site + latticeSize - strides[d];
     }
 }
 
 void Lattice::printLattice() {
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (i % xDim == 0) {
             printf("\n");
         }
@@ -103,7 +116,7 @@ void Lattice::printLattice() {
 }
 
 void Lattice::printSigns() {
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (i % xDim == 0) {
             printf("\n");
         }
@@ -118,7 +131,7 @@ void Lattice::printSigns() {
 }
 
 void Lattice::printClusters() {
-    for (unsigned int i = 0; i < latticeSize; i++) {
+    for (siteIndex i = 0; i < latticeSize; i++) {
         if (i % xDim == 0) {
             printf("\n");
         }
@@ -133,12 +146,20 @@ void Lattice::printClusters() {
 }
 
 double Lattice::calcTotalEnergy() {
+    return calcTotalEnergy(lattice.begin());
+}
+
+double Lattice::calcTotalEnergy(const double* field) const {
     double totalEnergy = 0.0;
     double currentPhi;
-    for (unsigned int i = 0; i < latticeSize; i++) {
-        currentPhi = lattice[i];
+    siteNeighbours neighbours;
+    for (siteIndex i = 0; i < latticeSize; i++) {
+        currentPhi = field[i];
 
-        totalEnergy -= currentPhi * (lattice[neighbours[i]->nextX] + lattice[neighbours[i]->nextY]);
+        getHelicalNeighbours(i, &neighbours);
+        for (unsigned int d = 0; d < dimensions; ++d) {
+            totalEnergy -= currentPhi * field[neighbours.next[d]];
+        }
         
         currentPhi *= currentPhi;
         totalEnergy += muSquared * currentPhi;
@@ -150,23 +171,36 @@ double Lattice::calcTotalEnergy() {
 }
 
 double Lattice::calcAvgPhi() {
+    return calcAvgPhi(lattice.begin());
+}
+
+double Lattice::calcAvgPhi(const double* field) const {
     double currentPhi = 0;
-    for (unsigned int i = 0; i < latticeSize; i++) {
-        currentPhi += lattice[i];
+    for (siteIndex i = 0; i < latticeSize; i++) {
+        currentPhi += field[i];
     }
     return currentPhi / latticeSize;
 }
 
-void Lattice::metropolis(unsigned int site) {
+void Lattice::metropolis(siteIndex site) {
+    metropolis(site, generator.get());
+}
+
+// This one only reads the field and writes the value at site, so threads with generators of
+// their own can update sites that aren't neighbours at the same time.
+bool Lattice::metropolis(siteIndex site, gsl_rng* rng) {
     double currentPhi = lattice[site];
-    double newValue = genRandomPhiValue();
+    double newValue = 3 * gsl_rng_uniform(rng) - 1.5;  // Like genRandomPhiValue().
     double tmp = newValue;
 
     // Compute energy difference.
-    siteNeighbours* curr = neighbours[site].get();
-    double difference = (currentPhi - newValue)
-        * (lattice[curr->nextX] + lattice[curr->nextY]
-        +  lattice[curr->prevX] + lattice[curr->prevY] );
+    siteNeighbours curr;
+    getHelicalNeighbours(site, &curr);
+    double neighbourSum = 0.0;
+    for (unsigned int d = 0; d < dimensions; ++d) {
+        neighbourSum += lattice[curr.next[d]] + lattice[curr.prev[d]];
+    }
+    double difference = (currentPhi - newValue) * neighbourSum;
 
     newValue *= newValue;
     currentPhi *= currentPhi;
@@ -179,12 +213,15 @@ void Lattice::metropolis(unsigned int site) {
     // Flip if difference is negative, otherwise accept probabilistically.
     if (difference <= 0) {
         lattice[site] = tmp;
-    } else if (genU() < gsl_sf_exp(-difference)) {
+        return true;
+    } else if (gsl_rng_uniform(rng) < gsl_sf_exp(-difference)) {
         lattice[site] = tmp;
+        return true;
     }
+    return false;
 }
 
-bool Lattice::clusterCheck(unsigned int site, unsigned int toAdd) {
+bool Lattice::clusterCheck(siteIndex site, siteIndex toAdd) {
     if (cluster->find(toAdd)) {
         // The potential site to add is already in the cluster.
         return false;
@@ -198,47 +235,51 @@ bool Lattice::clusterCheck(unsigned int site, unsigned int toAdd) {
     return false;
 }
 
-void Lattice::growClusterPos(unsigned int site) {
-    unsigned int toCheck = neighbours[site]->prevX;
-    if (lattice[toCheck] > 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
-    }
-
-    toCheck = neighbours[site]->nextX;
-    if (lattice[toCheck] > 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
-    }
-
-    toCheck = neighbours[site]->prevY;
-    if (lattice[toCheck] > 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
-    }
-
-    toCheck = neighbours[site]->nextY;
-    if (lattice[toCheck] > 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
+// The clusters used to be grown recursively, which overflows the stack once a cluster spans
+// a large lattice, so the sites still to be visited are kept on a stack instead.
+void Lattice::growClusterPos(siteIndex site) {
+    std::vector<siteIndex> toVisit(1, site);
+    siteNeighbours neighbours;
+    while (!toVisit.empty()) {
+        siteIndex current = toVisit.back();
+        toVisit.pop_back();
+        getHelicalNeighbours(current, &neighbours);
+
+        for (unsigned int d = 0; d < dimensions; ++d) {
+            siteIndex toCheck = neighbours.prev[d];
+            if (lattice[toCheck] > 0 && clusterCheck(current, toCheck)) {
+                toVisit.push_back(toCheck);
+            }
+
+            toCheck = neighbours.next[d];
+            if (lattice[toCheck] > 0 && clusterCheck(current, toCheck)) {
+                toVisit.push_back(toCheck);
+            }
+        }
     }
 }
 
-void Lattice::growClusterNeg(unsigned int site) {
-    unsigned int toCheck = neighbours[site]->prevX;
-    if (lattice[toCheck] <= 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
-    }
-
-    toCheck = neighbours[site]->nextX;
-    if (lattice[toCheck] <= 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
-    }
-
-    toCheck = neighbours[site]->prevY;
-    if (lattice[toCheck] <= 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
-    }
-
-    toCheck = neighbours[site]->nextY;
-    if (lattice[toCheck] <= 0 && clusterCheck(site, toCheck)) {
-        growClusterPos(toCheck);
+// Note: this used to recurse into growClusterPos, which stopped negative clusters after the
+// first neighbours of the seed and made the wolff update favour positive fields.
+void Lattice::growClusterNeg(siteIndex site) {
+    std::vector<siteIndex> toVisit(1, site);
+    siteNeighbours neighbours;
+    while (!toVisit.empty()) {
+        siteIndex current = toVisit.back();
+        toVisit.pop_back();
+        getHelicalNeighbours(current, &neighbours);
+
+        for (unsigned int d = 0; d < dimensions; ++d) {
+            siteIndex toCheck = neighbours.prev[d];
+            if (lattice[toCheck] <= 0 && clusterCheck(current, toCheck)) {
+                toVisit.push_back(toCheck);
+            }
+
+            toCheck = neighbours.next[d];
+            if (lattice[toCheck] <= 0 && clusterCheck(current, toCheck)) {
+                toVisit.push_back(toCheck);
+            }
+        }
     }
 }
 
@@ -257,7 +298,22 @@ void Lattice::flipCluster() {
     cluster->clear();
 }
 
-unsigned int Lattice::wolff(unsigned int site) {
+// measureCluster hands the sites of the wolff cluster and the size of their field to the
+// improved estimators.
+void Lattice::measureCluster() {
+    std::vector<siteIndex> members;
+    members.reserve(cluster->getNumberOfNodes());
+    const auto& table = cluster->getTable();
+    for (unsigned int i = 0; i < cluster->getTableSize(); i++) {
+        for (auto* current = table[i].get(); current != nullptr; current = current->next.get()) {
+            members.push_back(current->value);
+        }
+    }
+    estimators->add(members, [this](siteIndex member) { return cluster->find(member); },
+                    [this](siteIndex member) { return std::fabs(lattice[member]); });
+}
+
+siteIndex Lattice::wolff(siteIndex site) {
     cluster->insert(site);
 
     if (lattice[site] > 0) {
@@ -265,8 +321,11 @@ unsigned int Lattice::wolff(unsigned int site) {
     } else {
         growClusterNeg(site);
     }
+    if (estimators) {
+        measureCluster();
+    }
 
-    unsigned int toReturn = cluster->getNumberOfNodes();
+    siteIndex toReturn = cluster->getNumberOfNodes();
     flipCluster();
     return toReturn;
 }
\ No newline at end of file
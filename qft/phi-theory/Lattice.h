@@ -9,23 +9,31 @@ by David Schaich
 #define _LATTICE_H
 
 #include "HashTable.h"
+#include "SiteStorage.h"
+#include <filesystem>
 #include <vector>
 #include <memory>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_sf_exp.h>
 
+class WolffEstimators;
 
+
+// Neighbours along every dimension, [0] is x, [1] is y, then z and t.
 struct siteNeighbours {
-    unsigned int prevX;
-    unsigned int nextX;
-    unsigned int prevY;
-    unsigned int nextY;
+    static const unsigned int maxDimensions = 4;
+    siteIndex prev[maxDimensions];
+    siteIndex next[maxDimensions];
 };
 
 
 class Lattice {
     public:
         explicit Lattice(double mu, double lambda, unsigned int x, unsigned int y);
+        // dims holds the size of every dimension, x first, 2 to 4 of them.
+        // The field is kept in fieldFile if one is given, which lets the lattice outgrow the memory.
+        explicit Lattice(double mu, double lambda, const std::vector<unsigned int>& dims,
+                         const std::filesystem::path& fieldFile = {});
         ~Lattice() = default; // Destructor is no longer required to delete cluster.
 
         void printLattice();
@@ -34,35 +42,49 @@ class Lattice {
 
         double calcTotalEnergy();
         double calcAvgPhi();
+        // The same of a copy of the field, without touching the lattice.
+        double calcTotalEnergy(const double* field) const;
+        double calcAvgPhi(const double* field) const;
+        const double* getField() const { return lattice.begin(); }  // One value per site.
 
-        void metropolis(unsigned int site);
+        void metropolis(siteIndex site);
+        bool metropolis(siteIndex site, gsl_rng* rng);  // Thread safe, draws from rng, returns whether phi changed.
         
-        bool clusterCheck(unsigned int site, unsigned int toAdd);
-        void growClusterPos(unsigned int site);
-        void growClusterNeg(unsigned int site);
+        bool clusterCheck(siteIndex site, siteIndex toAdd);
+        void growClusterPos(siteIndex site);
+        void growClusterNeg(siteIndex site);
         void flipCluster();
-        unsigned int wolff(unsigned int site);  // Returns cluster size.
+        siteIndex wolff(siteIndex site);  // Returns cluster size.
+        // Every wolff cluster is measured by estimators while they are set, nullptr stops it.
+        void setEstimators(WolffEstimators* toSet) { estimators = toSet; }
 
-        unsigned int getRandomSite();
+        siteIndex getRandomSite();  // Uniformly distributed, also on lattices with more than 2^32 sites.
+        // Restarts the random numbers from seed and draws a new random field from them.
+        void reseed(unsigned long seed);
 
     private:
+        template <typename> friend class StripSweeper;  // Moves the field to the nodes of its threads.
+
         double muSquared;
         double lambda;
         unsigned int xDim;
         unsigned int yDim;
-        unsigned int latticeSize;
-        std::vector<double> lattice;
+        unsigned int dimensions;
+        std::vector<siteIndex> strides;  // Distance between neighbours along every dimension.
+        siteIndex latticeSize;
+        MappedArray<double> lattice;
 
         // Simple version: gsl_rng* generator;
         std::unique_ptr<gsl_rng, decltype(&gsl_rng_free)> generator;
-        // Simple version is: std::vector<siteNeighbours*> neighbours;
-        std::vector<std::unique_ptr<siteNeighbours>> neighbours;
         // Simple version: HashTable* cluster;
         std::unique_ptr<HashTable> cluster;
+        WolffEstimators* estimators = nullptr;
 
         double genU();
         double genRandomPhiValue();
-        void getHelicalNeighbours(unsigned int site, siteNeighbours* toInit);
+        void measureCluster();
+        void getHelicalNeighbours(siteIndex site, siteNeighbours* toInit) const;
+        static siteIndex productOf(const std::vector<unsigned int>& dims);
 };
 
 
@@ -8,10 +8,28 @@ by David Schaich
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>           // exit, atoi, atof.
+#include <cstring>           // memcpy.
+#include <algorithm>         // max.
 #include <cmath>             // floor.
 #include <memory>            // unqie_ptr, move.
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>            // hardware_concurrency.
 #include <vector>
+#include "Clusters.h"
+#include "Columns.h"
+#include "Correlations.h"
+#include "Equilibration.h"
 #include "Lattice.h"
+#include "MeasurementPipeline.h"
+#include "Options.h"
+#include "PerfCounters.h"
+#include "Resampling.h"
+#include "ResultCache.h"
+#include "StripSweeper.h"
+#include "Trace.h"
+#include "WolffEstimators.h"
 #include <gsl/gsl_sf_log.h>  // Natural log.
 #include <gsl/gsl_math.h>    // Power.
 
@@ -82,6 +100,17 @@ struct BinningResults {
     std::vector<unsigned int> counts;
 };
 
+// argumentSeed derives the default seed of the threaded sweeps and of the Fortuin-Kasteleyn
+// bonds of --clusters from the muSqrd and lambda
+// arguments. They can be fractional or negative, so their bits are mixed instead of converted.
+unsigned int argumentSeed(double muArgument, double lambdaArgument) {
+    uint64_t muBits = 0;
+    uint64_t lambdaBits = 0;
+    std::memcpy(&muBits, &muArgument, sizeof(double));
+    std::memcpy(&lambdaBits, &lambdaArgument, sizeof(double));
+    return static_cast<unsigned int>(streamSeed(streamSeed(muBits, 0) ^ lambdaBits, 1));
+}
+
 // Bin values of phi and calculate bimodality.
 // Values fo phi range from -maxPhi to +maxPhi.
 // Bin i of n will contain values greater than maxPhi*(2*i/n - 1)
@@ -124,8 +153,35 @@ std::unique_ptr<const BinningResults> calcBimodality(unsigned int bins,  int sam
 
 
 int main(int argc, char** const argv) {
-    if (argc != 7) {
-        std::cerr << "Usage: " << argv[0] << " muSqrd lambda xDim yDim init sampleSize" << std::endl;
+    if (argc < 7) {
+        std::cerr << "Usage: " << argv[0] << " muSqrd lambda xDim yDim init sampleSize [options]" << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --zDim=1              z dimension, for a 3D lattice" << std::endl;
+        std::cerr << "  --tDim=1              t dimension, for a 4D lattice" << std::endl;
+        std::cerr << "  --mmap=field.bin      keep the field in this file, for lattices larger than the memory" << std::endl;
+        std::cerr << "  --sequential          metropolis sweeps visit the sites in order instead of at random" << std::endl;
+        std::cerr << "  --sweep-threads=0     sweep strips of the lattice on this many pinned threads (0 uses every core)" << std::endl;
+        std::cerr << "  --seed=N              seed of the threads' and the cluster bonds' random number streams, derived from muSqrd and lambda by default" << std::endl;
+        std::cerr << "  --perf                report hardware performance counters per phase on stderr" << std::endl;
+        std::cerr << "  --trace=trace.json    write a Chrome trace_event timeline of the run" << std::endl;
+        std::cerr << "  --trace-sweeps=1      trace one in every this many metropolis+wolff iterations" << std::endl;
+        std::cerr << "  --trace-buffer=65536  number of trace events kept per thread" << std::endl;
+        std::cerr << "  --resample=32         append blocked jackknife errors for E, |phi|, C, chi and the Binder cumulant" << std::endl;
+        std::cerr << "  --bootstrap=0         use this many bootstrap resamples instead of the jackknife" << std::endl;
+        std::cerr << "  --bootstrap-seed=1    seed of the bootstrap random number streams" << std::endl;
+        std::cerr << "  --threads=0           threads for the bootstrap (0 uses every core)" << std::endl;
+        std::cerr << "  --series=series.col   save the energy, phi and wolff cluster size of every measurement as columns" << std::endl;
+        std::cerr << "                        numpy can map (see columnar.py)" << std::endl;
+        std::cerr << "  --correlations=xi.txt save G(r) and S(k), report the second-moment correlation length" << std::endl;
+        std::cerr << "  --clusters=sizes.txt  label every cluster, save the size distribution and report percolation" << std::endl;
+        std::cerr << "                        and the Fortuin-Kasteleyn improved susceptibility" << std::endl;
+        std::cerr << "  --cluster-threads=1   threads labelling the clusters (0 uses every core)" << std::endl;
+        std::cerr << "  --improved=g.txt      improved estimators of chi and xi from the wolff clusters," << std::endl;
+        std::cerr << "                        and their G(r) if a file is given" << std::endl;
+        std::cerr << "  --adaptive            stop equilibrating once MSER detects equilibrium (init is then the maximum)" << std::endl;
+        std::cerr << "                        and adapt the metropolis sweeps between measurements to tau_int" << std::endl;
+        std::cerr << "  --async=2             measure copies of the field on this many threads while sampling" << std::endl;
+        std::cerr << "  --cache=results-cache replay the output of a run already in this cache, or store it there" << std::endl;
         std::exit(EXIT_FAILURE);  // Use EXIT_FAILURE for portability.
     }
 
@@ -135,14 +191,106 @@ int main(int argc, char** const argv) {
     unsigned int yDim = atoi(argv[4]);
     unsigned int init = atoi(argv[5]);         // Iterations for equilibration.
     unsigned int sampleSize = atoi(argv[6]);
+    Options options(argc, argv, 7);
+
+    // The flags that can't work are rejected before the run rather than after it.
+    if (options.has("async") && options.has("adaptive")) {
+        throw std::runtime_error("--async and --adaptive can't be combined, the spacing needs every measurement at once");
+    }
+    if (options.has("resample") && (options.getUInt("resample", 32) < 2 || sampleSize < 2)) {
+        throw std::runtime_error("--resample needs at least 2 bins and 2 measurements");
+    }
+
+    // Hardware counters are only opened on request, opening them is not free.
+    std::unique_ptr<PerfCounters> perf;
+    if (options.has("perf")) {
+        perf = std::make_unique<PerfCounters>();
+    }
+
+    std::string traceFile = options.get("trace", "");
+    if (!traceFile.empty()) {
+        Trace::enable(options.getUInt("trace-buffer", 65536));
+    }
+    bool tracing = Trace::enabled();
+
+    // A run already in the cache is replayed: its output line and files are written back.
+    // Traces and counters describe the run itself, runs asking for them always run.
+    std::unique_ptr<ResultCache> cache;
+    std::string description;
+    if (options.has("cache") && !tracing && !options.has("perf")) {
+        cache = std::make_unique<ResultCache>(options.get("cache", "results-cache"));
+        description = ResultCache::describe(argc, argv);
+        CacheEntry entry;
+        if (cache->lookup(description, entry)) {
+            std::cout << entry.restoreFiles() << std::flush;
+            std::cerr << "cache: replayed from " << options.get("cache", "results-cache") << std::endl;
+            return 0;
+        }
+    }
 
+    unsigned int traceEvery = std::max(1u, options.getUInt("trace-sweeps", 1));
+    uint64_t phaseStart = tracing ? Trace::now() : 0;
 
-    unsigned int latticeSize = xDim * yDim;
+    // Dimensions of size 1 are left out, --tDim without --zDim gives a 3D lattice.
+    std::vector<unsigned int> dims = {xDim, yDim};
+    for (const char* name : {"zDim", "tDim"}) {
+        if (options.getUInt(name, 1) > 1) {
+            dims.push_back(options.getUInt(name, 1));
+        }
+    }
+    siteIndex latticeSize = 1;
+    for (unsigned int size : dims) {
+        latticeSize *= size;
+    }
     double energyData[sampleSize];
     double phiData[sampleSize];
     double phiDataAbs[sampleSize];
 
-    Lattice* lattice = new Lattice(muSqrd, lambda, xDim, yDim);
+    Lattice* lattice = new Lattice(muSqrd, lambda, dims, options.get("mmap", ""));
+    // Sequential sweeps stream through the field, which the pages of a huge lattice need.
+    bool sequential = options.has("sequential");
+
+    // The random number streams of the threaded sweeps and of the cluster labelling.
+    unsigned int seed = options.getUInt("seed", argumentSeed(atof(argv[1]), atof(argv[2])));
+
+    // Threaded sweeps replace the single site metropolis updates, the field is moved to the
+    // NUMA nodes of the threads unless it is kept in a file.
+    std::unique_ptr<StripSweeper<Lattice>> sweeper;
+    if (options.has("sweep-threads")) {
+        sweeper = std::make_unique<StripSweeper<Lattice>>(lattice, options.getUInt("sweep-threads", 0), seed, !options.has("mmap"));
+        sweeper->report(stderr);
+    }
+
+    // The time series of the measurements, for the notebooks.
+    std::unique_ptr<ColumnWriter> seriesColumns;
+    if (options.has("series")) {
+        std::vector<std::string> names = {"energy", "phi", "abs_phi", "cluster_size"};
+        ColumnAttributes attributes = {
+            {"muSqrd", muSqrd}, {"lambda", lambda},
+            {"latticeSize", (double)latticeSize}, {"dimensions", (double)dims.size()},
+        };
+        seriesColumns = std::make_unique<ColumnWriter>(options.get("series", "series.col"), names, sampleSize, attributes);
+    }
+
+    // The correlations are measured with an FFT of the field at every measurement.
+    std::unique_ptr<Correlations> correlations;
+    if (options.has("correlations")) {
+        correlations = std::make_unique<Correlations>(dims);
+    }
+
+    // Every measurement labels the geometric clusters of the signs of the field, and the
+    // Fortuin-Kasteleyn clusters of the wolff update.
+    std::unique_ptr<ClusterLabeller> labeller;
+    ClusterStatistics clusterStatistics;
+    if (options.has("clusters")) {
+        labeller = std::make_unique<ClusterLabeller>(dims, options.getUInt("cluster-threads", 1), seed);
+    }
+
+    // The wolff clusters of the sampling are measured as they are grown.
+    std::unique_ptr<WolffEstimators> estimators;
+    if (options.has("improved")) {
+        estimators = std::make_unique<WolffEstimators>(dims, !options.get("improved", "").empty());
+    }
 
     double avgEnergy      = 0;
     double avgPhi         = 0;
@@ -159,31 +307,66 @@ int main(int argc, char** const argv) {
 
     // Initialize and equilibrate the lattice.
     // Do gap metropolis steps for each lattice site, then a wolff step.
+    // With --adaptive the energy and |phi| of every iteration are fed to MSER, checked every
+    // 64 iterations, and gap follows the running tau_int of |phi| while sampling.
     double maxPhi = 0;
-    unsigned int randomSite = 0;
+    siteIndex randomSite = 0;
     unsigned int gap = 5;
+    unsigned long long equilibrationUpdates = 0;
+    bool adaptive = options.has("adaptive");
+    EquilibrationDetector energyDetector, phiDetector;
+    MeasurementSpacing spacing(gap, 1000);
+    if (perf) {
+        perf->begin("equilibration");
+    }
     for (unsigned int i = 0; i < init; i++) {
-        for (unsigned int j = 0; j < latticeSize * gap; j++) {
-            randomSite = lattice->getRandomSite();
-            lattice->metropolis(randomSite);
+        uint64_t sweepStart = (tracing && i % traceEvery == 0) ? Trace::now() : 0;
+        if (sweeper) {
+            sweeper->sweep(gap);
+        } else {
+            for (siteIndex j = 0; j < latticeSize * gap; j++) {
+                randomSite = sequential ? j % latticeSize : lattice->getRandomSite();
+                lattice->metropolis(randomSite);
+            }
         }
         randomSite = lattice->getRandomSite();
-        lattice->wolff(randomSite);
+        equilibrationUpdates += latticeSize * gap + lattice->wolff(randomSite);
+        if (tracing && i % traceEvery == 0) {
+            Trace::complete("sweeps", sweepStart);
+        }
+
+        if (adaptive) {
+            energyDetector.add(lattice->calcTotalEnergy());
+            phiDetector.add(fabs(lattice->calcAvgPhi()));
+            if ((i + 1) % 64 == 0 && energyDetector.equilibrated() && phiDetector.equilibrated()) {
+                break;
+            }
+        }
+    }
+    if (adaptive) {
+        bool equilibrated = energyDetector.equilibrated() && phiDetector.equilibrated();
+        std::cerr << "adaptive: " << (equilibrated ? "equilibrated" : "not equilibrated") << " after "
+                  << energyDetector.size() << " of " << init << " iterations, MSER truncation at iteration "
+                  << std::max(energyDetector.truncation(), phiDetector.truncation()) << std::endl;
+    }
+    if (perf) {
+        perf->end("equilibration", equilibrationUpdates);
+    }
+    if (tracing) {
+        Trace::complete("equilibration", phaseStart);
+        phaseStart = Trace::now();
     }
 
 
-    for (unsigned int i = 0; i < sampleSize; i++) {
-        for (unsigned int j = 0; j < latticeSize * gap; j++) {
-            randomSite = lattice->getRandomSite();
-            lattice->metropolis(randomSite);
-        }
-        randomSite = lattice->getRandomSite();
-        lattice->wolff(randomSite);
+    if (estimators) {
+        lattice->setEstimators(estimators.get());
+    }
 
-        energyData[i] = lattice->calcTotalEnergy();
+    std::vector<siteIndex> clusterSizes(sampleSize);
+    // accumulate adds measurement i to the sums, once energyData[i] and phiData[i] hold it.
+    auto accumulate = [&](unsigned int i) {
         avgEnergy += energyData[i];
 
-        phiData[i] = lattice->calcAvgPhi();
         phiDataAbs[i] = fabs(phiData[i]);
         avgPhi += phiData[i];
         avgPhiAbs += phiDataAbs[i];
@@ -191,9 +374,147 @@ int main(int argc, char** const argv) {
             maxPhi = phiDataAbs[i];
         }
 
+        if (seriesColumns) {
+            seriesColumns->append({energyData[i], phiData[i], phiDataAbs[i], (double)clusterSizes[i]});
+        }
+
         sqrdEnergy += (energyData[i] * energyData[i]);
         sqrdPhi += (phiData[i] * phiData[i]);
         quartPhi += gsl_pow_4(phiData[i]);
+    };
+    auto measureField = [&](const double* field) {
+        if (correlations) {
+            correlations->add(field);
+        }
+        if (labeller) {
+            labeller->label(field, ClusterLabeller::geometric);
+            clusterStatistics.addGeometric(*labeller);
+            labeller->label(field, 1.0);
+            clusterStatistics.addImproved(*labeller);
+        }
+    };
+
+    // With --async the sampling only copies the field into a snapshot, worker threads measure
+    // it. The sums are taken in order once they are done, so the output doesn't change. The
+    // correlations and the clusters are measured one snapshot at a time, in any order.
+    typedef std::vector<double> FieldSnapshot;
+    std::unique_ptr<MeasurementPipeline<FieldSnapshot>> pipeline;
+    unsigned int asyncWorkers = 0;
+    std::mutex measureFieldMutex;
+    if (options.has("async")) {
+        asyncWorkers = options.getUInt("async", 2);
+        if (asyncWorkers == 0) {
+            asyncWorkers = std::max(1u, std::thread::hardware_concurrency() - 1);
+        }
+        pipeline = std::make_unique<MeasurementPipeline<FieldSnapshot>>(asyncWorkers, 4 * asyncWorkers,
+            [&](unsigned int, std::uint64_t index, const FieldSnapshot& snapshot) {
+                energyData[index] = lattice->calcTotalEnergy(snapshot.data());
+                phiData[index] = lattice->calcAvgPhi(snapshot.data());
+                if (correlations || labeller) {
+                    std::lock_guard<std::mutex> lock(measureFieldMutex);
+                    measureField(snapshot.data());
+                }
+            });
+    }
+
+    // Every phase below is bracketed separately so that the cluster growth can be
+    // told apart from the local updates. Cluster updates count one per added site.
+    for (unsigned int i = 0; i < sampleSize; i++) {
+        bool traced = tracing && i % traceEvery == 0;
+        uint64_t eventStart = traced ? Trace::now() : 0;
+        if (perf) {
+            perf->begin("metropolis");
+        }
+        if (sweeper) {
+            sweeper->sweep(gap);
+        } else {
+            for (siteIndex j = 0; j < latticeSize * gap; j++) {
+                randomSite = sequential ? j % latticeSize : lattice->getRandomSite();
+                lattice->metropolis(randomSite);
+            }
+        }
+        if (perf) {
+            perf->end("metropolis", latticeSize * gap);
+            perf->begin("wolff");
+        }
+        if (traced) {
+            Trace::complete("sweeps", eventStart);
+            eventStart = Trace::now();
+        }
+        randomSite = lattice->getRandomSite();
+        siteIndex clusterSize = lattice->wolff(randomSite);
+        if (perf) {
+            perf->end("wolff", clusterSize);
+            perf->begin("measurement");
+        }
+        if (traced) {
+            Trace::complete("wolff", eventStart);
+            eventStart = Trace::now();
+        }
+
+        clusterSizes[i] = clusterSize;
+        if (pipeline) {
+            FieldSnapshot& snapshot = pipeline->acquire();
+            snapshot.assign(lattice->getField(), lattice->getField() + latticeSize);
+            pipeline->publish();
+        } else {
+            energyData[i] = lattice->calcTotalEnergy();
+            phiData[i] = lattice->calcAvgPhi();
+            accumulate(i);
+            measureField(lattice->getField());
+        }
+        if (adaptive) {
+            spacing.add(phiDataAbs[i]);
+            gap = spacing.gap();
+        }
+        if (perf) {
+            perf->end("measurement", latticeSize);
+        }
+        if (traced) {
+            Trace::complete("measurement", eventStart);
+        }
+    }
+    if (pipeline) {
+        pipeline->finish();
+        for (unsigned int i = 0; i < sampleSize; i++) {
+            accumulate(i);
+        }
+        std::cerr << "async: " << sampleSize << " measurements on " << asyncWorkers << " workers, the sweeps waited for them "
+                  << pipeline->getStalls() << " times" << std::endl;
+    }
+    if (adaptive) {
+        std::cerr << "adaptive: " << gap << " metropolis sweeps between measurements, tau_int "
+                  << spacing.tau() << " sweeps" << std::endl;
+    }
+    if (perf) {
+        perf->report(stderr);
+    }
+    if (estimators) {
+        lattice->setEstimators(nullptr);
+        if (!options.get("improved", "").empty()) {
+            estimators->write(options.get("improved", ""));
+        }
+        estimators->report(stderr, 1.0);
+    }
+    if (labeller) {
+        clusterStatistics.write(options.get("clusters", "clusters.txt"));
+        clusterStatistics.report(stderr, 1.0);
+    }
+    if (correlations) {
+        correlations->write(options.get("correlations", "correlations.txt"));
+        std::cerr << "correlations: xi_2nd";
+        for (unsigned int d = 0; d < correlations->getDimensions(); d++) {
+            std::cerr << " " << "xyzt"[d] << " " << correlations->correlationLength(d);
+        }
+        if (correlations->size() >= 2) {
+            ResamplingResult xi = correlations->meanCorrelationLength(std::min<unsigned int>(32, correlations->size()));
+            std::cerr << ", mean " << xi.value << " +- " << xi.error;
+        }
+        std::cerr << " over " << correlations->size() << " measurements" << std::endl;
+    }
+    if (tracing) {
+        Trace::complete("sampling", phaseStart);
+        phaseStart = Trace::now();
     }
 
     delete lattice;
@@ -206,11 +527,44 @@ int main(int argc, char** const argv) {
     sqrdPhi /= sampleSize;
     quartPhi /= sampleSize;
 
-    // Add bootstrapping here (lol).
     specificHeat = sqrdEnergy - (avgEnergy * avgEnergy);
     specificHeat *= latticeSize;
     susceptibility = sqrdPhi - (avgPhiAbs * avgPhiAbs);
-    susceptibility += latticeSize;
+    susceptibility *= latticeSize;
+
+    // The errors of the derived quantities come from resampling the binned series.
+    // They are only computed on request since they add columns to the output.
+    std::vector<double> resampled;
+    if (options.has("resample")) {
+        TraceScope scope("resampling");
+        std::vector<std::vector<double>> series(5, std::vector<double>(sampleSize));
+        for (unsigned int i = 0; i < sampleSize; i++) {
+            series[0][i] = energyData[i];
+            series[1][i] = energyData[i] * energyData[i];
+            series[2][i] = phiDataAbs[i];
+            series[3][i] = phiData[i] * phiData[i];
+            series[4][i] = gsl_pow_4(phiData[i]);
+        }
+        // Short runs get fewer bins, every bin holds at least one measurement.
+        Resampler resampler(series, std::min(options.getUInt("resample", 32), sampleSize));
+
+        double size = latticeSize;
+        std::vector<DerivedQuantity> quantities = {
+            [](const std::vector<double>& a) { return a[0]; },
+            [](const std::vector<double>& a) { return a[2]; },
+            [=](const std::vector<double>& a) { return size * (a[1] - a[0] * a[0]); },
+            [=](const std::vector<double>& a) { return size * (a[3] - a[2] * a[2]); },
+            [](const std::vector<double>& a) { return 1 - a[4] / (3 * a[3] * a[3]); },
+        };
+
+        unsigned int resamples = options.getUInt("bootstrap", 0);
+        for (const DerivedQuantity& f : quantities) {
+            ResamplingResult result = (resamples > 0)
+                ? resampler.bootstrap(f, resamples, options.getUInt("bootstrap-seed", 1), options.getUInt("threads", 0))
+                : resampler.jackknife(f);
+            resampled.push_back(result.error);
+        }
+    }
 
     auto autocorTResults = caclAutocorTime(sampleSize, avgPhiAbs, phiDataAbs);
     double autocorTime = autocorTResults->autocorTime;
@@ -233,13 +587,42 @@ int main(int argc, char** const argv) {
     double cumulant = 1 - quartPhi / (3 * sqrdPhi * sqrdPhi);
     auto binResults = calcBimodality(bins, sampleSize, maxPhi, phiData);
 
-    std::cout.precision(6);       // Set precision to 3 decimal places.
-    std::cout << std::fixed;      // Ensures fixed-point notation.
-    std::cout << muSqrd << "," << lambda << "," << autocorTime << ",";
-    std::cout << avgEnergy << "," << energyStdDev << ",";
-    std::cout << avgPhiAbs << "," << phiStdDev << ",";
-    std::cout << specificHeat << "," << susceptibility << ",";
-    std::cout << cumulant << "," << binResults->bimodality << ",";
-    std::cout << avgPhi << "," << autocorTResults->scaleFactor;
-    std::cout << std::endl;
-}
\ No newline at end of file
+    if (tracing) {
+        Trace::complete("analysis", phaseStart);
+        Trace::write(traceFile);
+    }
+
+    std::ostringstream line;
+    line.precision(6);       // Set precision to 3 decimal places.
+    line << std::fixed;      // Ensures fixed-point notation.
+    line << muSqrd << "," << lambda << "," << autocorTime << ",";
+    line << avgEnergy << "," << energyStdDev << ",";
+    line << avgPhiAbs << "," << phiStdDev << ",";
+    line << specificHeat << "," << susceptibility << ",";
+    line << cumulant << "," << binResults->bimodality << ",";
+    line << avgPhi << "," << autocorTResults->scaleFactor;
+    // errE, errPhiAbs, errC, errChi, errCumulant.
+    for (double value : resampled) {
+        line << "," << value;
+    }
+    line << "\n";
+    std::cout << line.str() << std::flush;
+
+    if (cache) {
+        seriesColumns.reset();  // Flushed first.
+        CacheEntry entry;
+        entry.blobs.emplace_back("stdout", line.str());
+        std::vector<std::pair<std::string, std::string>> outputs = {
+            {"series", "series.col"}, {"correlations", "correlations.txt"}, {"clusters", "clusters.txt"},
+        };
+        for (const auto& [name, fallback] : outputs) {
+            if (options.has(name)) {
+                entry.addFile(options.get(name, fallback));
+            }
+        }
+        if (!options.get("improved", "").empty()) {
+            entry.addFile(options.get("improved", ""));
+        }
+        cache->store(description, entry);
+    }
+}